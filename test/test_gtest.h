@@ -1,6 +1,21 @@
 #pragma once
 #include "gtest\gtest.h"
 #include "tree_avl.h"
+#include "tree_avl_compact.h"
+#include "tree_avl_frozen.h"
+#include "tree_avl_interval.h"
+#include "tree_avl_noparent.h"
+#include "tree_bplus.h"
+#include "tree_concurrent.h"
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
 
 /// <summary> Testing fixture for TTree. </summary>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
@@ -35,6 +50,8 @@ protected:
 
     void test_find()
     {
+        ASSERT_TRUE(m_tree.isValid());
+
         // search for each key and compare with corresponding value
         for(int i = 0, n = (int)m_aKey.size(); i < n; ++i)
         {
@@ -53,6 +70,7 @@ protected:
             m_tree.erase(m_aKey[i]);
             const int* pVal = m_tree.find(m_aKey[i]);
             ASSERT_TRUE(pVal == NULL);
+            ASSERT_TRUE(m_tree.isValid());
         }
 
         // ensure that the tree is empty
@@ -115,6 +133,1963 @@ TEST_F(Tree_10_shuffled, TestIterator)
     test_iterator();
 }
 
+/// <summary> Inserts keys 0..nKey-1 in shuffled order and checks that iteration follows the comparator order. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Tree> void test_compare(Tree& tree, int nKey, bool bReverse)
+{
+    std::vector<int> aKey(nKey);
+    for(int i = 0; i < nKey; ++i)
+        aKey[i] = i;
+    std::default_random_engine generator(nKey);
+    std::shuffle(aKey.begin(), aKey.end(), generator);
+    for(int i = 0; i < nKey; ++i)
+        tree.insert(aKey[i], aKey[i]);
+
+    int count = 0;
+    for(typename Tree::Iterator it = tree.begin(); !it.isEnd(); it.next(), ++count)
+        ASSERT_EQ(it.key(), bReverse ? nKey - 1 - count : count);
+    ASSERT_EQ(count, nKey);
+    ASSERT_TRUE(tree.find(nKey / 2) != NULL);
+    ASSERT_TRUE(tree.find(nKey) == NULL);
+}
+
+static int reverseCompFunc(const int& a, const int& b)
+{
+    return defCompFunc(b, a);
+}
+
+// tests for comparators of different styles
+TEST(TreeCompare, FunctionPointer)
+{
+    Tree<int, int, TreeCompareFn<int>> tree(reverseCompFunc);
+    test_compare(tree, 100, true);
+}
+
+TEST(TreeCompare, LessStyle)
+{
+    Tree<int, int, std::greater<int>> tree;
+    test_compare(tree, 100, true);
+}
+
+TEST(TreeCompare, Lambda)
+{
+    auto cmp = [](int a, int b) { return a < b; };
+    Tree<int, int, decltype(cmp)> tree(cmp);
+    test_compare(tree, 100, false);
+}
+
+/// <summary> Stateful three-way comparator, direction is set on construction. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+struct DirectionCompare
+{
+    explicit DirectionCompare(int dir = 1) : m_dir(dir) {}
+    int operator()(int a, int b) const { return m_dir * defCompFunc(a, b); }
+    int m_dir;
+};
+
+TEST(TreeCompare, Stateful)
+{
+    Tree<int, int, DirectionCompare> tree(DirectionCompare(-1));
+    test_compare(tree, 100, true);
+}
+
+TEST(TreeCompare, DefaultNonArithmetic)
+{
+    Tree<std::string, int> tree;
+    tree.insert("b", 2);
+    tree.insert("a", 1);
+    tree.insert("c", 3);
+    Tree<std::string, int>::Iterator it = tree.begin();
+    ASSERT_EQ(it.key(), "a");
+    it.next();
+    ASSERT_EQ(it.key(), "b");
+    ASSERT_EQ(*tree.find("c"), 3);
+}
+
+// tests for allocators of nodes
+TEST(TreeNodePool, Recycle)
+{
+    TreeNodePool<TreeNode<int, int>> pool;
+    TreeNode<int, int>* p1 = pool.allocate();
+    TreeNode<int, int>* p2 = pool.allocate();
+    ASSERT_EQ(p1 + 1, p2);
+    pool.deallocate(p1);
+    ASSERT_EQ(pool.allocate(), p1);
+}
+
+/// <summary> Value which counts number of living instances. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+struct CountedValue
+{
+    CountedValue() { ++s_count; }
+    CountedValue(const CountedValue&) { ++s_count; }
+    ~CountedValue() { --s_count; }
+    CountedValue& operator=(const CountedValue&) { return *this; }
+    static int s_count;
+};
+int CountedValue::s_count = 0;
+
+template<template<class> class Alloc> void test_alloc_destroy()
+{
+    {
+        Tree<int, CountedValue, TreeCompare<int>, Alloc> tree;
+        for(int i = 0; i < 1000; ++i)
+            tree.insert(i, CountedValue());
+        for(int i = 0; i < 1000; i += 2)
+            tree.erase(i);
+        ASSERT_EQ(CountedValue::s_count, 500);
+        for(int i = 0; i < 1000; i += 4)
+            tree.insert(i, CountedValue());
+        ASSERT_EQ(CountedValue::s_count, 750);
+    }
+    ASSERT_EQ(CountedValue::s_count, 0);
+}
+
+TEST(TreeAlloc, PoolDestroy)
+{
+    test_alloc_destroy<TreeNodePool>();
+}
+
+TEST(TreeAlloc, NewDestroy)
+{
+    test_alloc_destroy<TreeNodeNew>();
+}
+
+/// <summary> Checks public API of tree: inserts shuffled keys, searches, iterates and erases them. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Tree> void test_tree_api(int nKey)
+{
+    std::vector<int> aKey(nKey);
+    for(int i = 0; i < nKey; ++i)
+        aKey[i] = i;
+    std::default_random_engine generator(nKey);
+    std::shuffle(aKey.begin(), aKey.end(), generator);
+
+    Tree tree;
+    for(int i = 0; i < nKey; ++i)
+        tree.insert(aKey[i], 2 * aKey[i]);
+    tree[nKey] = 2 * nKey;
+
+    // search
+    for(int i = 0; i <= nKey; ++i)
+    {
+        const int* pVal = tree.find(i);
+        ASSERT_TRUE(pVal != NULL);
+        ASSERT_EQ(*pVal, 2 * i);
+    }
+    ASSERT_TRUE(tree.find(-1) == NULL);
+
+    // iterate
+    int count = 0;
+    for(typename Tree::Iterator it = tree.begin(); !it.isEnd(); it.next(), ++count)
+    {
+        ASSERT_EQ(it.key(), count);
+        ASSERT_EQ(it.value(), 2 * count);
+    }
+    ASSERT_EQ(count, nKey + 1);
+
+    // erase odd keys, then insert them again, then erase all
+    for(int i = 1; i < nKey; i += 2)
+        tree.erase(i);
+    for(int i = 0; i < nKey; ++i)
+        ASSERT_EQ(tree.find(i) != NULL, i % 2 == 0);
+    for(int i = 1; i < nKey; i += 2)
+        tree.insert(i, 2 * i);
+    for(int i = 0; i < nKey; ++i)
+        ASSERT_TRUE(tree.find(i) != NULL);
+    for(int i = 0; i < nKey; ++i)
+        tree.erase(aKey[i]);
+    tree.erase(nKey);
+    ASSERT_TRUE(tree.begin().isEnd());
+}
+
+// tests for compact tree
+TEST(TreeCompact, Api)
+{
+    test_tree_api<TreeCompact<int, int>>(1000);
+
+    // random insertions and erasures keep the structure valid, the erased nodes are reused
+    TreeCompact<int, int> tree;
+    std::default_random_engine generator(3);
+    std::uniform_int_distribution<int> distribution(0, 499);
+    for(int i = 0; i < 5000; ++i)
+    {
+        const int key = distribution(generator);
+        if(i % 3 == 2)
+            tree.erase(key);
+        else
+            tree.insert(key, 2 * key);
+        if(i % 100 == 0)
+        {
+            ASSERT_TRUE(tree.isValid());
+        }
+    }
+    ASSERT_TRUE(tree.isValid());
+    for(TreeCompact<int, int>::Iterator it = tree.begin(); !it.isEnd(); it.next())
+        ASSERT_EQ(it.value(), 2 * it.key());
+}
+
+TEST(TreeCompact, NodeSize)
+{
+    ASSERT_LE(2 * sizeof(TreeCompactNode<int, int>), sizeof(TreeNode<int, int>));
+}
+
+// tests for tree without links to parent
+TEST(TreeNoParent, Api)
+{
+    test_tree_api<TreeNoParent<int, int>>(1000);
+}
+
+TEST(TreeNoParent, NodeSize)
+{
+    ASSERT_EQ(sizeof(TreeNoParentNode<int, int>) + sizeof(void*), sizeof(TreeNode<int, int>));
+}
+
+/// <summary> Checks B+ tree against std::map under random inserts and erases, the keys are made by the function from random numbers. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Tree, class Key, class MapCompare = std::less<Key>, class MakeKey> void test_bplus_random(MakeKey makeKey, int nRange, int nStep)
+{
+    std::default_random_engine generator(nRange);
+    std::uniform_int_distribution<int> number(0, nRange);
+    Tree tree;
+    std::map<Key, int, MapCompare> map;
+    for(int i = 0; i < nStep; ++i)
+    {
+        const Key key = makeKey(number(generator));
+        // erase more often in the second half, so the tree shrinks to few leaves
+        if(number(generator) % 8 < (2 * i < nStep ? 3 : 5))
+        {
+            tree.erase(key);
+            map.erase(key);
+        }
+        else
+        {
+            tree.insert(key, i);
+            map[key] = i;
+        }
+        if(i % 512 == 0)
+        {
+            ASSERT_TRUE(tree.isValid());
+        }
+    }
+    ASSERT_TRUE(tree.isValid());
+    ASSERT_EQ(tree.size(), map.size());
+
+    typename Tree::Iterator it = tree.begin();
+    for(typename std::map<Key, int, MapCompare>::const_iterator itStd = map.begin(); itStd != map.end(); ++itStd, it.next())
+    {
+        ASSERT_FALSE(it.isEnd());
+        ASSERT_TRUE(it.key() == itStd->first);
+        ASSERT_EQ(it.value(), itStd->second);
+        const int* pVal = tree.find(itStd->first);
+        ASSERT_TRUE(pVal != NULL);
+        ASSERT_EQ(*pVal, itStd->second);
+    }
+    ASSERT_TRUE(it.isEnd());
+
+    for(int i = 0; i <= nRange; ++i)
+        ASSERT_EQ(tree.find(makeKey(i)) != NULL, map.count(makeKey(i)) != 0);
+    tree.clear();
+    ASSERT_TRUE(tree.isValid());
+    ASSERT_TRUE(tree.begin().isEnd());
+}
+
+// tests for B+ tree
+TEST(TreeBPlus, Api)
+{
+    test_tree_api<TreeBPlus<int, int>>(1000);
+    test_tree_api<TreeBPlus<int, int, TreeCompare<int>, 16>>(1000);
+    test_tree_api<TreeBPlus<int, int, TreeCompare<int>, 64>>(1000);
+}
+
+TEST(TreeBPlus, Random)
+{
+    // SIMD search of integers
+    test_bplus_random<TreeBPlus<int, int>, int>([](int i) { return i - 1000; }, 2000, 20000);
+    test_bplus_random<TreeBPlus<int, int, TreeCompare<int>, 16>, int>([](int i) { return i; }, 20000, 60000);
+    test_bplus_random<TreeBPlus<int, int, TreeCompare<int>, 64>, int>([](int i) { return i == 0 ? std::numeric_limits<int>::min() : i == 1 ? std::numeric_limits<int>::max() : i; }, 20000, 60000);
+    // the counting search of other arithmetic keys
+    test_bplus_random<TreeBPlus<double, int, TreeCompare<double>, 16>, double>([](int i) { return i * 0.5; }, 5000, 20000);
+    // the binary search by the comparator
+    test_bplus_random<TreeBPlus<std::string, int, TreeCompare<std::string>, 16>, std::string>([](int i) { return std::to_string(i); }, 5000, 20000);
+    test_bplus_random<TreeBPlus<int, int, std::greater<int>, 16>, int, std::greater<int>>([](int i) { return i; }, 5000, 20000);
+}
+
+TEST(TreeBPlus, Sorted)
+{
+    // ascending and descending inserts split the last and the first leaves, erase in order releases the leaves one by one
+    TreeBPlus<int, int, TreeCompare<int>, 16> tree;
+    for(int i = 0; i < 10000; ++i)
+    {
+        tree.insert(i, i);
+        tree.insert(-i - 1, i);
+    }
+    ASSERT_TRUE(tree.isValid());
+    ASSERT_EQ(tree.size(), 20000u);
+    for(int i = -10000; i < 10000; i += 2)
+        tree.erase(i);
+    ASSERT_TRUE(tree.isValid());
+    for(int i = -9999; i < 10000; i += 2)
+    {
+        tree.erase(i);
+        if((i + 9999) % 1000 == 0)
+        {
+            ASSERT_TRUE(tree.isValid());
+        }
+    }
+    ASSERT_EQ(tree.size(), 0u);
+    ASSERT_TRUE(tree.isValid());
+}
+
+// tests for balancing
+TEST(TreeBalance, RandomOperations)
+{
+    std::default_random_engine generator(1);
+    std::uniform_int_distribution<int> key(0, 500);
+    Tree<int, int> tree;
+    std::map<int, int> map;
+    for(int i = 0; i < 20000; ++i)
+    {
+        const int k = key(generator);
+        if(i % 3 == 0)
+        {
+            tree.erase(k);
+            map.erase(k);
+        }
+        else
+            tree.insert(k, map[k] = i);
+
+        if(i % 100 == 0)
+        {
+            ASSERT_TRUE(tree.isValid());
+        }
+    }
+    ASSERT_TRUE(tree.isValid());
+
+    // compare content with std::map
+    Tree<int, int>::Iterator it = tree.begin();
+    for(std::map<int, int>::const_iterator itMap = map.begin(); itMap != map.end(); ++itMap, it.next())
+    {
+        ASSERT_FALSE(it.isEnd());
+        ASSERT_EQ(it.key(), itMap->first);
+        ASSERT_EQ(it.value(), itMap->second);
+    }
+    ASSERT_TRUE(it.isEnd());
+}
+
+TEST(TreeBalance, RetraceStats)
+{
+    // consecutive insertion: retrace is O(1) amortized, not O(log n)
+    const int nKey = 1 << 16;
+    Tree<int, int> tree;
+    for(int i = 0; i < nKey; ++i)
+        tree.insert(i, i);
+    ASSERT_LT(tree.stats().m_nRetrace, size_t(3 * nKey));
+    ASSERT_LT(tree.stats().m_nRotation, size_t(nKey));
+
+    tree.reset_stats();
+    for(int i = 0; i < nKey; ++i)
+        tree.erase(i);
+    ASSERT_LT(tree.stats().m_nRetrace, size_t(3 * nKey));
+    ASSERT_TRUE(tree.begin().isEnd());
+}
+
+// tests for building of the tree from sorted range
+TEST(TreeBulkLoad, AssignSorted)
+{
+    for(int nKey = 0; nKey < 100; ++nKey)
+    {
+        std::vector<std::pair<int, int>> aPair;
+        for(int i = 0; i < nKey; ++i)
+            aPair.push_back(std::make_pair(2 * i, i));
+
+        Tree<int, int> tree;
+        tree.insert(1, 1);
+        tree.assign_sorted(aPair.begin(), aPair.end());
+        ASSERT_TRUE(tree.isValid());
+        ASSERT_TRUE(tree.find(1) == NULL);
+
+        int count = 0;
+        for(Tree<int, int>::Iterator it = tree.begin(); !it.isEnd(); it.next(), ++count)
+        {
+            ASSERT_EQ(it.key(), 2 * count);
+            ASSERT_EQ(it.value(), count);
+        }
+        ASSERT_EQ(count, nKey);
+
+        // the tree stays modifiable
+        tree.insert(1, 1);
+        tree.erase(0);
+        ASSERT_TRUE(tree.isValid());
+    }
+}
+
+TEST(TreeBulkLoad, Constructor)
+{
+    std::map<std::string, int> map;
+    for(int i = 0; i < 1000; ++i)
+        map[std::to_string(i)] = i;
+
+    Tree<std::string, int> tree(map.begin(), map.end());
+    ASSERT_TRUE(tree.isValid());
+    for(int i = 0; i < 1000; ++i)
+        ASSERT_EQ(*tree.find(std::to_string(i)), i);
+}
+
+// tests for insertion of batch
+TEST(TreeBatch, InsertBatch)
+{
+    std::default_random_engine generator(2);
+    std::uniform_int_distribution<int> key(0, 100000);
+
+    // small and large batches relative to the tree, including duplicated keys
+    const int aBatch[] = { 10, 1000, 50000, 200000 };
+    for(int t = 0; t < 4; ++t)
+    {
+        Tree<int, int> tree;
+        std::map<int, int> map;
+        for(int i = 0; i < 10000; ++i)
+        {
+            const int k = key(generator);
+            tree.insert(k, map[k] = i);
+        }
+
+        std::vector<std::pair<int, int>> aPair;
+        for(int i = 0; i < aBatch[t]; ++i)
+        {
+            const int k = key(generator);
+            aPair.push_back(std::make_pair(k, -i));
+            map[k] = -i;
+        }
+        tree.insert_batch(aPair.begin(), aPair.end());
+        ASSERT_TRUE(tree.isValid());
+        ASSERT_EQ(tree.size(), map.size());
+
+        Tree<int, int>::Iterator it = tree.begin();
+        for(std::map<int, int>::const_iterator itMap = map.begin(); itMap != map.end(); ++itMap, it.next())
+        {
+            ASSERT_EQ(it.key(), itMap->first);
+            ASSERT_EQ(it.value(), itMap->second);
+        }
+    }
+}
+
+/// <summary> Value which counts copies and moves. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+struct HeavyValue
+{
+    HeavyValue() : m_a(0), m_b(0) {}
+    HeavyValue(int a, int b) : m_a(a), m_b(b) {}
+    HeavyValue(const HeavyValue& v) : m_a(v.m_a), m_b(v.m_b) { ++s_nCopy; }
+    HeavyValue(HeavyValue&& v) : m_a(v.m_a), m_b(v.m_b) { ++s_nMove; }
+    HeavyValue& operator=(const HeavyValue& v) { m_a = v.m_a; m_b = v.m_b; ++s_nCopy; return *this; }
+    HeavyValue& operator=(HeavyValue&& v) { m_a = v.m_a; m_b = v.m_b; ++s_nMove; return *this; }
+
+    int m_a, m_b;
+    static int s_nCopy, s_nMove;
+};
+int HeavyValue::s_nCopy = 0;
+int HeavyValue::s_nMove = 0;
+
+// tests for construction of keys and values in place
+TEST(TreeEmplace, InPlace)
+{
+    Tree<std::string, HeavyValue> tree;
+    HeavyValue::s_nCopy = HeavyValue::s_nMove = 0;
+
+    // the value is constructed in place
+    std::pair<Tree<std::string, HeavyValue>::Iterator, bool> res = tree.try_emplace("b", 1, 2);
+    ASSERT_TRUE(res.second);
+    ASSERT_EQ(res.first.key(), "b");
+    ASSERT_EQ(res.first.value().m_b, 2);
+    res = tree.emplace("a", 3, 4);
+    ASSERT_TRUE(res.second);
+    ASSERT_EQ(tree.find("a")->m_a, 3);
+    ASSERT_EQ(HeavyValue::s_nCopy + HeavyValue::s_nMove, 0);
+
+    // existing key: try_emplace doesn't touch the value, emplace destroys new node
+    res = tree.try_emplace("b", 5, 6);
+    ASSERT_FALSE(res.second);
+    ASSERT_EQ(res.first.value().m_a, 1);
+    res = tree.emplace("a", 7, 8);
+    ASSERT_FALSE(res.second);
+    ASSERT_EQ(res.first.value().m_a, 3);
+
+    // rvalues are moved
+    res = tree.insert(std::string("c"), HeavyValue(9, 10));
+    ASSERT_TRUE(res.second);
+    ASSERT_EQ(HeavyValue::s_nCopy, 0);
+    ASSERT_EQ(HeavyValue::s_nMove, 1);
+
+    // insert_or_assign replaces the value of existing key
+    res = tree.insert_or_assign("c", HeavyValue(11, 12));
+    ASSERT_FALSE(res.second);
+    ASSERT_EQ(tree.find("c")->m_a, 11);
+    ASSERT_EQ(HeavyValue::s_nCopy, 0);
+    ASSERT_EQ(tree.size(), 3u);
+    ASSERT_TRUE(tree.isValid());
+}
+
+TEST(TreeEmplace, MoveOnlyValue)
+{
+    Tree<int, std::unique_ptr<int>> tree;
+    for(int i = 0; i < 100; ++i)
+        tree.try_emplace(i, new int(i));
+    tree.insert_or_assign(5, std::unique_ptr<int>(new int(50)));
+    tree[200].reset(new int(200));
+    ASSERT_EQ(**tree.find(5), 50);
+    ASSERT_EQ(**tree.find(99), 99);
+    ASSERT_EQ(**tree.find(200), 200);
+    ASSERT_TRUE(tree.isValid());
+}
+
+// the key which counts its constructions, comparable with int
+struct CountedKey
+{
+    explicit CountedKey(int n) : m_n(n) { ++s_nCreate; }
+    CountedKey(const CountedKey& key) : m_n(key.m_n) { ++s_nCreate; }
+    int m_n;
+    static int s_nCreate;
+};
+int CountedKey::s_nCreate = 0;
+
+inline bool operator<(const CountedKey& a, const CountedKey& b) { return a.m_n < b.m_n; }
+inline bool operator<(const CountedKey& a, int b) { return a.m_n < b; }
+inline bool operator<(int a, const CountedKey& b) { return a < b.m_n; }
+
+TEST(TreeTransparent, NoKeyConstruction)
+{
+    Tree<CountedKey, int, TreeCompare<void>> tree;
+    for(int i = 0; i < 100; i += 2)
+        tree.try_emplace(CountedKey(i), i);
+
+    CountedKey::s_nCreate = 0;
+    for(int i = 0; i < 100; ++i)
+    {
+        const int* pVal = tree.find(i);
+        ASSERT_EQ(pVal != NULL, i % 2 == 0);
+        ASSERT_TRUE(!pVal || *pVal == i);
+        ASSERT_EQ(tree.count(i), size_t(i % 2 == 0));
+    }
+    for(int i = 0; i < 100; i += 4)
+        tree.erase(i);
+    ASSERT_EQ(CountedKey::s_nCreate, 0);
+    ASSERT_EQ(tree.size(), 25u);
+    ASSERT_EQ(tree.count(4), 0u);
+    ASSERT_EQ(tree.count(6), 1u);
+    ASSERT_TRUE(tree.isValid());
+}
+
+TEST(TreeTransparent, StringKey)
+{
+    Tree<std::string, int, TreeCompare<void>> tree;
+    tree.insert(std::string("alpha"), 1);
+    tree.insert(std::string("beta"), 2);
+    tree.insert(std::string("gamma"), 3);
+    const char* sBeta = "beta";
+    ASSERT_EQ(*tree.find(sBeta), 2);
+    ASSERT_TRUE(tree.find("delta") == NULL);
+    tree.erase("alpha");
+    ASSERT_EQ(tree.count("alpha"), 0u);
+    ASSERT_EQ(tree.size(), 2u);
+
+    // std::less<> is transparent too
+    Tree<std::string, int, std::less<>> treeLess;
+    treeLess.insert(std::string("alpha"), 1);
+    ASSERT_EQ(*treeLess.find("alpha"), 1);
+    ASSERT_EQ(treeLess.count("beta"), 0u);
+}
+
+// tests for order statistics
+typedef Tree<int, int, TreeCompare<int>, TreeNodePool, TreeAugmentCount> CountTree;
+
+TEST(TreeAugment, OrderStatistics)
+{
+    std::default_random_engine generator(2);
+    std::uniform_int_distribution<int> key(0, 1000);
+    CountTree tree;
+    std::map<int, int> map;
+    for(int i = 0; i < 20000; ++i)
+    {
+        const int k = key(generator);
+        if(i % 3 == 0)
+        {
+            tree.erase(k);
+            map.erase(k);
+        }
+        else
+            tree.insert(k, map[k] = i);
+
+        if(i % 500 == 0)
+        {
+            ASSERT_TRUE(tree.isValid());
+        }
+    }
+    ASSERT_TRUE(tree.isValid());
+    ASSERT_EQ(tree.size(), map.size());
+
+    // k-th node and rank of each key
+    size_t k = 0;
+    for(std::map<int, int>::const_iterator it = map.begin(); it != map.end(); ++it, ++k)
+    {
+        CountTree::Iterator itSel = tree.select(k);
+        ASSERT_FALSE(itSel.isEnd());
+        ASSERT_EQ(itSel.key(), it->first);
+        ASSERT_EQ(tree.rank(it->first), k);
+    }
+    ASSERT_TRUE(tree.select(k).isEnd());
+
+    // ranges with bounds which are absent in the tree
+    for(int lo = -10; lo < 1010; lo += 37)
+    {
+        for(int hi = lo - 50; hi < 1020; hi += 91)
+        {
+            const size_t nExpected = hi > lo ? std::distance(map.lower_bound(lo), map.lower_bound(hi)) : 0;
+            ASSERT_EQ(tree.count_range(lo, hi), nExpected);
+        }
+    }
+}
+
+TEST(TreeAugment, BulkOperations)
+{
+    std::vector<std::pair<int, int>> aPair;
+    for(int i = 0; i < 1000; ++i)
+        aPair.push_back(std::make_pair(2 * i, i));
+    CountTree tree;
+    tree.assign_sorted(aPair.begin(), aPair.end());
+    ASSERT_TRUE(tree.isValid());
+    ASSERT_EQ(tree.select(500).key(), 1000);
+
+    // small batch is merged by insertion, large one - by rebuilding
+    for(int i = 0; i < 10; ++i)
+        aPair[i].first = 2 * i + 1;
+    tree.insert_batch(aPair.begin(), aPair.begin() + 10);
+    ASSERT_TRUE(tree.isValid());
+    for(int i = 0; i < 1000; ++i)
+        aPair[i].first = 4 * i + 3;
+    tree.insert_batch(aPair.begin(), aPair.end());
+    ASSERT_TRUE(tree.isValid());
+    ASSERT_EQ(tree.size(), 2005u);
+    ASSERT_EQ(tree.count_range(0, 20), 20u);
+}
+
+TEST(TreeAugment, NodeSize)
+{
+    // the default augmentation takes no space
+    ASSERT_EQ(sizeof(TreeNode<int, int>), sizeof(TreeNode<int, int, TreeAugmentNone>));
+    ASSERT_EQ(sizeof(TreeNode<int, int, TreeAugmentCount>), sizeof(TreeNode<int, int>) + sizeof(size_t));
+}
+
+// tests for bound queries and range scans
+TEST(TreeRange, Bounds)
+{
+    std::default_random_engine generator(3);
+    std::uniform_int_distribution<int> key(0, 2000);
+    Tree<int, int> tree;
+    std::map<int, int> map;
+    for(int i = 0; i < 1000; ++i)
+    {
+        const int k = key(generator);
+        tree.insert_or_assign(k, map[k] = i);
+    }
+
+    for(int k = -5; k < 2010; ++k)
+    {
+        std::map<int, int>::const_iterator itLow = map.lower_bound(k), itHigh = map.upper_bound(k);
+        Tree<int, int>::Iterator it = tree.lower_bound(k);
+        ASSERT_EQ(it.isEnd(), itLow == map.end());
+        ASSERT_TRUE(it.isEnd() || it.key() == itLow->first);
+        ASSERT_TRUE(tree.ceiling(k) == it);
+
+        it = tree.upper_bound(k);
+        ASSERT_EQ(it.isEnd(), itHigh == map.end());
+        ASSERT_TRUE(it.isEnd() || it.key() == itHigh->first);
+
+        std::pair<Tree<int, int>::Iterator, Tree<int, int>::Iterator> range = tree.equal_range(k);
+        ASSERT_TRUE(range.first == tree.lower_bound(k));
+        ASSERT_TRUE(range.second == tree.upper_bound(k));
+        ASSERT_EQ(range.first != range.second, map.count(k) == 1);
+
+        // floor is the node before upper bound
+        it = tree.floor(k);
+        ASSERT_EQ(it.isEnd(), itHigh == map.begin());
+        if(!it.isEnd())
+        {
+            --itHigh;
+            ASSERT_EQ(it.key(), itHigh->first);
+        }
+    }
+    Tree<int, int> empty;
+    ASSERT_TRUE(empty.lower_bound(1).isEnd());
+    ASSERT_TRUE(empty.floor(1).isEnd());
+}
+
+TEST(TreeRange, ForEachInRange)
+{
+    std::default_random_engine generator(4);
+    std::uniform_int_distribution<int> key(0, 2000);
+    Tree<int, int> tree;
+    std::map<int, int> map;
+    for(int i = 0; i < 1000; ++i)
+    {
+        const int k = key(generator);
+        tree.insert_or_assign(k, map[k] = i);
+    }
+
+    for(int lo = -10; lo < 2010; lo += 53)
+    {
+        for(int hi = lo - 20; hi < 2020; hi += 117)
+        {
+            std::vector<std::pair<int, int>> aVisited;
+            tree.for_each_in_range(lo, hi, [&aVisited](const int& k, int& v) { aVisited.push_back(std::make_pair(k, v)); });
+            const std::vector<std::pair<int, int>> aExpected(map.lower_bound(lo), hi > lo ? map.lower_bound(hi) : map.lower_bound(lo));
+            ASSERT_TRUE(aVisited == aExpected);
+        }
+    }
+
+    // values are modifiable
+    tree.for_each_in_range(0, 2001, [](const int&, int& v) { v = -1; });
+    for(Tree<int, int>::Iterator it = tree.begin(); !it.isEnd(); it.next())
+        ASSERT_EQ(it.value(), -1);
+}
+
+TEST(TreeRange, Transparent)
+{
+    Tree<std::string, int, TreeCompare<void>> tree;
+    const char* aKey[] = { "apple", "banana", "cherry", "date" };
+    for(int i = 0; i < 4; ++i)
+        tree.insert(std::string(aKey[i]), i);
+    ASSERT_EQ(tree.lower_bound("b").key(), "banana");
+    ASSERT_EQ(tree.upper_bound("banana").key(), "cherry");
+    ASSERT_EQ(tree.floor("c").key(), "banana");
+    int nVisited = 0;
+    tree.for_each_in_range("b", "d", [&nVisited](const std::string&, int&) { ++nVisited; });
+    ASSERT_EQ(nVisited, 2);
+}
+
+// tests for erasing of range
+template<class Tree> void test_erase_range(unsigned seed)
+{
+    std::default_random_engine generator(seed);
+    std::uniform_int_distribution<int> key(0, 5000);
+    Tree tree;
+    std::map<int, int> map;
+    for(int round = 0; round < 200; ++round)
+    {
+        for(int i = 0; i < 100; ++i)
+        {
+            const int k = key(generator);
+            tree.insert_or_assign(k, map[k] = i);
+        }
+
+        // erase range with bounds which may be absent in the tree
+        int lo = key(generator), hi = lo + key(generator) / (1 + round % 10);
+        if(round % 7 == 0)
+            std::swap(lo, hi);
+        const size_t nExpected = hi > lo ? std::distance(map.lower_bound(lo), map.lower_bound(hi)) : 0;
+        if(hi > lo)
+            map.erase(map.lower_bound(lo), map.lower_bound(hi));
+        ASSERT_EQ(tree.erase_range(lo, hi), nExpected);
+        ASSERT_TRUE(tree.isValid());
+        ASSERT_EQ(tree.size(), map.size());
+    }
+
+    typename Tree::Iterator it = tree.begin();
+    for(std::map<int, int>::const_iterator itMap = map.begin(); itMap != map.end(); ++itMap, it.next())
+    {
+        ASSERT_FALSE(it.isEnd());
+        ASSERT_EQ(it.key(), itMap->first);
+        ASSERT_EQ(it.value(), itMap->second);
+    }
+    ASSERT_TRUE(it.isEnd());
+}
+
+TEST(TreeEraseRange, Random)
+{
+    test_erase_range<Tree<int, int>>(5);
+}
+
+TEST(TreeEraseRange, SubtreeSizes)
+{
+    test_erase_range<CountTree>(6);
+}
+
+TEST(TreeEraseRange, Iterators)
+{
+    Tree<int, CountedValue, TreeCompare<int>, TreeNodeNew> tree;
+    for(int i = 0; i < 1000; ++i)
+        tree.insert(i, CountedValue());
+
+    // erase [100, 200), the iterator to the end of range is kept
+    Tree<int, CountedValue, TreeCompare<int>, TreeNodeNew>::Iterator it = tree.erase(tree.lower_bound(100), tree.lower_bound(200));
+    ASSERT_EQ(it.key(), 200);
+    ASSERT_EQ(CountedValue::s_count, 900);
+    ASSERT_TRUE(tree.find(99) && !tree.find(100) && !tree.find(199) && tree.find(200));
+
+    // empty range, range till the end, everything
+    tree.erase(tree.lower_bound(500), tree.lower_bound(500));
+    ASSERT_EQ(tree.size(), 900u);
+    ASSERT_TRUE(tree.erase(tree.lower_bound(900), tree.lower_bound(2000)).isEnd());
+    ASSERT_EQ(tree.size(), 800u);
+    ASSERT_TRUE(tree.isValid());
+    tree.erase(tree.begin(), tree.lower_bound(2000));
+    ASSERT_EQ(tree.size(), 0u);
+    ASSERT_TRUE(tree.begin().isEnd());
+    ASSERT_EQ(CountedValue::s_count, 0);
+}
+
+// tests for split and join
+template<class Tree> void test_split_join(unsigned seed)
+{
+    std::default_random_engine generator(seed);
+    std::uniform_int_distribution<int> key(0, 3000);
+    for(int round = 0; round < 50; ++round)
+    {
+        Tree tree;
+        std::map<int, int> map;
+        for(int i = 0, n = round * 20; i < n; ++i)
+        {
+            const int k = key(generator);
+            tree.insert_or_assign(k, map[k] = i);
+        }
+
+        // split by the key which may be absent in the tree
+        const int k = key(generator);
+        Tree right;
+        right.insert(-1, -1);
+        tree.split(k, right);
+        ASSERT_TRUE(tree.isValid());
+        ASSERT_TRUE(right.isValid());
+        ASSERT_EQ(tree.size(), size_t(std::distance(map.begin(), map.lower_bound(k))));
+        ASSERT_EQ(right.size(), size_t(std::distance(map.lower_bound(k), map.end())));
+        ASSERT_TRUE(tree.lower_bound(k).isEnd());
+        ASSERT_TRUE(right.begin().isEnd() || right.begin().key() >= k);
+
+        // join back with or without the middle node
+        if(round % 2 && !right.find(k))
+        {
+            tree.join(k, -2, right);
+            map[k] = -2;
+        }
+        else
+            tree.join(right);
+        ASSERT_TRUE(tree.isValid());
+        ASSERT_EQ(right.size(), 0u);
+        ASSERT_TRUE(right.begin().isEnd());
+        ASSERT_EQ(tree.size(), map.size());
+        typename Tree::Iterator it = tree.begin();
+        for(std::map<int, int>::const_iterator itMap = map.begin(); itMap != map.end(); ++itMap, it.next())
+        {
+            ASSERT_FALSE(it.isEnd());
+            ASSERT_EQ(it.key(), itMap->first);
+            ASSERT_EQ(it.value(), itMap->second);
+        }
+        ASSERT_TRUE(it.isEnd());
+    }
+}
+
+TEST(TreeSplitJoin, Random)
+{
+    test_split_join<Tree<int, int>>(7);
+}
+
+TEST(TreeSplitJoin, SubtreeSizes)
+{
+    test_split_join<CountTree>(8);
+}
+
+TEST(TreeSplitJoin, SharedMemory)
+{
+    // the right part outlives the tree which allocated its nodes
+    std::unique_ptr<Tree<int, std::string>> pRight(new Tree<int, std::string>());
+    {
+        Tree<int, std::string> tree;
+        for(int i = 0; i < 1000; ++i)
+            tree.insert(i, std::to_string(i));
+        tree.split(500, *pRight);
+        ASSERT_EQ(tree.size(), 500u);
+    }
+    ASSERT_EQ(pRight->size(), 500u);
+    ASSERT_EQ(*pRight->find(700), "700");
+
+    // the nodes are recycled by the tree which received them
+    for(int i = 500; i < 600; ++i)
+        pRight->erase(i);
+    for(int i = 1000; i < 1100; ++i)
+        pRight->insert(i, std::to_string(i));
+    ASSERT_EQ(pRight->size(), 500u);
+    ASSERT_TRUE(pRight->isValid());
+
+    // join of trees with different pools
+    Tree<int, std::string> left;
+    left.insert(1, "1");
+    left.join(*pRight);
+    pRight.reset();
+    ASSERT_EQ(left.size(), 501u);
+    ASSERT_EQ(*left.find(1099), "1099");
+    ASSERT_TRUE(left.isValid());
+}
+
+// tests for set operations
+template<class Tree> void test_set_operations(unsigned seed, TreeThreadPool& pool)
+{
+    std::default_random_engine generator(seed);
+    for(int round = 0; round < 12; ++round)
+    {
+        // sizes of operands differ from equal to 1000 times
+        const int n1 = round % 3 == 0 ? 20000 : 5000, n2 = round % 4 == 0 ? 20 : 8000;
+        std::uniform_int_distribution<int> key(0, round % 2 ? 20000 : 200000);
+        std::map<int, int> map1, map2;
+        Tree tree1, tree2;
+        for(int i = 0; i < n1; ++i)
+        {
+            const int k = key(generator);
+            tree1.insert_or_assign(k, map1[k] = i);
+        }
+        for(int i = 0; i < n2; ++i)
+        {
+            const int k = key(generator);
+            tree2.insert_or_assign(k, map2[k] = -i);
+        }
+
+        std::map<int, int> expected;
+        switch(round % 3)
+        {
+        case 0:
+            expected = map1;
+            for(std::map<int, int>::const_iterator it = map2.begin(); it != map2.end(); ++it)
+                expected[it->first] = it->second;
+            tree1.union_with(tree2, pool);
+            break;
+        case 1:
+            for(std::map<int, int>::const_iterator it = map1.begin(); it != map1.end(); ++it)
+            {
+                if(map2.count(it->first))
+                    expected.insert(*it);
+            }
+            tree1.intersect_with(tree2, pool);
+            break;
+        default:
+            for(std::map<int, int>::const_iterator it = map1.begin(); it != map1.end(); ++it)
+            {
+                if(!map2.count(it->first))
+                    expected.insert(*it);
+            }
+            tree1.difference(tree2, pool);
+            break;
+        }
+
+        ASSERT_TRUE(tree1.isValid());
+        ASSERT_EQ(tree2.size(), 0u);
+        ASSERT_EQ(tree1.size(), expected.size());
+        typename Tree::Iterator it = tree1.begin();
+        for(std::map<int, int>::const_iterator itMap = expected.begin(); itMap != expected.end(); ++itMap, it.next())
+        {
+            ASSERT_FALSE(it.isEnd());
+            ASSERT_EQ(it.key(), itMap->first);
+            ASSERT_EQ(it.value(), itMap->second);
+        }
+        ASSERT_TRUE(it.isEnd());
+    }
+}
+
+TEST(TreeSetOperations, Sequential)
+{
+    TreeThreadPool pool(1);
+    test_set_operations<Tree<int, int>>(9, pool);
+}
+
+TEST(TreeSetOperations, Parallel)
+{
+    TreeThreadPool pool(4);
+    test_set_operations<Tree<int, int>>(10, pool);
+    test_set_operations<CountTree>(11, pool);
+}
+
+TEST(TreeSetOperations, Destroy)
+{
+    {
+        Tree<int, CountedValue, TreeCompare<int>, TreeNodeNew> tree1, tree2;
+        for(int i = 0; i < 10000; ++i)
+        {
+            tree1.insert(i, CountedValue());
+            tree2.insert(i + 5000, CountedValue());
+        }
+        TreeThreadPool pool(4);
+        tree1.intersect_with(tree2, pool);
+        ASSERT_EQ(tree1.size(), 5000u);
+        ASSERT_EQ(CountedValue::s_count, 5000);
+    }
+    ASSERT_EQ(CountedValue::s_count, 0);
+}
+
+/// <summary> The comparator which throws once when the shared limit of comparisons is exhausted. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+struct ThrowingCompare
+{
+    explicit ThrowingCompare(std::atomic<int>* pLimit = NULL) : m_pLimit(pLimit) {}
+
+    bool operator()(int a, int b) const
+    {
+        if(m_pLimit && (*m_pLimit)-- == 0)
+            throw std::runtime_error("compare");
+        return a < b;
+    }
+
+    std::atomic<int>* m_pLimit;
+};
+
+TEST(TreeSetOperations, Exception)
+{
+    // the comparator throws part-way, both trees remain valid and no node is lost or destroyed twice
+    typedef Tree<int, CountedValue, ThrowingCompare, TreeNodeNew> ThrowTree;
+    TreeThreadPool pool(4), poolSingle(1);
+    TreeThreadPool* aPool[] = { &pool, &poolSingle };
+    const int aLimit[] = { 0, 1, 7, 100, 1000, 10000, 100000 };
+    std::atomic<int> nLimit(std::numeric_limits<int>::max());
+    int nThrown = 0;
+    for(int p = 0; p < 2; ++p)
+    {
+        for(int op = 0; op < 3; ++op)
+        {
+            for(size_t l = 0; l < sizeof(aLimit) / sizeof(aLimit[0]); ++l)
+            {
+                {
+                    nLimit = std::numeric_limits<int>::max();
+                    ThrowTree tree1((ThrowingCompare(&nLimit))), tree2((ThrowingCompare(&nLimit)));
+                    for(int i = 0; i < 20000; ++i)
+                    {
+                        tree1.insert(2 * i, CountedValue());
+                        tree2.insert(3 * i, CountedValue());
+                    }
+
+                    nLimit = aLimit[l];
+                    try
+                    {
+                        if(op == 0)
+                            tree1.union_with(tree2, *aPool[p]);
+                        else if(op == 1)
+                            tree1.intersect_with(tree2, *aPool[p]);
+                        else
+                            tree1.difference(tree2, *aPool[p]);
+                    }
+                    catch(const std::runtime_error&)
+                    {
+                        ++nThrown;
+                    }
+
+                    nLimit = std::numeric_limits<int>::max();
+                    ASSERT_TRUE(tree1.isValid());
+                    ASSERT_TRUE(tree2.isValid());
+                    size_t nNode = 0;
+                    for(ThrowTree::Iterator it = tree1.begin(); !it.isEnd(); it.next())
+                        ++nNode;
+                    for(ThrowTree::Iterator it = tree2.begin(); !it.isEnd(); it.next())
+                        ++nNode;
+                    ASSERT_EQ(nNode, tree1.size() + tree2.size());
+                    ASSERT_EQ(size_t(CountedValue::s_count), tree1.size() + tree2.size());
+                }
+                ASSERT_EQ(CountedValue::s_count, 0);
+            }
+        }
+    }
+    ASSERT_GT(nThrown, 0);
+}
+
+TEST(TreeThreadPool, Exception)
+{
+    TreeThreadPool pool(2);
+    std::atomic<int> nDone(0);
+    ASSERT_THROW(pool.invoke([&nDone]() { ++nDone; }, [&nDone]() { ++nDone; throw std::runtime_error("task"); }), std::runtime_error);
+    ASSERT_EQ(nDone.load(), 2);
+}
+
+// counts the leaves of the binary recursion of fork-join tasks
+inline void pool_fork(TreeThreadPool& pool, int nDepth, std::atomic<int>& nLeaf)
+{
+    if(!nDepth)
+    {
+        ++nLeaf;
+        return;
+    }
+    pool.invoke([&]() { pool_fork(pool, nDepth - 1, nLeaf); }, [&]() { pool_fork(pool, nDepth - 1, nLeaf); });
+}
+
+TEST(TreeThreadPool, Nested)
+{
+    // the workers steal the nested tasks, the threads which aren't workers share one deque
+    TreeThreadPool pool(4);
+    std::atomic<int> nLeaf(0);
+    std::vector<std::thread> aThread;
+    for(int i = 0; i < 3; ++i)
+        aThread.push_back(std::thread([&]() { pool_fork(pool, 12, nLeaf); }));
+    pool_fork(pool, 12, nLeaf);
+    for(size_t i = 0; i < aThread.size(); ++i)
+        aThread[i].join();
+    ASSERT_EQ(nLeaf.load(), 4 << 12);
+}
+
+// tests for parallel passes over the tree
+TEST(TreeParallel, ForEach)
+{
+    TreeThreadPool pool(4), poolSingle(1);
+    TreeThreadPool* aPool[] = { &pool, &poolSingle };
+    for(int p = 0; p < 2; ++p)
+    {
+        for(int nKey = 0; nKey < 100000; nKey = nKey * 7 + 1)
+        {
+            Tree<int, int> tree;
+            for(int i = 0; i < nKey; ++i)
+                tree.insert((i * 7919) % nKey, 0);
+
+            // each node is visited once
+            std::atomic<long long> sum(0);
+            tree.parallel_for_each([&sum](const int& key, int& value) { ++value; sum += key; }, *aPool[p]);
+            ASSERT_EQ(sum.load(), (long long)nKey * (nKey - 1) / 2);
+            for(Tree<int, int>::Iterator it = tree.begin(); !it.isEnd(); it.next())
+                ASSERT_EQ(it.value(), 1);
+        }
+    }
+
+    // the exception of the function is rethrown
+    Tree<int, int> tree;
+    for(int i = 0; i < 10000; ++i)
+        tree.insert(i, i);
+    ASSERT_THROW(tree.parallel_for_each([](const int& key, int&) { if(key == 7777) throw std::runtime_error("node"); }, pool), std::runtime_error);
+}
+
+TEST(TreeParallel, Reduce)
+{
+    TreeThreadPool pool(4), poolSingle(1);
+    TreeThreadPool* aPool[] = { &pool, &poolSingle };
+    for(int p = 0; p < 2; ++p)
+    {
+        for(int nKey = 0; nKey < 100000; nKey = nKey * 7 + 1)
+        {
+            Tree<int, int, TreeCompare<int>, TreeNodePool, TreeAugmentThread<>> tree;
+            for(int i = 0; i < nKey; ++i)
+                tree.insert((i * 7919) % nKey, 1);
+            const long long sum = tree.parallel_reduce(10LL, [](const int& key, const int& value) { return (long long)key * value; },
+                                                       [](long long a, long long b) { return a + b; }, *aPool[p]);
+            ASSERT_EQ(sum, 10 + (long long)nKey * (nKey - 1) / 2);
+
+            // the associative but not commutative combine keeps order of keys: the first and the last key of each part
+            typedef std::pair<int, int> Span;
+            const Span span = tree.parallel_reduce(Span(-1, -1), [](const int& key, const int&) { return Span(key, key); },
+                                                   [](const Span& a, const Span& b) { return Span(a.first, b.second); }, *aPool[p]);
+            ASSERT_EQ(span, nKey ? Span(-1, nKey - 1) : Span(-1, -1));
+            std::vector<int> aKey = tree.parallel_reduce(std::vector<int>(), [](const int& key, const int&) { return std::vector<int>(1, key); },
+                                                         [](std::vector<int> a, const std::vector<int>& b) { a.insert(a.end(), b.begin(), b.end()); return a; }, *aPool[p]);
+            ASSERT_EQ(aKey.size(), size_t(nKey));
+            for(int i = 0; i < nKey; ++i)
+                ASSERT_EQ(aKey[i], i);
+        }
+    }
+}
+
+// tests for concurrent access
+TEST(TreeConcurrent, SharedLock)
+{
+    // the writers keep two counters equal, the readers never see them differ
+    TreeSharedLock lock(4);
+    ASSERT_TRUE(lock.isValid());
+    long long a = 0, b = 0;
+    std::atomic<int> nBroken(0), nRead(0);
+    std::vector<std::thread> aThread;
+    for(int t = 0; t < 6; ++t)
+    {
+        aThread.push_back(std::thread([&, t]() 
+        {
+            for(int i = 0; i < 20000; ++i)
+            {
+                if(t < 2)
+                {
+                    lock.lock();
+                    ++a;
+                    ++b;
+                    lock.unlock();
+                }
+                else
+                {
+                    lock.lock_shared();
+                    if(a != b)
+                        ++nBroken;
+                    ++nRead;
+                    lock.unlock_shared();
+                }
+            }
+        }));
+    }
+    for(size_t t = 0; t < aThread.size(); ++t)
+        aThread[t].join();
+    ASSERT_EQ(nBroken.load(), 0);
+    ASSERT_EQ(nRead.load(), 80000);
+    ASSERT_EQ(a, 40000);
+}
+
+template<class Tree> void test_concurrent_tree()
+{
+    // the writers insert their own keys with value 2 * key and erase every third of them, the readers check what they find
+    const int c_nKey = 5000, c_nWriter = 3, c_nReader = 3;
+    ConcurrentTree<Tree> tree;
+    std::atomic<int> nBroken(0);
+    std::vector<std::thread> aThread;
+    for(int t = 0; t < c_nWriter + c_nReader; ++t)
+    {
+        aThread.push_back(std::thread([&, t]() 
+        {
+            for(int i = 0; i < c_nKey; ++i)
+            {
+                if(t < c_nWriter)
+                {
+                    const int key = i * c_nWriter + t;
+                    tree.insert(key, 2 * key);
+                    if(i % 3 == 2)
+                        tree.erase(key - 2 * c_nWriter);
+                    continue;
+                }
+
+                int val = -1;
+                const int key = (i * 7919) % (c_nKey * c_nWriter);
+                if(tree.find(key, val) && val != 2 * key)
+                    ++nBroken;
+                if(i % 500 == 0)
+                {
+                    // the iteration sees a consistent tree
+                    typename ConcurrentTree<Tree>::Reader reader = tree.read();
+                    static_assert(std::is_same<decltype(reader->begin().value()), const int&>::value, "the reader changes the tree");
+                    int prev = -1;
+                    size_t n = 0;
+                    for(typename Tree::ConstIterator it = reader->begin(); !it.isEnd(); it.next(), ++n)
+                    {
+                        if(it.key() <= prev || it.value() != 2 * it.key())
+                            ++nBroken;
+                        prev = it.key();
+                    }
+                    if(n != reader->size())
+                        ++nBroken;
+                }
+            }
+        }));
+    }
+    for(size_t t = 0; t < aThread.size(); ++t)
+        aThread[t].join();
+    ASSERT_EQ(nBroken.load(), 0);
+    ASSERT_EQ(tree.size(), size_t(c_nWriter * (c_nKey - c_nKey / 3)));
+    for(int key = 0; key < c_nKey * c_nWriter; ++key)
+        ASSERT_EQ(tree.count(key), size_t(key / c_nWriter % 3 != 0 || key / c_nWriter + 2 >= c_nKey ? 1 : 0));
+
+    // several changes under one exclusive lock
+    {
+        typename ConcurrentTree<Tree>::Writer writer = tree.write();
+        writer->clear();
+        writer->insert(1, 2);
+    }
+    ASSERT_EQ(tree.size(), 1u);
+}
+
+TEST(TreeConcurrent, ReadersAndWriters)
+{
+    test_concurrent_tree<Tree<int, int>>();
+    test_concurrent_tree<TreeBPlus<int, int>>();
+}
+
+template<class Tree> void test_concurrent_api()
+{
+    ConcurrentTree<Tree> tree;
+    for(int i = 0; i < 100; ++i)
+        tree.insert(i, 2 * i);
+    tree.erase(10);
+    {
+        typename ConcurrentTree<Tree>::Writer writer = tree.write();
+        writer->insert(200, 400);
+    }
+    int val = -1;
+    ASSERT_TRUE(tree.find(200, val));
+    ASSERT_EQ(val, 400);
+    ASSERT_FALSE(tree.find(10, val));
+    ASSERT_EQ(tree.count(20), 1u);
+    ASSERT_EQ(tree.count(10), 0u);
+    tree.clear();
+    ASSERT_EQ(tree.count(20), 0u);
+}
+
+TEST(TreeConcurrent, TreeTypes)
+{
+    test_concurrent_api<Tree<int, int>>();
+    test_concurrent_api<TreeBPlus<int, int>>();
+    test_concurrent_api<TreeCompact<int, int>>();
+    test_concurrent_api<TreeNoParent<int, int>>();
+}
+
+TEST(TreeConcurrent, ReaderMovedToThread)
+{
+    // the reader released by another thread frees the counter of its own slot, so the writer isn't blocked
+    ConcurrentTree<Tree<int, int>> tree;
+    tree.insert(1, 2);
+    for(int i = 0; i < 20; ++i)
+    {
+        ConcurrentTree<Tree<int, int>>::Reader* pReader = new ConcurrentTree<Tree<int, int>>::Reader(tree.read());
+        std::thread([pReader]() { delete pReader; }).join();
+        tree.insert(i, 2 * i);
+    }
+    ASSERT_EQ(tree.size(), 20u);
+}
+
+// tests for aggregates of ranges
+template<class Monoid> void test_query_range(unsigned seed)
+{
+    typedef Tree<int, int, TreeCompare<int>, TreeNodePool, TreeAugmentAggregate<Monoid>> AggregateTree;
+    std::default_random_engine generator(seed);
+    std::uniform_int_distribution<int> key(0, 2000);
+    AggregateTree tree;
+    std::map<int, int> map;
+    for(int i = 0; i < 5000; ++i)
+    {
+        const int k = key(generator);
+        if(i % 4 == 0)
+        {
+            tree.erase(k);
+            map.erase(k);
+        }
+        else if(i % 4 == 1)
+            tree.insert_or_assign(k, map[k] = i % 1000 - 500);
+        else
+            tree.insert(k, map.insert(std::make_pair(k, i % 1000 - 500)).first->second);
+    }
+    ASSERT_TRUE(tree.isValid());
+
+    for(int lo = -10; lo < 2010; lo += 37)
+    {
+        for(int hi = lo - 20; hi < 2020; hi += 101)
+        {
+            typename Monoid::value_type expected = Monoid::identity();
+            for(std::map<int, int>::const_iterator it = map.lower_bound(lo); hi > lo && it != map.end() && it->first < hi; ++it)
+                expected = Monoid::combine(expected, Monoid::lift(it->first, it->second));
+            ASSERT_EQ(tree.query_range(lo, hi), expected);
+        }
+    }
+
+    // the values changed in place are taken into account after update
+    for(int i = 0; i < 200; ++i)
+    {
+        int k = key(generator);
+        const int val = i % 1000 - 500;
+        if(i % 4 == 0)
+        {
+            int* pValue = tree.find(k);
+            if(!pValue)
+                continue;
+            *pValue = val;
+        }
+        else if(i % 4 == 1)
+            tree[k] = val;
+        else if(i % 4 == 2)
+        {
+            typename AggregateTree::Iterator it = tree.lower_bound(k);
+            if(it.isEnd())
+                continue;
+            it.value() = val;
+            k = it.key();
+        }
+        else
+            tree.emplace(k, 0).first.value() = val;
+        map[k] = val;
+        ASSERT_TRUE(tree.update(k));
+    }
+    ASSERT_FALSE(tree.update(-1));
+    ASSERT_TRUE(tree.isValid());
+    typename Monoid::value_type total = Monoid::identity();
+    for(std::map<int, int>::const_iterator it = map.begin(); it != map.end(); ++it)
+        total = Monoid::combine(total, Monoid::lift(it->first, it->second));
+    ASSERT_EQ(tree.query_range(-1, 2001), total);
+
+    // the aggregates are maintained by bulk operations
+    AggregateTree right;
+    tree.split(1000, right);
+    ASSERT_TRUE(tree.isValid() && right.isValid());
+    tree.join(right);
+    tree.erase_range(500, 700);
+    std::vector<std::pair<int, int>> aPair;
+    for(int i = 0; i < 3000; ++i)
+        aPair.push_back(std::make_pair(key(generator), i));
+    tree.insert_batch(aPair.begin(), aPair.begin() + 10);
+    tree.insert_batch(aPair.begin(), aPair.end());
+    ASSERT_TRUE(tree.isValid());
+}
+
+TEST(TreeAggregate, Sum)
+{
+    test_query_range<TreeMonoidSum<long long>>(12);
+}
+
+TEST(TreeAggregate, Min)
+{
+    test_query_range<TreeMonoidMin<int>>(13);
+}
+
+TEST(TreeAggregate, Max)
+{
+    test_query_range<TreeMonoidMax<int>>(14);
+}
+
+// the value of the node with the greatest key in range: combination isn't commutative
+struct MonoidLast
+{
+    typedef std::pair<bool, int> value_type;
+    static value_type identity() { return value_type(false, 0); }
+    static value_type lift(int, int val) { return value_type(true, val); }
+    static value_type combine(const value_type& a, const value_type& b) { return b.first ? b : a; }
+};
+
+TEST(TreeAggregate, NonCommutative)
+{
+    test_query_range<MonoidLast>(15);
+}
+
+// tests for interval tree
+TEST(TreeIntervals, Overlap)
+{
+    std::default_random_engine generator(16);
+    std::uniform_int_distribution<int> point(0, 10000), length(1, 300);
+    TreeIntervals<int, int> tree;
+    std::map<TreeInterval<int>, int> map;
+    for(int i = 0; i < 3000; ++i)
+    {
+        const int begin = point(generator);
+        const TreeInterval<int> interval(begin, begin + length(generator));
+        if(i % 5 == 0 && !map.empty())
+        {
+            // erase existing interval
+            std::map<TreeInterval<int>, int>::iterator it = map.lower_bound(interval);
+            if(it == map.end())
+                --it;
+            tree.erase(it->first);
+            map.erase(it);
+        }
+        else
+            tree.insert_or_assign(interval, map[interval] = i);
+    }
+    ASSERT_TRUE(tree.isValid());
+
+    for(int lo = -50; lo < 10400; lo += 97)
+    {
+        for(int len = 0; len < 500; len += 123)
+        {
+            std::vector<std::pair<TreeInterval<int>, int>> aExpected, aFound, aStab, aStabExpected;
+            for(std::map<TreeInterval<int>, int>::const_iterator it = map.begin(); it != map.end(); ++it)
+            {
+                if(len > 0 && it->first.m_begin < lo + len && lo < it->first.m_end)
+                    aExpected.push_back(*it);
+                if(len == 0 && it->first.m_begin <= lo && lo < it->first.m_end)
+                    aStabExpected.push_back(*it);
+            }
+            tree.for_each_overlap(lo, lo + len, [&aFound](const TreeInterval<int>& interval, int& v) { aFound.push_back(std::make_pair(interval, v)); });
+            ASSERT_TRUE(aFound == aExpected);
+            ASSERT_EQ(tree.count_overlap(lo, lo + len), aExpected.size());
+            if(len == 0)
+            {
+                tree.for_each_containing(lo, [&aStab](const TreeInterval<int>& interval, int& v) { aStab.push_back(std::make_pair(interval, v)); });
+                ASSERT_TRUE(aStab == aStabExpected);
+            }
+        }
+    }
+}
+
+TEST(TreeIntervals, SplitJoin)
+{
+    TreeIntervals<double, int> tree, right;
+    for(int i = 0; i < 1000; ++i)
+        tree.insert(TreeInterval<double>(i, i + 100.5), i);
+    tree.split(TreeInterval<double>(500, 0), right);
+    ASSERT_TRUE(tree.isValid() && right.isValid());
+    ASSERT_EQ(tree.count_overlap(550, 551), 50u);
+    ASSERT_EQ(right.count_overlap(550, 551), 51u);
+    tree.join(right);
+    ASSERT_EQ(tree.count_overlap(550, 551), 101u);
+    ASSERT_TRUE(tree.isValid());
+}
+
+TEST(TreeIntervals, EqualAndEmpty)
+{
+    TreeIntervals<int, int> tree;
+
+    // the equal interval replaces the value of existing one
+    ASSERT_TRUE(tree.insert(TreeInterval<int>(10, 20), 1).second);
+    ASSERT_FALSE(tree.try_emplace(TreeInterval<int>(10, 20), 2).second);
+    ASSERT_EQ(*tree.find(TreeInterval<int>(10, 20)), 1);
+    ASSERT_FALSE(tree.insert(TreeInterval<int>(10, 20), 3).second);
+    ASSERT_EQ(tree.size(), 1u);
+    ASSERT_EQ(*tree.find(TreeInterval<int>(10, 20)), 3);
+
+    // the empty intervals overlap nothing, even the ranges which contain their bounds
+    tree.insert(TreeInterval<int>(15, 15), 4);
+    tree.insert(TreeInterval<int>(30, 30), 5);
+    ASSERT_EQ(tree.size(), 3u);
+    ASSERT_TRUE(tree.isValid());
+    ASSERT_EQ(tree.count_overlap(0, 100), 1u);
+    ASSERT_EQ(tree.count_overlap(15, 16), 1u);
+    ASSERT_EQ(tree.count_overlap(25, 35), 0u);
+    size_t nContaining = 0;
+    tree.for_each_containing(15, [&nContaining](const TreeInterval<int>&, int& v) { ++nContaining; ASSERT_EQ(v, 3); });
+    ASSERT_EQ(nContaining, 1u);
+    tree.for_each_containing(30, [&nContaining](const TreeInterval<int>&, int&) { ++nContaining; });
+    ASSERT_EQ(nContaining, 1u);
+}
+
+template<class Tree> void check_tree(Tree& tree, const std::map<int, int>& map)
+{
+    ASSERT_TRUE(tree.isValid());
+    ASSERT_EQ(tree.size(), map.size());
+    typename Tree::Iterator it = tree.begin();
+    for(std::map<int, int>::const_iterator itMap = map.begin(); itMap != map.end(); ++itMap, it.next())
+    {
+        ASSERT_FALSE(it.isEnd());
+        ASSERT_EQ(it.key(), itMap->first);
+        ASSERT_EQ(it.value(), itMap->second);
+    }
+    ASSERT_TRUE(it.isEnd());
+}
+
+TEST(TreeFinger, SortedStreams)
+{
+    const int c_nKey = 5000;
+    std::default_random_engine generator(4);
+    for(int mode = 0; mode < 3; ++mode)
+    {
+        // ascending, descending, ascending with shuffled windows of 16 keys
+        std::vector<int> aKey(c_nKey);
+        for(int i = 0; i < c_nKey; ++i)
+            aKey[i] = mode == 1 ? c_nKey - i : i;
+        if(mode == 2)
+        {
+            for(int i = 0; i < c_nKey; i += 16)
+                std::shuffle(aKey.begin() + i, aKey.begin() + std::min(i + 16, c_nKey), generator);
+        }
+
+        Tree<int, int> tree;
+        std::map<int, int> map;
+        for(int i = 0; i < c_nKey; ++i)
+            tree.insert(aKey[i], map[aKey[i]] = i);
+        check_tree(tree, map);
+        // each sorted key is next to the previous one, the shuffled keys mostly are not
+        if(mode < 2)
+        {
+            ASSERT_EQ(tree.stats().m_nFinger, size_t(c_nKey - 1));
+        }
+
+        // existing keys are found at the finger too
+        for(int i = 0; i < c_nKey; ++i)
+            tree[aKey[i]] += 1;
+        for(std::map<int, int>::iterator it = map.begin(); it != map.end(); ++it)
+            it->second += 1;
+        check_tree(tree, map);
+    }
+}
+
+TEST(TreeFinger, Hint)
+{
+    std::default_random_engine generator(5);
+    std::uniform_int_distribution<int> key(0, 3000), op(0, 9);
+    CountTree tree;
+    std::map<int, int> map;
+    for(int i = 0; i < 20000; ++i)
+    {
+        const int k = key(generator);
+        switch(op(generator))
+        {
+        case 0:
+            tree.erase(k);
+            map.erase(k);
+            break;
+        case 1:
+            tree.insert(k, map[k] = i);
+            break;
+        case 2:
+            // the hint far from the key
+            tree.insert(tree.select(size_t(k) % (tree.size() + 1)), k, map[k] = i);
+            break;
+        case 3:
+        {
+            const size_t nErased = tree.erase_range(k, k + 20);
+            ASSERT_EQ(nErased, size_t(std::distance(map.lower_bound(k), map.lower_bound(k + 20))));
+            map.erase(map.lower_bound(k), map.lower_bound(k + 20));
+            break;
+        }
+        default:
+        {
+            // the hint next to the key
+            const int kNear = k + op(generator) % 3 - 1;
+            tree.insert(tree.lower_bound(k), kNear, map[kNear] = i);
+        }
+        }
+        ASSERT_TRUE(tree.isValid());
+    }
+    check_tree(tree, map);
+
+    // the end iterator means the last inserted node
+    tree.clear();
+    map.clear();
+    for(int i = 0; i < 1000; ++i)
+        tree.insert(tree.end(), i * 2, map[i * 2] = i);
+    for(int i = 0; i < 1000; ++i)
+        tree.insert(tree.end(), 1999 - i * 2, map[1999 - i * 2] = i);
+    check_tree(tree, map);
+}
+
+TEST(TreeMinMax, PopAndReverse)
+{
+    std::default_random_engine generator(6);
+    std::uniform_int_distribution<int> key(0, 5000), op(0, 5);
+    Tree<int, int> tree;
+    std::map<int, int> map;
+    ASSERT_TRUE(tree.min().isEnd() && tree.max().isEnd() && tree.rbegin().isEnd());
+    ASSERT_FALSE(tree.pop_min() || tree.pop_max());
+    for(int i = 0; i < 20000; ++i)
+    {
+        const int k = key(generator);
+        switch(op(generator))
+        {
+        case 0:
+            ASSERT_EQ(tree.pop_min(), !map.empty());
+            if(!map.empty())
+                map.erase(map.begin());
+            break;
+        case 1:
+            ASSERT_EQ(tree.pop_max(), !map.empty());
+            if(!map.empty())
+                map.erase(--map.end());
+            break;
+        case 2:
+            tree.erase(k);
+            map.erase(k);
+            break;
+        default:
+            tree.insert(k, map[k] = i);
+        }
+        ASSERT_TRUE(tree.isValid());
+        ASSERT_EQ(tree.min().isEnd(), map.empty());
+        if(!map.empty())
+        {
+            ASSERT_EQ(tree.min().key(), map.begin()->first);
+            ASSERT_EQ(tree.max().key(), map.rbegin()->first);
+        }
+    }
+
+    // reverse iteration
+    std::map<int, int>::reverse_iterator itMap = map.rbegin();
+    Tree<int, int>::Iterator it = tree.rbegin();
+    for(; itMap != map.rend(); ++itMap, it.prev())
+    {
+        ASSERT_FALSE(it.isEnd());
+        ASSERT_EQ(it.key(), itMap->first);
+    }
+    ASSERT_TRUE(it.isEnd());
+    ASSERT_FALSE(it.prev());
+}
+
+TEST(TreeMinMax, BulkOperations)
+{
+    // isValid checks the leftmost and the rightmost nodes
+    std::vector<std::pair<int, int>> aPair;
+    for(int i = 0; i < 1000; ++i)
+        aPair.push_back(std::make_pair(i * 2, i));
+    CountTree tree(aPair.begin(), aPair.end()), right, other;
+    ASSERT_TRUE(tree.isValid() && tree.min().key() == 0 && tree.max().key() == 1998);
+    tree.split(1000, right);
+    ASSERT_TRUE(tree.isValid() && right.isValid());
+    ASSERT_TRUE(tree.max().key() == 998 && right.min().key() == 1000);
+    tree.join(right);
+    ASSERT_TRUE(tree.isValid() && right.isValid() && right.max().isEnd());
+    ASSERT_EQ(tree.erase_range(-10, 100), 50u);
+    ASSERT_EQ(tree.erase_range(1900, 3000), 50u);
+    ASSERT_TRUE(tree.isValid() && tree.min().key() == 100 && tree.max().key() == 1898);
+
+    std::vector<std::pair<int, int>> aBatch;
+    for(int i = 0; i < 300; ++i)
+        aBatch.push_back(std::make_pair(i * 7 - 50, i));
+    tree.insert_batch(aBatch.begin(), aBatch.begin() + 10);
+    ASSERT_TRUE(tree.isValid() && tree.min().key() == -50);
+    tree.insert_batch(aBatch.begin(), aBatch.end());
+    ASSERT_TRUE(tree.isValid() && tree.max().key() == 299 * 7 - 50);
+
+    for(int i = 0; i < 500; ++i)
+        other.insert(i * 5 + 3000, i);
+    tree.union_with(other);
+    ASSERT_TRUE(tree.isValid() && other.isValid() && tree.max().key() == 499 * 5 + 3000);
+    for(int i = 0; i < 100; ++i)
+        other.insert(i, i);
+    tree.difference(other);
+    ASSERT_TRUE(tree.isValid() && tree.min().key() == -50);
+}
+
+TEST(TreeFindBatch, Random)
+{
+    std::default_random_engine generator(7);
+    std::uniform_int_distribution<int> key(0, 4000);
+    Tree<int, int> tree;
+    for(int i = 0; i < 2000; ++i)
+        tree.insert(key(generator), i);
+
+    const size_t c_aBatch[] = { 0, 1, 15, 16, 17, 100, 1000 };
+    for(size_t b = 0; b < sizeof(c_aBatch) / sizeof(c_aBatch[0]); ++b)
+    {
+        std::vector<int> aKey(c_aBatch[b]);
+        for(size_t i = 0; i < aKey.size(); ++i)
+            aKey[i] = key(generator);
+        int sentinel = 0;
+        std::vector<int*> aValue(aKey.size() + 1, &sentinel);
+        size_t nExpected = 0;
+        const size_t nFound = tree.find_batch(aKey.data(), aKey.size(), aValue.data());
+        for(size_t i = 0; i < aKey.size(); ++i)
+        {
+            ASSERT_EQ(aValue[i], tree.find(aKey[i]));
+            nExpected += aValue[i] ? 1 : 0;
+        }
+        ASSERT_EQ(nFound, nExpected);
+        // the values after the batch aren't touched
+        ASSERT_TRUE(aValue[aKey.size()] == &sentinel);
+    }
+
+    Tree<int, int> empty;
+    int k = 1;
+    int* pValue = &k;
+    ASSERT_EQ(empty.find_batch(&k, 1, &pValue), 0u);
+    ASSERT_TRUE(pValue == NULL);
+}
+
+TEST(TreeFindBatch, Transparent)
+{
+    Tree<std::string, int, TreeCompare<void>> tree;
+    tree.insert("alpha", 1);
+    tree.insert("beta", 2);
+    const char* aKey[] = { "beta", "gamma", "alpha" };
+    int* aValue[3];
+    ASSERT_EQ(tree.find_batch(aKey, 3, aValue), 2u);
+    ASSERT_TRUE(aValue[0] && *aValue[0] == 2 && !aValue[1] && aValue[2] && *aValue[2] == 1);
+}
+
+TEST(TreeFrozen, Random)
+{
+    std::default_random_engine generator(8);
+    const size_t c_aSize[] = { 0, 1, 2, 3, 15, 16, 17, 100, 1000 };
+    for(size_t s = 0; s < sizeof(c_aSize) / sizeof(c_aSize[0]); ++s)
+    {
+        std::uniform_int_distribution<int> key(0, int(c_aSize[s]) * 3);
+        Tree<int, int> tree;
+        while(tree.size() < c_aSize[s])
+        {
+            const int k = key(generator);
+            tree.insert(k, k * 10);
+        }
+        TreeFrozen<int, int> frozen = tree.freeze();
+        ASSERT_EQ(frozen.size(), tree.size());
+
+        // ordered iteration
+        TreeFrozen<int, int>::Iterator itFrozen = frozen.begin();
+        for(Tree<int, int>::Iterator it = tree.begin(); !it.isEnd(); it.next(), itFrozen.next())
+        {
+            ASSERT_FALSE(itFrozen.isEnd());
+            ASSERT_EQ(itFrozen.key(), it.key());
+            ASSERT_EQ(itFrozen.value(), it.value());
+        }
+        ASSERT_TRUE(itFrozen.isEnd() && itFrozen == frozen.end());
+
+        for(int k = -1; k <= int(c_aSize[s]) * 3 + 1; ++k)
+        {
+            const int* pValue = frozen.find(k);
+            ASSERT_EQ(pValue != NULL, tree.find(k) != NULL);
+            ASSERT_TRUE(!pValue || *pValue == k * 10);
+            ASSERT_EQ(frozen.count(k), tree.count(k));
+            Tree<int, int>::Iterator it = tree.lower_bound(k);
+            itFrozen = frozen.lower_bound(k);
+            ASSERT_EQ(itFrozen.isEnd(), it.isEnd());
+            ASSERT_TRUE(it.isEnd() || itFrozen.key() == it.key());
+        }
+    }
+}
+
+TEST(TreeFrozen, Transparent)
+{
+    Tree<std::string, int, TreeCompare<void>> tree;
+    tree.insert("beta", 2);
+    tree.insert("alpha", 1);
+    tree.insert("gamma", 3);
+    TreeFrozen<std::string, int, TreeCompare<void>> frozen = tree.freeze();
+    tree.clear();
+    ASSERT_TRUE(frozen.find("beta") && *frozen.find("beta") == 2);
+    ASSERT_TRUE(frozen.find("delta") == NULL);
+    ASSERT_EQ(frozen.lower_bound("b").key(), "beta");
+    ASSERT_TRUE(frozen.lower_bound("h").isEnd());
+}
+
+template<class Tree> void test_compact_veb(unsigned seed)
+{
+    std::default_random_engine generator(seed);
+    std::uniform_int_distribution<int> key(0, 20000);
+    Tree tree;
+    std::map<int, int> map;
+    for(int i = 0; i < 5000; ++i)
+    {
+        const int k = key(generator);
+        tree.insert(k, map[k] = i);
+        if(i % 3 == 0)
+        {
+            tree.erase(k / 2);
+            map.erase(k / 2);
+        }
+    }
+    tree.compact_veb();
+    check_tree(tree, map);
+
+    // the tree stays mutable
+    for(int i = 0; i < 2000; ++i)
+    {
+        const int k = key(generator);
+        if(i % 2)
+        {
+            tree.erase(k);
+            map.erase(k);
+        }
+        else
+            tree.insert(k, map[k] = i);
+    }
+    check_tree(tree, map);
+    tree.compact_veb();
+    check_tree(tree, map);
+}
+
+TEST(TreeCompactVeb, Random)
+{
+    test_compact_veb<Tree<int, int>>(9);
+    test_compact_veb<CountTree>(10);
+    test_compact_veb<Tree<int, int, TreeCompare<int>, TreeNodeNew>>(11);
+    test_compact_veb<Tree<int, int, TreeCompare<int>, TreeNodePool, TreeAugmentAggregate<TreeMonoidSum<long long>>>>(12);
+}
+
+TEST(TreeCompactVeb, Layout)
+{
+    typedef Tree<int, std::string> StringTree;
+    StringTree tree, right;
+    std::map<int, std::string> map;
+    for(int i = 0; i < 1000; ++i)
+        tree.insert((i * 7919) % 1000, map[(i * 7919) % 1000] = std::to_string(i));
+    tree.split(500, right);
+    tree.compact_veb();
+    right.compact_veb();
+
+    // the nodes of each tree occupy one block
+    StringTree* aTree[] = { &tree, &right };
+    for(int t = 0; t < 2; ++t)
+    {
+        ASSERT_TRUE(aTree[t]->isValid());
+        ASSERT_EQ(aTree[t]->size(), 500u);
+        const char* pLow = NULL;
+        const char* pHigh = NULL;
+        for(StringTree::Iterator it = aTree[t]->begin(); !it.isEnd(); it.next())
+        {
+            const char* p = reinterpret_cast<const char*>(&it.value());
+            pLow = !pLow || p < pLow ? p : pLow;
+            pHigh = !pHigh || p > pHigh ? p : pHigh;
+            ASSERT_EQ(it.value(), map[it.key()]);
+        }
+        ASSERT_EQ(size_t(pHigh - pLow), 499 * sizeof(StringTree::Node));
+    }
+}
+
+// tests for threaded nodes
+typedef Tree<int, int, TreeCompare<int>, TreeNodePool, TreeAugmentThread<>> ThreadTree;
+typedef Tree<int, int, TreeCompare<int>, TreeNodePool, TreeAugmentThread<TreeAugmentCount>> ThreadCountTree;
+
+TEST(TreeThread, Random)
+{
+    std::default_random_engine generator(13);
+    std::uniform_int_distribution<int> key(0, 3000);
+    ThreadTree tree;
+    std::map<int, int> map;
+    for(int i = 0; i < 20000; ++i)
+    {
+        const int k = key(generator);
+        switch(i % 5)
+        {
+        case 0:
+            tree.erase(k);
+            map.erase(k);
+            break;
+        case 1:
+            if(tree.pop_min())
+                map.erase(map.begin());
+            break;
+        case 2:
+            tree.insert(tree.lower_bound(k), k, map[k] = i);
+            break;
+        default:
+            tree.insert(k, map[k] = i);
+            break;
+        }
+        if(i % 1000 == 0)
+            check_tree(tree, map);
+    }
+    check_tree(tree, map);
+
+    // reverse iteration follows the links too
+    ThreadTree::Iterator it = tree.rbegin();
+    for(std::map<int, int>::const_reverse_iterator itMap = map.rbegin(); itMap != map.rend(); ++itMap, it.prev())
+    {
+        ASSERT_FALSE(it.isEnd());
+        ASSERT_EQ(it.key(), itMap->first);
+    }
+    ASSERT_TRUE(it.isEnd());
+}
+
+TEST(TreeThread, BulkOperations)
+{
+    test_tree_api<ThreadTree>(1000);
+    test_erase_range<ThreadTree>(14);
+    test_split_join<ThreadTree>(15);
+    test_split_join<ThreadCountTree>(16);
+    TreeThreadPool pool(4);
+    test_set_operations<ThreadTree>(17, pool);
+    test_compact_veb<ThreadTree>(18);
+    test_compact_veb<Tree<int, int, TreeCompare<int>, TreeNodeNew, TreeAugmentThread<>>>(19);
+
+    // the sorted build and both paths of the batch insert
+    std::vector<std::pair<int, int>> aPair;
+    std::map<int, int> map;
+    for(int i = 0; i < 1000; ++i)
+    {
+        aPair.push_back(std::make_pair(3 * i, i));
+        map[3 * i] = i;
+    }
+    ThreadTree tree(aPair.begin(), aPair.end());
+    check_tree(tree, map);
+    for(int n = 10; n <= 10000; n *= 1000)
+    {
+        aPair.clear();
+        for(int i = 0; i < n; ++i)
+        {
+            aPair.push_back(std::make_pair(7 * i + n, -i));
+            map[7 * i + n] = -i;
+        }
+        tree.insert_batch(aPair.begin(), aPair.end());
+        check_tree(tree, map);
+    }
+}
+
+TEST(TreeThread, OrderStatistics)
+{
+    ThreadCountTree tree;
+    for(int i = 0; i < 1000; ++i)
+        tree.insert((i * 7919) % 1000, i);
+    ASSERT_TRUE(tree.isValid());
+    for(int i = 0; i < 1000; i += 37)
+    {
+        ASSERT_EQ(tree.select(i).key(), i);
+        ASSERT_EQ(tree.rank(i), size_t(i));
+    }
+    ASSERT_EQ(sizeof(ThreadCountTree::Node), sizeof(CountTree::Node) + 2 * sizeof(void*));
+}
+
 int main_gtest(int argc, char* argv[])
 {
     ::testing::InitGoogleTest(&argc, argv);
@@ -1,10 +1,18 @@
 #pragma once
 #include "tree_avl.h"
+#include "tree_avl_compact.h"
+#include "tree_avl_frozen.h"
+#include "tree_avl_interval.h"
+#include "tree_avl_noparent.h"
+#include "tree_bplus.h"
+#include "tree_concurrent.h"
 #include <vector>
 #include <random>
 #include <iostream>
 #include <time.h>
+#include <chrono>
 #include <map>
+#include <limits>
 
 /// <summary> Helper class to keep time </summary>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
@@ -32,6 +40,20 @@ private:
     clock_t m_time; 
 };
 
+/// <summary> Checks result of search in the tree (the tree returns pointer to value). Keeps the compiler from eliminating search. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Tree> size_t find_count(Tree& tree, int key)
+{
+    return tree.find(key) != NULL ? 1 : 0;
+}
+
+/// <summary> Checks result of search in std::map (the map returns iterator). </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Val> size_t find_count(std::map<int, Val>& tree, int key)
+{
+    return tree.find(key) != tree.end() ? 1 : 0;
+}
+
 /// <summary> Tests tree pefrormance </summary>
 /// <param name="aKey"> in. Initial set of keys. </param>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
@@ -49,9 +71,12 @@ template<class Tree> void test_peformance(double& insert, double& find, double&
 
     // search data in the tree
     time.start();
+    size_t nFound = 0;
     for(size_t i = 0, n = aKey.size(); i < n; ++i)
-        tree.find(aKey[i]);
+        nFound += find_count(tree, aKey[i]);
     find = time.stop();
+    if(nFound != aKey.size())
+        std::cout << "\nError: " << aKey.size() - nFound << " keys are not found";
 
     // remove data from the tree
     time.start();
@@ -60,6 +85,752 @@ template<class Tree> void test_peformance(double& insert, double& find, double&
     remove = time.stop();
 }
 
+/// <summary> 
+/// Adapter of the frozen snapshot to the test_peformance template: the keys are inserted into the tree, the first search after 
+/// a change freezes the tree (the time of freeze is included into the search), erase removes keys from the tree. 
+/// </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+class TreeFrozenTest
+{
+public:
+    TreeFrozenTest() : m_bFrozen(false) {}
+
+    void insert(const std::pair<int, int>& pair)
+    {
+        m_tree.insert(pair);
+        m_bFrozen = false;
+    }
+
+    const int* find(int key)
+    {
+        if(!m_bFrozen)
+        {
+            m_frozen = m_tree.freeze();
+            m_bFrozen = true;
+        }
+        return m_frozen.find(key);
+    }
+
+    void erase(int key)
+    {
+        m_tree.erase(key);
+        m_bFrozen = false;
+    }
+
+private:
+    Tree<int, int> m_tree;
+    TreeFrozen<int, int> m_frozen;
+    bool m_bFrozen;
+};
+
+/// <summary> Tests tree pefrormance under churn: each key of the second half is inserted after erasing the key inserted half of sequence before. </summary>
+/// <returns> Time of churn. </returns>
+/// <param name="aKey"> in. Initial set of keys. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Tree> double test_churn(const std::vector<int>& aKey)
+{
+    Tree tree;
+    const size_t nHalf = aKey.size() / 2;
+    for(size_t i = 0; i < nHalf; ++i)
+        tree.insert(std::make_pair(aKey[i], (int)i));
+
+    Timing time;
+    time.start();
+    for(size_t i = nHalf, n = aKey.size(); i < n; ++i)
+    {
+        tree.erase(aKey[i - nHalf]);
+        tree.insert(std::make_pair(aKey[i], (int)i));
+    }
+    return time.stop();
+}
+
+/// <summary> Prints statistics of tree balancing: average number of retraced ancestors and rotations per operation. </summary>
+/// <param name="aKey"> in. Initial set of keys. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+void test_retrace(const std::vector<int>& aKey)
+{
+    Tree<int, int> tree;
+    const double n = double(aKey.size());
+    for(size_t i = 0; i < aKey.size(); ++i)
+        tree.insert(aKey[i], (int)i);
+    std::cout << "\nRetrace statistics per operation:\n insert: ancestors=" << tree.stats().m_nRetrace / n << " rotations=" << tree.stats().m_nRotation / n;
+
+    tree.reset_stats();
+    for(size_t i = 0; i < aKey.size(); ++i)
+        tree.erase(aKey[i]);
+    std::cout << "\n erase: ancestors=" << tree.stats().m_nRetrace / n << " rotations=" << tree.stats().m_nRotation / n;
+}
+
+/// <summary> Compares building of the tree from sorted range with insertion of sorted keys one by one. </summary>
+/// <param name="nKey"> in. Number of keys. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+void test_bulk_load(int nKey)
+{
+    std::vector<std::pair<int, int>> aPair(nKey);
+    for(int i = 0; i < nKey; ++i)
+        aPair[i] = std::make_pair(i, i);
+
+    Timing time;
+    double insert, assign;
+    {
+        Tree<int, int> tree;
+        time.start();
+        for(int i = 0; i < nKey; ++i)
+            tree.insert(aPair[i]);
+        insert = time.stop();
+    }
+    {
+        Tree<int, int> tree;
+        time.start();
+        tree.assign_sorted(aPair.begin(), aPair.end());
+        assign = time.stop();
+    }
+    std::cout << "\nBuilding from sorted keys timing:\n insert=" << insert << " sec, assign_sorted=" << assign << " sec, speedup=" << insert / assign;
+}
+
+/// <summary> Compares insertion of batch of unsorted keys with insertion of keys one by one for several ratios of batch size to tree size. </summary>
+/// <param name="nKey"> in. Number of keys in the tree. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+void test_insert_batch(int nKey)
+{
+    std::default_random_engine generator(10);
+    std::vector<int> aKey(nKey);
+    for(int i = 0; i < nKey; ++i)
+        aKey[i] = 2 * i;
+    std::shuffle(aKey.begin(), aKey.end(), generator);
+
+    std::cout << "\nInsertion of batch timing (batch size / tree size):";
+    const double aRatio[] = { 0.01, 0.1, 1, 10 };
+    for(int r = 0; r < 4; ++r)
+    {
+        // batch of new keys (odd) and existing keys (even)
+        const int nBatch = int(nKey * aRatio[r]);
+        std::vector<std::pair<int, int>> aPair(nBatch);
+        for(int i = 0; i < nBatch; ++i)
+            aPair[i] = std::make_pair(int(generator() % (4 * nKey)), i);
+
+        Timing time;
+        double insert, batch;
+        {
+            Tree<int, int> tree;
+            for(int i = 0; i < nKey; ++i)
+                tree.insert(aKey[i], i);
+            time.start();
+            for(int i = 0; i < nBatch; ++i)
+                tree.insert(aPair[i]);
+            insert = time.stop();
+        }
+        {
+            Tree<int, int> tree;
+            for(int i = 0; i < nKey; ++i)
+                tree.insert(aKey[i], i);
+            time.start();
+            tree.insert_batch(aPair.begin(), aPair.end());
+            batch = time.stop();
+        }
+        std::cout << "\n " << aRatio[r] << ": insert=" << insert << " sec, insert_batch=" << batch << " sec, speedup=" << insert / batch;
+    }
+}
+
+/// <summary> Measures order statistics queries of the tree augmented by subtree size. </summary>
+/// <param name="aKey"> in. Initial set of keys. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+void test_order_statistics(const std::vector<int>& aKey)
+{
+    Tree<int, int, TreeCompare<int>, TreeNodePool, TreeAugmentCount> tree;
+    for(size_t i = 0; i < aKey.size(); ++i)
+        tree.insert(aKey[i], (int)i);
+
+    Timing time;
+    size_t nSum = 0;
+    time.start();
+    for(size_t i = 0; i < aKey.size(); ++i)
+        nSum += tree.select(i).key();
+    const double select = time.stop();
+    time.start();
+    for(size_t i = 0; i < aKey.size(); ++i)
+        nSum += tree.rank(aKey[i]);
+    const double rank = time.stop();
+    std::cout << "\nOrder statistics timing:\n select=" << select << " sec, rank=" << rank << " sec" << (nSum ? "" : " ");
+}
+
+/// <summary> Compares range scan by for_each_in_range with scan of the whole tree by iterator. </summary>
+/// <param name="aKey"> in. Initial set of keys. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+void test_range_scan(const std::vector<int>& aKey)
+{
+    Tree<int, int> tree;
+    for(size_t i = 0; i < aKey.size(); ++i)
+        tree.insert(aKey[i], (int)i);
+
+    // windows of 1000 keys
+    const int nQuery = 20, nWindow = 1000;
+    std::default_random_engine generator(5);
+    std::vector<int> aLow(nQuery);
+    for(int q = 0; q < nQuery; ++q)
+        aLow[q] = int(generator() % aKey.size());
+
+    Timing time;
+    size_t nScan = 0, nRange = 0;
+    time.start();
+    for(int q = 0; q < nQuery; ++q)
+    {
+        for(Tree<int, int>::Iterator it = tree.begin(); !it.isEnd(); it.next())
+            nScan += it.key() >= aLow[q] && it.key() < aLow[q] + nWindow ? 1 : 0;
+    }
+    const double scan = time.stop();
+    time.start();
+    for(int q = 0; q < nQuery; ++q)
+        tree.for_each_in_range(aLow[q], aLow[q] + nWindow, [&nRange](const int&, int&) { ++nRange; });
+    const double range = time.stop();
+    if(nScan != nRange)
+        std::cout << "\nError: range scan visited " << nRange << " keys instead of " << nScan;
+    std::cout << "\nRange scan timing (" << nQuery << " windows of " << nWindow << " keys):\n iterator=" << scan << " sec, for_each_in_range=" << range << " sec, speedup=" << scan / range;
+}
+
+/// <summary> Compares erasing of contiguous range of keys by erase_range with erasing keys one by one. </summary>
+/// <param name="aKey"> in. Initial set of keys. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+void test_erase_range(const std::vector<int>& aKey)
+{
+    // the middle half of keys
+    const int nKey = int(aKey.size()), lo = nKey / 4, hi = lo + nKey / 2;
+    Timing time;
+    double erase, range;
+    {
+        Tree<int, int> tree;
+        for(size_t i = 0; i < aKey.size(); ++i)
+            tree.insert(aKey[i], (int)i);
+        time.start();
+        for(int k = lo; k < hi; ++k)
+            tree.erase(k);
+        erase = time.stop();
+    }
+    {
+        Tree<int, int> tree;
+        for(size_t i = 0; i < aKey.size(); ++i)
+            tree.insert(aKey[i], (int)i);
+        time.start();
+        tree.erase_range(lo, hi);
+        range = time.stop();
+    }
+    std::cout << "\nErasing of range timing (" << hi - lo << " keys):\n erase=" << erase << " sec, erase_range=" << range << " sec, speedup=" << erase / range;
+}
+
+/// <summary> Compares split of the tree in halves and join of them with reinsertion of the nodes into new trees. </summary>
+/// <param name="aKey"> in. Initial set of keys. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+void test_split_join(const std::vector<int>& aKey)
+{
+    Tree<int, int> tree;
+    for(size_t i = 0; i < aKey.size(); ++i)
+        tree.insert(aKey[i], (int)i);
+    const int nMiddle = int(aKey.size() / 2);
+
+    Timing time;
+    double reinsert, split;
+    {
+        time.start();
+        Tree<int, int> left, right;
+        for(Tree<int, int>::Iterator it = tree.begin(); !it.isEnd(); it.next())
+            (it.key() < nMiddle ? left : right).insert(it.key(), it.value());
+        Tree<int, int> joined;
+        for(Tree<int, int>::Iterator it = left.begin(); !it.isEnd(); it.next())
+            joined.insert(it.key(), it.value());
+        for(Tree<int, int>::Iterator it = right.begin(); !it.isEnd(); it.next())
+            joined.insert(it.key(), it.value());
+        reinsert = time.stop();
+    }
+    {
+        time.start();
+        Tree<int, int> right;
+        tree.split(nMiddle, right);
+        tree.join(right);
+        split = time.stop();
+    }
+    std::cout << "\nSplit and join timing:\n reinsert=" << reinsert << " sec, split/join=" << split << " sec" << (tree.isValid() ? "" : " error: the tree is invalid");
+}
+
+/// <summary> Compares merging of trees by union_with (sequential and parallel) with insertion of nodes one by one. </summary>
+/// <param name="aKey"> in. Initial set of keys. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+void test_union(const std::vector<int>& aKey)
+{
+    std::cout << "\nUnion timing (size of merged tree / size of tree, " << TreeThreadPool::instance().size() << " threads):";
+    TreeThreadPool poolSingle(1);
+    const double aRatio[] = { 0.01, 1 };
+    for(int r = 0; r < 2; ++r)
+    {
+        const size_t nOther = size_t(aKey.size() * aRatio[r]);
+        double insert = 0, single = 0, parallel = 0;
+        Timing time;
+        for(int m = 0; m < 3; ++m)
+        {
+            // even keys in the tree, keys of merged tree are spread over the same range
+            Tree<int, int> tree, other;
+            for(size_t i = 0; i < aKey.size(); ++i)
+                tree.insert(2 * aKey[i], (int)i);
+            for(size_t i = 0; i < nOther; ++i)
+                other.insert(int(2 * aKey[i] / aRatio[r]) % int(2 * aKey.size()) + 1, (int)i);
+
+            time.start();
+            if(m == 0)
+            {
+                for(Tree<int, int>::Iterator it = other.begin(); !it.isEnd(); it.next())
+                    tree.insert_or_assign(it.key(), it.value());
+            }
+            else
+                tree.union_with(other, m == 1 ? poolSingle : TreeThreadPool::instance());
+            (m == 0 ? insert : m == 1 ? single : parallel) = time.stop();
+        }
+        std::cout << "\n " << aRatio[r] << ": insert=" << insert << " sec, union_with (1 thread)=" << single << " sec, union_with=" << parallel << " sec, speedup=" << insert / parallel;
+    }
+}
+
+/// <summary> Compares sum of values of range by query_range with summation of nodes visited by for_each_in_range. </summary>
+/// <param name="aKey"> in. Initial set of keys. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+void test_query_range(const std::vector<int>& aKey)
+{
+    Tree<int, int, TreeCompare<int>, TreeNodePool, TreeAugmentAggregate<TreeMonoidSum<long long>>> tree;
+    for(size_t i = 0; i < aKey.size(); ++i)
+        tree.insert(aKey[i], (int)i);
+
+    // windows of 10% of keys
+    const int nQuery = 100, nWindow = int(aKey.size() / 10);
+    std::default_random_engine generator(6);
+    std::vector<int> aLow(nQuery);
+    for(int q = 0; q < nQuery; ++q)
+        aLow[q] = int(generator() % aKey.size());
+
+    Timing time;
+    long long nScan = 0, nQueried = 0;
+    time.start();
+    for(int q = 0; q < nQuery; ++q)
+        tree.for_each_in_range(aLow[q], aLow[q] + nWindow, [&nScan](const int&, int& v) { nScan += v; });
+    const double scan = time.stop();
+    time.start();
+    for(int q = 0; q < nQuery; ++q)
+        nQueried += tree.query_range(aLow[q], aLow[q] + nWindow);
+    const double query = time.stop();
+    if(nScan != nQueried)
+        std::cout << "\nError: query_range sum " << nQueried << " differs from " << nScan;
+    std::cout << "\nAggregate of range timing (" << nQuery << " windows of " << nWindow << " keys):\n for_each_in_range=" << scan << " sec, query_range=" << query << " sec, speedup=" << scan / query;
+}
+
+/// <summary> Compares stabbing queries of the interval tree with the walk over all intervals. </summary>
+/// <param name="nKey"> in. Number of intervals. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+void test_intervals(int nKey)
+{
+    // intervals of length up to 1000 at random points
+    std::default_random_engine generator(7);
+    TreeIntervals<int, int> tree;
+    for(int i = 0; i < nKey; ++i)
+    {
+        const int begin = int(generator() % (10 * nKey));
+        tree.insert(TreeInterval<int>(begin, begin + 1 + int(generator() % 1000)), i);
+    }
+
+    const int nQuery = 20;
+    Timing time;
+    size_t nWalk = 0, nStab = 0;
+    time.start();
+    for(int q = 0; q < nQuery; ++q)
+    {
+        const int point = q * (10 * nKey / nQuery);
+        for(TreeIntervals<int, int>::Iterator it = tree.begin(); !it.isEnd(); it.next())
+            nWalk += it.key().m_begin <= point && point < it.key().m_end ? 1 : 0;
+    }
+    const double walk = time.stop();
+    time.start();
+    for(int q = 0; q < nQuery; ++q)
+        tree.for_each_containing(q * (10 * nKey / nQuery), [&nStab](const TreeInterval<int>&, int&) { ++nStab; });
+    const double stab = time.stop();
+    if(nWalk != nStab)
+        std::cout << "\nError: stabbing query found " << nStab << " intervals instead of " << nWalk;
+    std::cout << "\nInterval tree timing (" << nQuery << " stabbing queries):\n walk=" << walk << " sec, for_each_containing=" << stab << " sec, speedup=" << walk / stab;
+}
+
+/// <summary> Compares lookups one by one with find_batch for batch sizes 1..64. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+void test_find_batch(const std::vector<int>& aKey)
+{
+    Tree<int, int> tree;
+    for(size_t i = 0; i < aKey.size(); ++i)
+        tree.insert(aKey[i], int(i));
+
+    // the lookups in random order, so each level of the search misses the cache on large trees
+    std::vector<int> aFind(aKey);
+    std::default_random_engine generator(9);
+    std::shuffle(aFind.begin(), aFind.end(), generator);
+
+    Timing time;
+    size_t nFound = 0;
+    time.start();
+    for(size_t i = 0; i < aFind.size(); ++i)
+        nFound += find_count(tree, aFind[i]);
+    const double find = time.stop();
+    std::cout << "\nBatch find timing:\n find=" << find << " sec";
+
+    std::vector<int*> aValue(aFind.size());
+    for(size_t nBatch = 1; nBatch <= 64; nBatch *= 2)
+    {
+        size_t nBatchFound = 0;
+        time.start();
+        for(size_t i = 0; i < aFind.size(); i += nBatch)
+            nBatchFound += tree.find_batch(&aFind[i], std::min(nBatch, aFind.size() - i), &aValue[i]);
+        const double batch = time.stop();
+        if(nBatchFound != nFound)
+            std::cout << "\nError: find_batch found " << nBatchFound << " keys instead of " << nFound;
+        std::cout << "\n batch " << nBatch << ": " << batch << " sec, speedup=" << find / batch;
+    }
+}
+
+/// <summary> Tests tree pefrormance on the small sets too: the test is repeated to process at least 10^6 keys, the times are summed. </summary>
+/// <param name="aKey"> in. Initial set of keys. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Tree> void test_peformance_repeat(double& insert, double& find, double& remove, const std::vector<int>& aKey)
+{
+    insert = find = remove = 0;
+    for(size_t nKey = 0; nKey < 1000000; nKey += aKey.size())
+    {
+        double insert_one, find_one, remove_one;
+        test_peformance<Tree>(insert_one, find_one, remove_one, aKey);
+        insert += insert_one;
+        find += find_one;
+        remove += remove_one;
+    }
+}
+
+/// <summary> Compares B+ tree with the tree and std::map for sizes from 10^3 to the number of keys (by powers of 10). </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+void test_bplus_sizes(int nKeyMax)
+{
+    std::cout << "\nB+ tree speedup by size (tree / B+ tree, std::map / B+ tree):";
+    std::default_random_engine generator(11);
+    for(int nKey = 1000; nKey <= nKeyMax; nKey *= 10)
+    {
+        std::vector<int> aKey(nKey);
+        for(int i = 0; i < nKey; ++i)
+            aKey[i] = i;
+        std::shuffle(aKey.begin(), aKey.end(), generator);
+
+        double insert, find, remove, insert_bp, find_bp, remove_bp, insert_std, find_std, remove_std;
+        test_peformance_repeat<Tree<int, int>>(insert, find, remove, aKey);
+        test_peformance_repeat<TreeBPlus<int, int>>(insert_bp, find_bp, remove_bp, aKey);
+        test_peformance_repeat<std::map<int, int>>(insert_std, find_std, remove_std, aKey);
+        std::cout << "\n " << nKey << ": insert=" << insert / insert_bp << ", " << insert_std / insert_bp 
+                  << " find=" << find / find_bp << ", " << find_std / find_bp << " remove=" << remove / remove_bp << ", " << remove_std / remove_bp;
+        if(nKey > std::numeric_limits<int>::max() / 10)
+            break;
+    }
+}
+
+/// <summary> Compares full scans by the iterator of the tree, the threaded tree and std::map, and the cost of threads for insert and erase. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+void test_thread_scan(const std::vector<int>& aKey)
+{
+    typedef Tree<int, int, TreeCompare<int>, TreeNodePool, TreeAugmentThread<>> ThreadTree;
+    double insert, find, remove, insert_thr, find_thr, remove_thr;
+    test_peformance<Tree<int, int>>(insert, find, remove, aKey);
+    test_peformance<ThreadTree>(insert_thr, find_thr, remove_thr, aKey);
+
+    Tree<int, int> tree;
+    ThreadTree treeThread;
+    std::map<int, int> map;
+    for(size_t i = 0; i < aKey.size(); ++i)
+    {
+        tree.insert(aKey[i], int(i));
+        treeThread.insert(aKey[i], int(i));
+        map[aKey[i]] = int(i);
+    }
+
+    // the scans are repeated to visit at least 10^7 nodes
+    const int nRepeat = int(std::max<size_t>(1, 10000000 / std::max<size_t>(1, aKey.size())));
+    Timing time;
+    long long sum = 0, sum_thr = 0, sum_std = 0;
+    time.start();
+    for(int r = 0; r < nRepeat; ++r)
+    {
+        for(Tree<int, int>::Iterator it = tree.begin(); !it.isEnd(); it.next())
+            sum += it.value();
+    }
+    const double scan = time.stop();
+    time.start();
+    for(int r = 0; r < nRepeat; ++r)
+    {
+        for(ThreadTree::Iterator it = treeThread.begin(); !it.isEnd(); it.next())
+            sum_thr += it.value();
+    }
+    const double scan_thr = time.stop();
+    time.start();
+    for(int r = 0; r < nRepeat; ++r)
+    {
+        for(std::map<int, int>::const_iterator it = map.begin(); it != map.end(); ++it)
+            sum_std += it->second;
+    }
+    const double scan_std = time.stop();
+    if(sum != sum_thr || sum != sum_std)
+        std::cout << "\nError: the scans of the trees differ";
+    std::cout << "\nThreaded tree timing (" << nRepeat << " x full scan):\n scan: tree=" << scan << " sec, threaded=" << scan_thr << " sec, std::map=" << scan_std 
+              << " sec, speedup=" << scan / scan_thr << ", " << scan_std / scan_thr 
+              << "\n threads overhead: insert=" << insert_thr / insert << " find=" << find_thr / find << " remove=" << remove_thr / remove;
+}
+
+/// <summary> Compares the sum of values by the iterator with parallel_reduce and parallel_for_each on pools of 1, 2, 4, ... threads (up to hardware threads). </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+void test_parallel_scan(const std::vector<int>& aKey)
+{
+    Tree<int, int> tree;
+    for(size_t i = 0; i < aKey.size(); ++i)
+        tree.insert(aKey[i], int(i));
+
+    Timing time;
+    long long sum = 0;
+    time.start();
+    for(Tree<int, int>::Iterator it = tree.begin(); !it.isEnd(); it.next())
+        sum += it.value();
+    const double scan = time.stop();
+    std::cout << "\nParallel scan timing (iterator=" << scan << " sec):";
+
+    const size_t nThreadMax = std::max<size_t>(1, std::thread::hardware_concurrency());
+    for(size_t nThread = 1; ; nThread = std::min(2 * nThread, nThreadMax))
+    {
+        TreeThreadPool pool(nThread);
+        time.start();
+        const long long sum_par = tree.parallel_reduce(0LL, [](const int&, const int& value) { return (long long)value; }, [](long long a, long long b) { return a + b; }, pool);
+        const double reduce = time.stop();
+        time.start();
+        tree.parallel_for_each([](const int&, int& value) { value ^= 1; }, pool);
+        const double for_each = time.stop();
+        if(sum_par != sum)
+            std::cout << "\nError: parallel_reduce returned " << sum_par << " instead of " << sum;
+        std::cout << "\n " << nThread << " threads: parallel_reduce=" << reduce << " sec, parallel_for_each=" << for_each << " sec, speedup=" << scan / reduce;
+        if(nThread == nThreadMax)
+            break;
+    }
+}
+
+/// <summary> Reader-writer lock with one counter of readers (like std::shared_mutex): every reader writes the same cache line. The base line for TreeSharedLock. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+class SingleCounterLock
+{
+public:
+    SingleCounterLock() : m_nReader(0) {}
+
+    void lock_shared()
+    {
+        long n = m_nReader.load(std::memory_order_relaxed);
+        while(n < 0 || !m_nReader.compare_exchange_weak(n, n + 1, std::memory_order_acquire))
+        {
+            if(n < 0)
+            {
+                std::this_thread::yield();
+                n = m_nReader.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void unlock_shared() { m_nReader.fetch_sub(1, std::memory_order_release); }
+
+    void lock()
+    {
+        long n = 0;
+        while(!m_nReader.compare_exchange_weak(n, -1, std::memory_order_acquire))
+        {
+            n = 0;
+            std::this_thread::yield();
+        }
+    }
+
+    void unlock() { m_nReader.store(0, std::memory_order_release); }
+
+private:
+    // number of readers, -1 - the writer
+    std::atomic<long> m_nReader;
+};
+
+/// <summary> Runs lookups and inserts from several threads over the concurrent tree. </summary>
+/// <returns> Throughput, millions of operations per second. </returns>
+/// <param name="aKey"> in. The keys. </param>
+/// <param name="nThread"> in. Number of threads. </param>
+/// <param name="nWritePercent"> in. Percent of inserts. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Lock> double test_concurrent_throughput(const std::vector<int>& aKey, int nThread, int nWritePercent)
+{
+    // the operations of all threads
+    const int c_nOperation = 2000000;
+
+    ConcurrentTree<Tree<int, int>, Lock> tree;
+    {
+        typename ConcurrentTree<Tree<int, int>, Lock>::Writer writer = tree.write();
+        for(size_t i = 0; i < aKey.size(); ++i)
+            writer->insert(aKey[i], int(i));
+    }
+
+    std::atomic<size_t> nFound(0);
+    std::vector<std::thread> aThread;
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for(int t = 0; t < nThread; ++t)
+    {
+        aThread.push_back(std::thread([&, t]()
+        {
+            size_t nFoundThread = 0;
+            for(size_t i = t, n = aKey.size(); i < size_t(c_nOperation); i += nThread)
+            {
+                const int key = aKey[i % n];
+                int val;
+                if(int(i % 100) < nWritePercent)
+                    tree.insert(key, int(i));
+                else if(tree.find(key, val))
+                    ++nFoundThread;
+            }
+            nFound += nFoundThread;
+        }));
+    }
+    for(int t = 0; t < nThread; ++t)
+        aThread[t].join();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if(nFound.load() != size_t(c_nOperation) - size_t(c_nOperation) / 100 * nWritePercent)
+        std::cout << "\nError: " << nFound.load() << " keys are found";
+    return c_nOperation / seconds / 1e6;
+}
+
+/// <summary> Compares throughput of the concurrent tree with per-core reader counters and with one counter at 1..64 threads. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+void test_concurrent(const std::vector<int>& aKey)
+{
+    if(aKey.empty())
+        return;
+    std::cout << "\nConcurrent tree throughput (millions of operations per second, " << std::thread::hardware_concurrency() << " hardware threads):";
+    const int aWritePercent[] = { 0, 1, 10 };
+    for(int w = 0; w < 3; ++w)
+    {
+        std::cout << "\n " << aWritePercent[w] << "% inserts:";
+        for(int nThread = 1; nThread <= 64; nThread *= 2)
+        {
+            const double perCore = test_concurrent_throughput<TreeSharedLock>(aKey, nThread, aWritePercent[w]);
+            const double single = test_concurrent_throughput<SingleCounterLock>(aKey, nThread, aWritePercent[w]);
+            std::cout << "\n  " << nThread << " threads: per-core counters=" << perCore << ", one counter=" << single << ", speedup=" << perCore / single;
+        }
+    }
+}
+
+/// <summary> Compares lookups in random order before and after relocation of nodes in van Emde Boas order. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+void test_compact_veb(const std::vector<int>& aKey)
+{
+    Tree<int, int> tree;
+    for(size_t i = 0; i < aKey.size(); ++i)
+        tree.insert(aKey[i], int(i));
+    std::vector<int> aFind(aKey);
+    std::default_random_engine generator(10);
+    std::shuffle(aFind.begin(), aFind.end(), generator);
+
+    Timing time;
+    size_t nFound = 0;
+    time.start();
+    for(size_t i = 0; i < aFind.size(); ++i)
+        nFound += find_count(tree, aFind[i]);
+    const double find = time.stop();
+    time.start();
+    tree.compact_veb();
+    const double compact = time.stop();
+    time.start();
+    for(size_t i = 0; i < aFind.size(); ++i)
+        nFound -= find_count(tree, aFind[i]);
+    const double find_veb = time.stop();
+    if(nFound)
+        std::cout << "\nError: the compacted tree lost " << nFound << " keys";
+    std::cout << "\nvan Emde Boas layout timing:\n find=" << find << " sec, compact_veb=" << compact << " sec, find after compaction=" << find_veb << " sec, speedup=" << find / find_veb;
+}
+
+/// <summary> Compares the tree used as a priority queue of a scheduler with std::map: take the least key, remove it and insert a later one. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+void test_min_access(const std::vector<int>& aKey)
+{
+    const int nKey = int(aKey.size());
+    Tree<int, int> tree;
+    std::map<int, int> map;
+    for(int i = 0; i < nKey; ++i)
+    {
+        tree.insert(aKey[i], i);
+        map[aKey[i]] = i;
+    }
+
+    Timing time;
+    long long sum = 0, sum_std = 0;
+    time.start();
+    for(int i = 0; i < nKey; ++i)
+    {
+        const int key = tree.min().key();
+        sum += tree.min().value();
+        tree.pop_min();
+        tree.insert(key + nKey, i);
+    }
+    const double pop = time.stop();
+    time.start();
+    for(int i = 0; i < nKey; ++i)
+    {
+        const int key = map.begin()->first;
+        sum_std += map.begin()->second;
+        map.erase(map.begin());
+        map.insert(std::make_pair(key + nKey, i));
+    }
+    const double pop_std = time.stop();
+    if(sum != sum_std || tree.max().key() != map.rbegin()->first)
+        std::cout << "\nError: the tree and std::map differ after pop_min";
+    std::cout << "\nScheduler timing (" << nKey << " x min, pop_min, insert):\n tree=" << pop << " sec, std::map=" << pop_std << " sec, difference=" << pop_std / pop;
+}
+
+/// <summary> Compares insertion of sorted and nearly sorted keys: from the finger, with the hint and into std::map. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+void test_finger_insert(int nKey)
+{
+    const char* c_aMode[] = { "sorted", "reverse sorted", "shuffled by 16" };
+    std::default_random_engine generator(8);
+    std::cout << "\nFinger insert timing:";
+    for(int mode = 0; mode < 3; ++mode)
+    {
+        std::vector<int> aKey(nKey);
+        for(int i = 0; i < nKey; ++i)
+            aKey[i] = mode == 1 ? nKey - i : i;
+        if(mode == 2)
+        {
+            for(int i = 0; i < nKey; i += 16)
+                std::shuffle(aKey.begin() + i, aKey.begin() + std::min(i + 16, nKey), generator);
+        }
+
+        Timing time;
+        Tree<int, int> tree;
+        time.start();
+        for(int i = 0; i < nKey; ++i)
+            tree.insert(aKey[i], i);
+        const double plain = time.stop();
+        const size_t nFinger = tree.stats().m_nFinger;
+
+        // the hint is the previous inserted node
+        Tree<int, int> treeHint;
+        Tree<int, int>::Iterator hint = treeHint.end();
+        time.start();
+        for(int i = 0; i < nKey; ++i)
+            hint = treeHint.insert(hint, aKey[i], i).first;
+        const double hinted = time.stop();
+
+        std::map<int, int> map;
+        time.start();
+        for(int i = 0; i < nKey; ++i)
+            map.insert(std::make_pair(aKey[i], i));
+        const double insert_std = time.stop();
+        if(tree.size() != map.size() || treeHint.size() != map.size())
+            std::cout << "\nError: the trees contain " << tree.size() << " and " << treeHint.size() << " keys instead of " << map.size();
+
+        std::cout << "\n " << c_aMode[mode] << ": insert=" << plain << " sec (" << nFinger << " at the finger), insert with hint=" << hinted 
+                  << " sec, std::map insert=" << insert_std << " sec, difference=" << insert_std / plain;
+    }
+}
+
 /// <summary> Teste tree prfrormance </summary>
 /// <param name="nKey"> in. Number of keys to be insertd in the tree. </param>
 /// <param name="bShuffle"> in. Indicates whether keys should be shuffled befor inserting in the tree. </param>
@@ -86,11 +857,82 @@ void test_peformance(int nKey, bool bShuffle)
     double insert, find, remove;
     test_peformance<Tree<int, int>>(insert, find, remove, aKey);
     std::cout << "\nTree timing:\n insert=" << insert << " sec, find=" << find << " sec, remove=" << remove << " sec";
+    test_retrace(aKey);
+    test_bulk_load(nKey);
+    test_insert_batch(nKey);
+    test_range_scan(aKey);
+    test_erase_range(aKey);
+    test_split_join(aKey);
+    test_union(aKey);
+    test_query_range(aKey);
+    test_intervals(nKey);
+    test_finger_insert(nKey);
+    test_min_access(aKey);
+    test_find_batch(aKey);
+    test_compact_veb(aKey);
+    test_thread_scan(aKey);
+    test_parallel_scan(aKey);
+    test_concurrent(aKey);
 
     double insert_std, find_std, remove_std;
     test_peformance<std::map<int, int>>(insert_std, find_std, remove_std, aKey);
     std::cout << "\nstd::map timing:\n insert=" << insert_std << " sec, find=" << find_std << " sec, remove=" << remove_std << " sec";
 
     std::cout << "\nDifference:\n insert=" << insert_std / insert << " find=" << find_std / find << " remove=" << remove_std / remove;
+
+    // immutable snapshot in Eytzinger layout
+    double insert_frz, find_frz, remove_frz;
+    test_peformance<TreeFrozenTest>(insert_frz, find_frz, remove_frz, aKey);
+    Tree<int, int> tree;
+    for(int i = 0; i < nKey; ++i)
+        tree.insert(aKey[i], i);
+    Timing time;
+    time.start();
+    TreeFrozen<int, int> frozen = tree.freeze();
+    const double freeze = time.stop();
+    std::cout << "\nFrozen snapshot timing:\n find=" << find_frz << " sec (including freeze=" << freeze << " sec)";
+    std::cout << "\nFrozen snapshot speedup:\n find: tree=" << find / find_frz << " std::map=" << find_std / find_frz;
+
+    // the comparison through function pointer (the former default behaviour of the tree)
+    double insert_fn, find_fn, remove_fn;
+    test_peformance<Tree<int, int, TreeCompareFn<int>>>(insert_fn, find_fn, remove_fn, aKey);
+    std::cout << "\nTree with function pointer comparator timing:\n insert=" << insert_fn << " sec, find=" << find_fn << " sec, remove=" << remove_fn << " sec";
+    std::cout << "\nInlined comparator speedup:\n insert=" << insert_fn / insert << " find=" << find_fn / find << " remove=" << remove_fn / remove;
+
+    // allocation of each node by new/delete (the former behaviour of the tree)
+    double insert_new, find_new, remove_new;
+    test_peformance<Tree<int, int, TreeCompare<int>, TreeNodeNew>>(insert_new, find_new, remove_new, aKey);
+    const double churn = test_churn<Tree<int, int>>(aKey);
+    const double churn_new = test_churn<Tree<int, int, TreeCompare<int>, TreeNodeNew>>(aKey);
+    std::cout << "\nTree with new/delete allocator timing:\n insert=" << insert_new << " sec, find=" << find_new << " sec, remove=" << remove_new << " sec";
+    std::cout << "\nChurn timing:\n pool=" << churn << " sec, new/delete=" << churn_new << " sec";
+    std::cout << "\nPool allocator speedup:\n insert=" << insert_new / insert << " find=" << find_new / find << " remove=" << remove_new / remove << " churn=" << churn_new / churn;
+
+    // compact storage of nodes
+    double insert_cmp, find_cmp, remove_cmp;
+    test_peformance<TreeCompact<int, int>>(insert_cmp, find_cmp, remove_cmp, aKey);
+    std::cout << "\nCompact tree timing (node size " << sizeof(TreeCompactNode<int, int>) << " bytes instead of " << sizeof(TreeNode<int, int>) << "):\n insert=" << insert_cmp << " sec, find=" << find_cmp << " sec, remove=" << remove_cmp << " sec";
+    std::cout << "\nCompact tree speedup:\n insert=" << insert / insert_cmp << " find=" << find / find_cmp << " remove=" << remove / remove_cmp;
+
+    // nodes without links to parent
+    double insert_np, find_np, remove_np;
+    test_peformance<TreeNoParent<int, int>>(insert_np, find_np, remove_np, aKey);
+    std::cout << "\nTree without parent links timing (node size " << sizeof(TreeNoParentNode<int, int>) << " bytes):\n insert=" << insert_np << " sec, find=" << find_np << " sec, remove=" << remove_np << " sec";
+    std::cout << "\nTree without parent links speedup:\n insert=" << insert / insert_np << " find=" << find / find_np << " remove=" << remove / remove_np;
+
+    // B+ tree with SIMD search in nodes
+    double insert_bp, find_bp, remove_bp;
+    test_peformance<TreeBPlus<int, int>>(insert_bp, find_bp, remove_bp, aKey);
+    std::cout << "\nB+ tree timing (leaf size " << sizeof(TreeBPlusLeaf<int, int, 32>) << " bytes for 32 keys):\n insert=" << insert_bp << " sec, find=" << find_bp << " sec, remove=" << remove_bp << " sec";
+    std::cout << "\nB+ tree speedup:\n tree: insert=" << insert / insert_bp << " find=" << find / find_bp << " remove=" << remove / remove_bp
+              << "\n std::map: insert=" << insert_std / insert_bp << " find=" << find_std / find_bp << " remove=" << remove_std / remove_bp;
+    test_bplus_sizes(nKey);
+
+    // overhead of maintenance of subtree sizes
+    double insert_cnt, find_cnt, remove_cnt;
+    test_peformance<Tree<int, int, TreeCompare<int>, TreeNodePool, TreeAugmentCount>>(insert_cnt, find_cnt, remove_cnt, aKey);
+    std::cout << "\nTree with subtree sizes timing (node size " << sizeof(TreeNode<int, int, TreeAugmentCount>) << " bytes instead of " << sizeof(TreeNode<int, int>) << "):\n insert=" << insert_cnt << " sec, find=" << find_cnt << " sec, remove=" << remove_cnt << " sec";
+    std::cout << "\nSubtree sizes overhead:\n insert=" << insert_cnt / insert << " find=" << find_cnt / find << " remove=" << remove_cnt / remove;
+    test_order_statistics(aKey);
     std::cout << "\n";
 }
\ No newline at end of file
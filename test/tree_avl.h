@@ -1,7 +1,20 @@
 #pragma once
+#include "tree_thread_pool.h"
 #include <assert.h>
 #include <algorithm>
 #include <fstream>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdint.h>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <xmmintrin.h>
+#endif
 
 /// <summary> The default keys comparison function. </summary>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
@@ -14,23 +27,441 @@ template<class T> int defCompFunc(const T& a, const T& b)
     return 0;
 }
 
-/// <summary> Implements tree node, contains pair of value and key. </summary>
+/// <summary> The default keys comparator (three-way style), inlined into the tree code. </summary>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
-template<class Key, class Val> class TreeNode
+template<class T, bool bArithmetic = std::is_arithmetic<T>::value> struct TreeCompare
+{
+    int operator()(const T& a, const T& b) const { return a < b ? -1 : (b < a ? 1 : 0); }
+};
+
+/// <summary> The default comparator for arithmetic keys: branch-free three-way comparison. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class T> struct TreeCompare<T, true>
+{
+    int operator()(T a, T b) const { return int(b < a) - int(a < b); }
+};
+
+/// <summary> 
+/// The transparent comparator: compares values of different types (e.g. std::string key with const char* or std::string_view), 
+/// lets the tree search by a value which isn't the Key without constructing a temporary Key.
+/// </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<> struct TreeCompare<void, false>
+{
+    typedef void is_transparent;
+    template<class A, class B> int operator()(const A& a, const B& b) const { return a < b ? -1 : (b < a ? 1 : 0); }
+};
+
+/// <summary> Adapter of the keys comparison function pointer to the comparator interface. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class T> class TreeCompareFn
+{
+public:
+    typedef int(*t_fnCompare)(const T& a, const T& b);
+
+    // the implicit conversion keeps working the code which passes function pointer to the tree constructor
+    TreeCompareFn(t_fnCompare fnCmp = NULL) : m_fnCmp(fnCmp ? fnCmp : defCompFunc<T>) {}
+    int operator()(const T& a, const T& b) const { return m_fnCmp(a, b); }
+
+private:
+    t_fnCompare m_fnCmp;
+};
+
+/// <summary> Three-way comparison of keys by comparator of any style: three-way (returns int) or std::less (returns bool). </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Compare, class A, class B> int tree_compare(const Compare& cmp, const A& a, const B& b, std::false_type)
+{
+    return cmp(a, b);
+}
+
+template<class Compare, class A, class B> int tree_compare(const Compare& cmp, const A& a, const B& b, std::true_type)
+{
+    return cmp(a, b) ? -1 : int(cmp(b, a));
+}
+
+template<class Compare, class A, class B> int tree_compare(const Compare& cmp, const A& a, const B& b)
+{
+    return tree_compare(cmp, a, b, std::is_same<decltype(cmp(a, b)), bool>());
+}
+
+/// <summary> Hints the processor to load the cache line of the address, does nothing if the compiler has no prefetch intrinsic. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+inline void tree_prefetch(const void* p)
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    _mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#elif defined(__GNUC__)
+    __builtin_prefetch(p);
+#else
+    (void)p;
+#endif
+}
+
+/// <summary> Stable sort of the subrange: the halves are sorted in parallel and merged. </summary>
+/// <param name="first"> in. The beginning of range (random access iterator). </param>
+/// <param name="last"> in. The end of range. </param>
+/// <param name="less"> in. The comparator of elements (std::less style). </param>
+/// <param name="nDepth"> in. The remaining depth of parallel recursion. </param>
+/// <param name="pool"> in. The thread pool. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class It, class Less> void tree_parallel_sort_imp(It first, It last, Less& less, int nDepth, TreeThreadPool& pool)
+{
+    // minimal number of elements in chunk sorted by separate thread
+    const size_t c_nMinChunk = 1 << 15;
+
+    const size_t n = last - first;
+    if(nDepth == 0 || n < 2 * c_nMinChunk)
+    {
+        std::stable_sort(first, last, less);
+        return;
+    }
+
+    const It mid = first + n / 2;
+    pool.invoke(
+        [&]() { tree_parallel_sort_imp(first, mid, less, nDepth - 1, pool); },
+        [&]() { tree_parallel_sort_imp(mid, last, less, nDepth - 1, pool); });
+    std::inplace_merge(first, mid, last, less);
+}
+
+/// <summary> Stable sort of the range. Large range is split into chunks which are sorted and then merged in parallel by the thread pool. </summary>
+/// <param name="first"> in. The beginning of range (random access iterator). </param>
+/// <param name="last"> in. The end of range. </param>
+/// <param name="less"> in. The comparator of elements (std::less style). </param>
+/// <param name="pool"> in. Optional. The thread pool. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class It, class Less> void tree_parallel_sort(It first, It last, Less less, TreeThreadPool& pool = TreeThreadPool::instance())
+{
+    // a chunk per thread
+    int nDepth = 0;
+    for(size_t n = 1; n < pool.size(); n *= 2)
+        ++nDepth;
+    tree_parallel_sort_imp(first, last, less, nDepth, pool);
+}
+
+/// <summary> Allocates memory aligned to cache line (64 bytes), the pointer to the allocated block is stored before the aligned memory. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+inline void* tree_aligned_allocate(size_t nSize)
+{
+    char* pRaw = static_cast<char*>(::operator new(nSize + 64));
+    char* p = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(pRaw) + 64) & ~uintptr_t(63));
+    reinterpret_cast<char**>(p)[-1] = pRaw;
+    return p;
+}
+
+/// <summary> Releases memory allocated by tree_aligned_allocate. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+inline void tree_aligned_free(void* p)
+{
+    ::operator delete(reinterpret_cast<char**>(p)[-1]);
+}
+
+/// <summary> 
+/// The default nodes allocator: hands out nodes from large contiguous blocks and recycles released nodes through the free list. 
+/// Memory of all nodes is released in bulk by release() or by destructor. 
+/// The blocks are reference counted: the pool which receives nodes of another pool (split/join of trees) shares its blocks, 
+/// so the blocks are released when the last sharing pool is released. The free lists aren't shared. 
+/// </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class T> class TreeNodePool
+{
+public:
+    // the tree may skip releasing of each node if the nodes don't need destruction
+    static const bool bulk_release = true;
+
+public:
+    // constructor/destructor
+    TreeNodePool() : m_pFree(NULL), m_pNext(NULL), m_pEnd(NULL), m_nBlock(0) {}
+    ~TreeNodePool() { release(); }
+
+    /// <summary> Allocates memory for one node. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    T* allocate()
+    {
+        // reuse released node
+        if(m_pFree)
+        {
+            T* p = reinterpret_cast<T*>(m_pFree);
+            m_pFree = m_pFree->m_pNext;
+            return p;
+        }
+
+        // next node from the current block
+        if(m_pNext == m_pEnd)
+            add_block(m_nBlock ? std::min<size_t>(2 * m_nBlock, eMaxBlock) : size_t(eMinBlock));
+        T* p = reinterpret_cast<T*>(m_pNext);
+        m_pNext += sizeof(T);
+        return p;
+    }
+
+    /// <summary> Ensures that next nNode nodes (if the free list is empty) are allocated from one contiguous block. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void reserve(size_t nNode)
+    {
+        if(size_t(m_pEnd - m_pNext) < nNode * sizeof(T))
+            add_block(nNode);
+    }
+
+    /// <summary> Returns memory of one node to the free list. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void deallocate(T* p)
+    {
+        FreeNode* pFree = reinterpret_cast<FreeNode*>(p);
+        pFree->m_pNext = m_pFree;
+        m_pFree = pFree;
+    }
+
+    /// <summary> Releases memory of all nodes (the blocks shared with other pools are released by the last of them). </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void release()
+    {
+        m_pArena.reset();
+        m_aShared.clear();
+        m_pFree = NULL;
+        m_pNext = m_pEnd = NULL;
+        m_nBlock = 0;
+    }
+
+    /// <summary> Exchanges content with another pool. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void swap(TreeNodePool& pool)
+    {
+        std::swap(m_pFree, pool.m_pFree);
+        std::swap(m_pNext, pool.m_pNext);
+        std::swap(m_pEnd, pool.m_pEnd);
+        std::swap(m_nBlock, pool.m_nBlock);
+        m_pArena.swap(pool.m_pArena);
+        m_aShared.swap(pool.m_aShared);
+    }
+
+    /// <summary> Shares blocks of another pool: nodes allocated by that pool may be passed to this one. </summary>
+    /// <param name="pool"> in. The pool which nodes are passed. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void share(const TreeNodePool& pool)
+    {
+        add_shared(pool.m_pArena);
+        for(size_t i = 0, n = pool.m_aShared.size(); i < n; ++i)
+            add_shared(pool.m_aShared[i]);
+    }
+
+private:
+    // limits of block size (number of nodes)
+    enum { eMinBlock = 64, eMaxBlock = 64 * 1024 };
+
+    // released node in the free list
+    struct FreeNode { FreeNode* m_pNext; };
+
+    // the blocks allocated by one pool
+    struct Arena
+    {
+        ~Arena()
+        {
+            for(size_t i = 0, n = m_aBlock.size(); i < n; ++i)
+                ::operator delete(m_aBlock[i]);
+        }
+        std::vector<void*> m_aBlock;
+    };
+
+    void add_block(size_t nNode)
+    {
+        if(!m_pArena)
+            m_pArena = std::make_shared<Arena>();
+        m_pArena->m_aBlock.reserve(m_pArena->m_aBlock.size() + 1);
+        m_pNext = static_cast<char*>(::operator new(nNode * sizeof(T)));
+        m_pEnd = m_pNext + nNode * sizeof(T);
+        m_pArena->m_aBlock.push_back(m_pNext);
+        m_nBlock = nNode;
+    }
+
+    void add_shared(const std::shared_ptr<Arena>& pArena)
+    {
+        if(!pArena || pArena == m_pArena || std::find(m_aShared.begin(), m_aShared.end(), pArena) != m_aShared.end())
+            return;
+        m_aShared.push_back(pArena);
+    }
+
+    // copying is forbidden
+    TreeNodePool(const TreeNodePool&);
+    TreeNodePool& operator=(const TreeNodePool&);
+
+private:
+    // head of the free list
+    FreeNode* m_pFree;
+    // unused part of the current block
+    char* m_pNext;
+    char* m_pEnd;
+    // number of nodes in the current block
+    size_t m_nBlock;
+    // blocks allocated by this pool
+    std::shared_ptr<Arena> m_pArena;
+    // blocks of other pools which nodes were passed to this pool
+    std::vector<std::shared_ptr<Arena>> m_aShared;
+};
+
+/// <summary> Nodes allocator which allocates each node on the heap by operator new. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class T> class TreeNodeNew
+{
+public:
+    // each node should be released separately
+    static const bool bulk_release = false;
+
+public:
+    T* allocate() { return static_cast<T*>(::operator new(sizeof(T))); }
+    void deallocate(T* p) { ::operator delete(p); }
+    void reserve(size_t) {}
+    void release() {}
+    void share(const TreeNodeNew&) {}
+    void swap(TreeNodeNew&) {}
+};
+
+/// <summary> The default augmentation of nodes: no additional data. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+struct TreeAugmentNone
+{
+    // the data stored in each node
+    struct Data {};
+
+    // the data of nodes above the changed node don't need update
+    static const bool propagate = false;
+
+    // the data doesn't depend on values: assignment of value doesn't need update
+    static const bool propagate_value = false;
+
+    // recalculates the data of the node from its children
+    template<class Node> static void update(Node&) {}
+
+    // checks the data of the node
+    template<class Node> static bool check(const Node&) { return true; }
+};
+
+/// <summary> Augmentation of nodes by the number of nodes in subtree, provides order statistics: Tree::select, Tree::rank, Tree::count_range. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+struct TreeAugmentCount
+{
+    struct Data
+    {
+        Data() : m_count(1) {}
+
+        // number of nodes in the subtree
+        size_t m_count;
+    };
+
+    static const bool propagate = true;
+    static const bool propagate_value = false;
+
+    template<class Node> static size_t count(const Node* pNode) { return pNode ? pNode->m_count : 0; }
+    template<class Node> static void update(Node& node) { node.m_count = 1 + count(node.m_child[0]) + count(node.m_child[1]); }
+    template<class Node> static bool check(const Node& node) { return node.m_count == 1 + count(node.m_child[0]) + count(node.m_child[1]); }
+};
+
+/// <summary> 
+/// Augmentation of nodes by the aggregate of subtree (sum, min, max, ...), provides Tree::query_range. 
+/// Monoid defines value_type, identity(), lift(key, value) - the aggregate of one node and associative combine(a, b) - the aggregate of 
+/// adjacent ranges a and b (in order of keys). isValid() compares the aggregates by operator==. 
+/// The aggregates are updated by insert/erase and by insert_or_assign. The values changed in place through find(), operator[], Iterator::value() 
+/// or the iterator returned by emplace/try_emplace aren't tracked: call Tree::update(key) after such change, otherwise query_range returns stale aggregates. 
+/// </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class M> struct TreeAugmentAggregate
+{
+    typedef M Monoid;
+    typedef typename Monoid::value_type value_type;
+
+    struct Data
+    {
+        // aggregate of the subtree
+        value_type m_aggregate;
+    };
+
+    static const bool propagate = true;
+    static const bool propagate_value = true;
+
+    template<class Node> static value_type aggregate(const Node* pNode) { return pNode ? pNode->m_aggregate : Monoid::identity(); }
+    template<class Node> static value_type calculate(const Node& node) 
+    { 
+        return Monoid::combine(Monoid::combine(aggregate(node.m_child[0]), Monoid::lift(node.m_key, node.m_value)), aggregate(node.m_child[1])); 
+    }
+    template<class Node> static void update(Node& node) { node.m_aggregate = calculate(node); }
+    template<class Node> static bool check(const Node& node) { return node.m_aggregate == calculate(node); }
+};
+
+/// <summary> The monoid of sum of values for TreeAugmentAggregate. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class T> struct TreeMonoidSum
+{
+    typedef T value_type;
+    static T identity() { return T(); }
+    template<class K, class V> static T lift(const K&, const V& val) { return T(val); }
+    static T combine(const T& a, const T& b) { return a + b; }
+};
+
+/// <summary> The monoid of minimum of values for TreeAugmentAggregate. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class T> struct TreeMonoidMin
+{
+    typedef T value_type;
+    static T identity() { return std::numeric_limits<T>::max(); }
+    template<class K, class V> static T lift(const K&, const V& val) { return T(val); }
+    static T combine(const T& a, const T& b) { return b < a ? b : a; }
+};
+
+/// <summary> The monoid of maximum of values (e.g. the last timestamp) for TreeAugmentAggregate. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class T> struct TreeMonoidMax
+{
+    typedef T value_type;
+    static T identity() { return std::numeric_limits<T>::lowest(); }
+    template<class K, class V> static T lift(const K&, const V& val) { return T(val); }
+    static T combine(const T& a, const T& b) { return a < b ? b : a; }
+};
+
+/// <summary> 
+/// Augmentation of nodes by links to the previous and the next nodes in order of keys (threads), combined with another augmentation 
+/// (e.g. TreeAugmentThread<TreeAugmentCount>). Iterator::next/prev, the finger and erase follow one link instead of climbing through parents, 
+/// so a full scan is one dependent load per node. Rotations don't change the order, the links are maintained by insert, erase, split/join 
+/// and bulk operations; set operations (union_with, ...) and compact_veb re-thread the whole tree in O(n). Costs two pointers per node. 
+/// </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Augment = TreeAugmentNone> struct TreeAugmentThread : Augment
+{
+    struct Data : Augment::Data
+    {
+        Data() { m_thread[0] = m_thread[1] = NULL; }
+
+        // the previous and the next nodes in order of keys (TreeNode), NULL for the first (the last) node
+        void* m_thread[2];
+    };
+};
+
+/// <summary> Checks whether the augmentation threads the nodes in order of keys. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Augment> struct TreeIsThreaded : std::false_type {};
+template<class Augment> struct TreeIsThreaded<TreeAugmentThread<Augment>> : std::true_type {};
+
+// the immutable snapshot of the tree made by Tree::freeze(), defined in tree_avl_frozen.h
+template<class Key, class Val, class Compare = TreeCompare<Key>> class TreeFrozen;
+
+/// <summary> 
+/// Implements tree node, contains pair of value and key. 
+/// Augment is the policy of additional data of node (the base class) calculated from the children: TreeAugmentNone (default), TreeAugmentCount or TreeAugmentAggregate, 
+/// optionally with links to the neighbours in order of keys: TreeAugmentThread. 
+/// </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Augment = TreeAugmentNone> class TreeNode : public Augment::Data
 {
 public:
     // Enumeration for manupulations with left/right children of the node
     enum EBranch { eLeft = 0, eRight = 1 };
 
 public:
-    // constructor/destructor
-    TreeNode(const Key& key) : m_key(key), m_height(1), m_parent(NULL) { m_child[eLeft] = m_child[eRight] = NULL; }
-    ~TreeNode() { delete m_child[0]; delete m_child[1]; }
+    // constructor, the key and the value are constructed in place from the arguments
+    template<class K, class... Args> explicit TreeNode(K&& key, Args&&... args) 
+        : m_parent(NULL), m_height(1), m_value(std::forward<Args>(args)...), m_key(std::forward<K>(key)) { m_child[eLeft] = m_child[eRight] = NULL; Augment::update(*this); }
 
     // access to node height and balance
     unsigned char height(EBranch branch) const { return m_child[branch] ? m_child[branch]->m_height : 0; }
     int balance() const { return height(eLeft) - height(eRight); }
-    void update_height() { m_height = 1 + std::max(height(eLeft), height(eRight)); }
+    void update_height() { m_height = 1 + std::max(height(eLeft), height(eRight)); Augment::update(*this); }
 
     // access to parent/left/right nodes
     TreeNode* parent() { return m_parent; }
@@ -39,7 +470,7 @@ public:
 
 private:
     // assignment is forbidden
-    TreeNode<Key, Val>& operator=(const TreeNode<Key, Val>&) { return *this; }
+    TreeNode& operator=(const TreeNode&) { return *this; }
 
 public:
     // parent node
@@ -54,20 +485,43 @@ public:
     const Key m_key;
 };
 
-/// <summary> The AVL tree itemplate implementation: balanced binary tree. </summary>
+/// <summary> Statistics of tree balancing. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+struct TreeStats
+{
+    TreeStats() : m_nRetrace(0), m_nRotation(0), m_nFinger(0) {}
+
+    // number of ancestors visited while retracing after insert/erase
+    size_t m_nRetrace;
+    // number of single rotations (double rotation is counted as two)
+    size_t m_nRotation;
+    // number of inserts which found the position next to the finger (the last inserted node) without search from the root
+    size_t m_nFinger;
+};
+
+/// <summary> 
+/// The AVL tree itemplate implementation: balanced binary tree. 
+/// Compare is a comparator of keys: either three-way style (returns negative/zero/positive int, like defCompFunc) 
+/// or std::less style (returns bool). Functors, lambdas and stateful comparators are supported, 
+/// use TreeCompareFn to pass a function pointer. 
+/// Alloc is an allocator of nodes: TreeNodePool (default) or TreeNodeNew. 
+/// Augment is the policy of additional data of nodes: TreeAugmentNone (default), TreeAugmentCount or TreeAugmentAggregate, 
+/// TreeAugmentThread adds links to the neighbours for O(1) iteration. 
+/// </summary>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
-template<class Key, class Val> class Tree
+template<class Key, class Val, class Compare = TreeCompare<Key>, template<class> class Alloc = TreeNodePool, class Augment = TreeAugmentNone> class Tree
 {
 public:
-    typedef int(*t_fnCompare)(const Key& a, const Key& b);
-    typedef TreeNode<Key, Val> Node;
+    typedef TreeNode<Key, Val, Augment> Node;
 
 public:
     /// <summary> Tree iterator. </summary>
     /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    class ConstIterator;
     class Iterator
     {       
-        friend class Tree<Key, Val>;
+        friend class Tree<Key, Val, Compare, Alloc, Augment>;
+        friend class ConstIterator;
     public:
 
         /// <summary> Constructor </summary>
@@ -77,7 +531,17 @@ public:
         /// <summary> Moves iterator to next node in the tree. </summary>
         /// <returns> True if the curent node isn't end </returns>
         /// <remarks> Author: Vladimir Zelyonkin </remarks>
-        bool next();
+        bool next() { return next(t_threaded()); }
+
+        /// <summary> Moves iterator to previous node in the tree. </summary>
+        /// <returns> True if the curent node isn't end </returns>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        bool prev()
+        {
+            if(m_node)
+                m_node = neighbour(m_node, Node::eLeft);
+            return m_node != NULL;
+        }
 
         /// <summary> Checks whether the node is end node of the tree. </summary>
         /// <remarks> Author: Vladimir Zelyonkin </remarks>
@@ -91,327 +555,2358 @@ public:
         /// <remarks> Author: Vladimir Zelyonkin </remarks>
         Val& value() { return m_node->m_value; }
 
+        /// <summary> Checks whether iterators point to the same node. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        bool operator==(const Iterator& it) const { return m_node == it.m_node; }
+        bool operator!=(const Iterator& it) const { return m_node != it.m_node; }
+
     private:
+        // the threaded node links the next one
+        bool next(std::true_type)
+        {
+            if(m_node)
+                m_node = thread(m_node, Node::eRight);
+            return m_node != NULL;
+        }
+        bool next(std::false_type);
+
         Node* m_node;
     };
+
+    /// <summary> The iterator of the const tree, the values are read-only. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    class ConstIterator
+    {
+    public:
+
+        /// <summary> Constructor </summary>
+        /// <param name="it"> in. The iterator of the tree. </param>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        ConstIterator(const Iterator& it) : m_it(it) {}
+
+        /// <summary> Moves iterator to next node in the tree. </summary>
+        /// <returns> True if the curent node isn't end </returns>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        bool next() { return m_it.next(); }
+
+        /// <summary> Moves iterator to previous node in the tree. </summary>
+        /// <returns> True if the curent node isn't end </returns>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        bool prev() { return m_it.prev(); }
+
+        /// <summary> Checks whether the node is end node of the tree. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        bool isEnd() const { return m_it.isEnd(); }
+
+        /// <summary> Queries the node key. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        const Key& key() const { return m_it.key(); }
+
+        /// <summary> Queries the node value. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        const Val& value() const { return m_it.m_node->m_value; }
+
+        /// <summary> Checks whether iterators point to the same node. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        bool operator==(const ConstIterator& it) const { return m_it == it.m_it; }
+        bool operator!=(const ConstIterator& it) const { return m_it != it.m_it; }
+
+    private:
+        Iterator m_it;
+    };
     
     /// <summary> Constructor </summary>
-    /// <param name="fnCmp"> in. Optional. Pointer to function for comparison of keys. </param>
+    /// <param name="cmp"> in. Optional. The comparator of keys. </param>
     /// <remarks> Author: Vladimir Zelyonkin </remarks>
-    explicit Tree(t_fnCompare fnCmp = NULL) : m_root(NULL), m_fnCmp(fnCmp ? fnCmp : defCompFunc<Key>) {}
+    explicit Tree(const Compare& cmp = Compare()) : m_cmp(cmp), m_root(NULL), m_size(0), m_pFinger(NULL), m_pFingerPrev(NULL), m_pFingerNext(NULL), m_pMin(NULL), m_pMax(NULL) {}
 
-    /// <summary> Destructor </summary>
+    /// <summary> Constructor, builds the tree from sorted range in linear time, see assign_sorted. </summary>
+    /// <param name="first"> in. The beginning of range of pairs of key and value sorted by keys without duplicates. </param>
+    /// <param name="last"> in. The end of range. </param>
+    /// <param name="cmp"> in. Optional. The comparator of keys. </param>
     /// <remarks> Author: Vladimir Zelyonkin </remarks>
-    virtual ~Tree() { delete m_root; }
+    template<class It> Tree(It first, It last, const Compare& cmp = Compare()) 
+        : m_cmp(cmp), m_root(NULL), m_size(0), m_pFinger(NULL), m_pFingerPrev(NULL), m_pFingerNext(NULL), m_pMin(NULL), m_pMax(NULL) { assign_sorted(first, last); }
 
-    /// <summary> Searches for node with specified key. </summary>
-    /// <returns> Pointer to node value, NULL if specified key isn't found in the tree. </returns>
-    /// <param name="key"> in. The key of node to be found. </param>
+    /// <summary> Destructor </summary>
     /// <remarks> Author: Vladimir Zelyonkin </remarks>
-    Val* find(const Key& key);
+    virtual ~Tree() { clear(); }
 
-    /// <summary> Searches for node with specified key. </summary>
-    /// <returns> Pointer to node value, NULL if specified key isn't found in the tree. </returns>
-    /// <param name="key"> in. The key of node to be found. </param>
-    /// <remarks> Author: Vladimir Zelyonkin </remarks>
-    const Val* find(const Key& key) const;
-    
-    /// <summary> Removes node with specified key from the tree. </summary>
-    /// <param name="key"> in. The key of node to be removed. </param>
+    /// <summary> Removes all nodes from the tree. </summary>
     /// <remarks> Author: Vladimir Zelyonkin </remarks>
-    void erase(const Key& key);
+    void clear();
 
-    /// <summary> Inserts new node into the tree. </summary>
-    /// <param name="key"> in. The node key. </param>
-    /// <param name="val"> in. The node value. </param>
+    /// <summary> 
+    /// Replaces content of the tree by the sorted range. Builds perfectly balanced tree bottom-up in linear time,
+    /// the nodes are allocated from one contiguous block in order of keys. 
+    /// </summary>
+    /// <param name="first"> in. The beginning of range of pairs of key and value (forward iterator), sorted by keys without duplicates. </param>
+    /// <param name="last"> in. The end of range. </param>
     /// <remarks> Author: Vladimir Zelyonkin </remarks>
-    void insert(const Key& key, const Val& val);
+    template<class It> void assign_sorted(It first, It last);
 
-    /// <summary> Inserts new node into the tree. </summary>
-    /// <param name="pair"> in. The node key and value. </param>
+    /// <summary> 
+    /// Inserts the batch of pairs of key and value (in any order). The batch is sorted once (in parallel if it is large), 
+    /// then it is merged into the tree in single pass from the last inserted position, or, if the batch is large relative to the tree, 
+    /// the tree is rebuilt together with the batch in linear time. Values of existing keys are replaced, the last of duplicated keys wins. 
+    /// </summary>
+    /// <param name="first"> in. The beginning of range of pairs of key and value. </param>
+    /// <param name="last"> in. The end of range. </param>
     /// <remarks> Author: Vladimir Zelyonkin </remarks>
-    void insert(const std::pair<Key, Val>& pair) { insert(pair.first, pair.second); }
-    
-    /// <summary> Accesses the node value by its key. Important: if node with specified key isn't exists in tree - node with default value will be inserted. </summary>
-    /// <returns> The reference to node value. </returns>
-    /// <param name="key"> in. The key of node to be found. </param>
+    template<class It> void insert_batch(It first, It last);
+
+    /// <summary> Queries number of nodes in the tree in O(1). </summary>
     /// <remarks> Author: Vladimir Zelyonkin </remarks>
-    Val& operator[](const Key& key) { return node_imp(key).m_value; }
-    
-    /// <summary> Queries the tree iterator. </summary>
-    /// <returns> The iteraror. </returns>
+    size_t size() const { return m_size; }
+
+    /// <summary> 
+    /// Splits the tree by the key in O(log n): the nodes with keys not less than the key are moved to the right tree, the rest nodes remain in this tree. 
+    /// The nodes aren't copied, the right tree shares memory blocks of this tree. 
+    /// Without TreeAugmentCount the nodes of the smaller part are counted for size(), the time is O(log n + min(size of the parts)). 
+    /// </summary>
+    /// <param name="key"> in. The key. </param>
+    /// <param name="right"> out. The tree which receives the nodes with greater keys, its previous content is removed. </param>
     /// <remarks> Author: Vladimir Zelyonkin </remarks>
-    Iterator begin();
+    void split(const Key& key, Tree& right) { split_tree(key, right); }
+    template<class K, class C = Compare, class = typename C::is_transparent> void split(const K& key, Tree& right) { split_tree(key, right); }
 
     /// <summary> 
-    /// Saves the tree to graphviz-format file. 
-    /// This file may be converted to .pdf or .png using graphviz utility. 
-    /// Example of command line to convert file to .png: "%GRAPHVIZ%\release\bin\dot.exe -Kdot -Gratio=0.6 -Gsplines=true -Nfontsize=20 -Tpng [file_name] -O"
+    /// Moves all nodes of the right tree to this tree in O(log n): all keys of the right tree should be greater than keys of this tree. 
+    /// The nodes aren't copied, this tree shares memory blocks of the right tree. 
     /// </summary>
-    /// <param name="sFile"> in. The output file name. </param>
+    /// <param name="right"> inout. The tree with greater keys, on return - empty. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void join(Tree& right)
+    {
+        assert(&right != this && (!m_root || !right.m_root || compare(max_node(m_root)->m_key, min_node(right.m_root)->m_key) < 0));
+        m_alloc.share(right.m_alloc);
+        link(m_pMax, right.m_pMin);
+        join_trees(join_imp(m_root, right.m_root), m_size + right.m_size, right);
+    }
+
+    /// <summary> Moves the new node and all nodes of the right tree to this tree in O(log n): keys of this tree &lt; key &lt; keys of the right tree. </summary>
+    /// <param name="key"> in. The key of the new node. </param>
+    /// <param name="val"> in. The value of the new node. </param>
+    /// <param name="right"> inout. The tree with greater keys, on return - empty. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class K, class V> void join(K&& key, V&& val, Tree& right)
+    {
+        assert(&right != this);
+        Node* pNode = create_node(std::forward<K>(key), std::forward<V>(val));
+        assert((!m_root || compare(max_node(m_root)->m_key, pNode->m_key) < 0) && (!right.m_root || compare(pNode->m_key, min_node(right.m_root)->m_key) < 0));
+        m_alloc.share(right.m_alloc);
+        link(m_pMax, pNode);
+        link(pNode, right.m_pMin);
+        join_trees(join_imp(m_root, *pNode, right.m_root), m_size + 1 + right.m_size, right);
+    }
+
+    /// <summary> 
+    /// Moves all nodes of another tree to this tree, the values of the other tree replace the values of equal keys. 
+    /// Join-based algorithm: O(m log(n/m + 1)) work, independent subtrees are processed in parallel. 
+    /// </summary>
+    /// <param name="other"> inout. The tree to be merged, on return - empty. </param>
+    /// <param name="pool"> in. Optional. The thread pool. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void union_with(Tree& other, TreeThreadPool& pool = TreeThreadPool::instance()) { set_operation(other, eUnion, pool); }
+
+    /// <summary> Keeps only the nodes with keys which exist in another tree, see union_with. </summary>
+    /// <param name="other"> inout. The tree to be intersected with, on return - empty. </param>
+    /// <param name="pool"> in. Optional. The thread pool. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void intersect_with(Tree& other, TreeThreadPool& pool = TreeThreadPool::instance()) { set_operation(other, eIntersect, pool); }
+
+    /// <summary> Removes the nodes with keys which exist in another tree, see union_with. </summary>
+    /// <param name="other"> inout. The tree with keys to be removed, on return - empty. </param>
+    /// <param name="pool"> in. Optional. The thread pool. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void difference(Tree& other, TreeThreadPool& pool = TreeThreadPool::instance()) { set_operation(other, eDifference, pool); }
+
+    /// <summary> 
+    /// Relocates all nodes to one contiguous block (with TreeNodePool) in van Emde Boas order: the top half of levels is placed first, 
+    /// then each subtree below it, recursively. A search of any tree size touches O(log n / log B) cache lines of size B and few pages. 
+    /// The tree stays mutable, new nodes are allocated after the block. Iterators and pointers to values are invalidated. 
+    /// </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void compact_veb();
+
+    /// <summary> 
+    /// Makes the immutable snapshot of the tree in O(n) for read-mostly data: the keys in Eytzinger layout with branch-free search, 
+    /// see TreeFrozen (include tree_avl_frozen.h). The snapshot doesn't refer to the tree. 
+    /// </summary>
+    /// <returns> The snapshot. </returns>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class Frozen = TreeFrozen<Key, Val, Compare>> Frozen freeze() const { return Frozen(begin(), size(), m_cmp); }
+
+    /// <summary> Searches for node with specified key. </summary>
+    /// <returns> Pointer to node value, NULL if specified key isn't found in the tree. </returns>
+    /// <param name="key"> in. The key of node to be found. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Val* find(const Key& key);
+
+    /// <summary> Searches for node with specified key. </summary>
+    /// <returns> Pointer to node value, NULL if specified key isn't found in the tree. </returns>
+    /// <param name="key"> in. The key of node to be found. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    const Val* find(const Key& key) const;
+
+    /// <summary> Searches for node with the key equivalent to specified value. Available if the comparator is transparent. </summary>
+    /// <returns> Pointer to node value, NULL if the key isn't found in the tree. </returns>
+    /// <param name="key"> in. The value comparable with the keys. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class K, class C = Compare, class = typename C::is_transparent> Val* find(const K& key)
+    {
+        Node* pNode;
+        return find_imp(pNode, key) ? &pNode->m_value : NULL;
+    }
+
+    /// <summary> Searches for node with the key equivalent to specified value. Available if the comparator is transparent. </summary>
+    /// <returns> Pointer to node value, NULL if the key isn't found in the tree. </returns>
+    /// <param name="key"> in. The value comparable with the keys. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class K, class C = Compare, class = typename C::is_transparent> const Val* find(const K& key) const
+    {
+        Node* pNode;
+        return find_imp(pNode, key) ? &pNode->m_value : NULL;
+    }
+
+    /// <summary> 
+    /// Recalculates the augmented data on the path from the node to the root after its value was changed in place 
+    /// (through find(), operator[] or Iterator::value()). Required by TreeAugmentAggregate, does nothing for the augmentations which don't depend on values. 
+    /// </summary>
+    /// <returns> True if the key is found. </returns>
+    /// <param name="key"> in. The key of changed node. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    bool update(const Key& key);
+
+    /// <summary> 
+    /// Searches for many keys at once: the searches descend in lockstep by groups, each search prefetches its next node 
+    /// while the others compare, so the cache misses of independent searches overlap instead of being waited one by one. 
+    /// Pays off if the tree is larger than the cache. 
+    /// </summary>
+    /// <returns> The number of found keys. </returns>
+    /// <param name="aKey"> in. The keys to be found. </param>
+    /// <param name="nKey"> in. Number of keys. </param>
+    /// <param name="aValue"> out. Pointers to values of the keys, NULL if the key isn't found in the tree. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    size_t find_batch(const Key* aKey, size_t nKey, Val** aValue) { return find_batch_imp(aKey, nKey, aValue); }
+    template<class K, class C = Compare, class = typename C::is_transparent> size_t find_batch(const K* aKey, size_t nKey, Val** aValue) { return find_batch_imp(aKey, nKey, aValue); }
+
+    /// <summary> Counts nodes with specified key. </summary>
+    /// <returns> 1 if the key is found in the tree, otherwise 0. </returns>
+    /// <param name="key"> in. The key of node to be found. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    size_t count(const Key& key) const
+    {
+        Node* pNode;
+        return find_imp(pNode, key) ? 1 : 0;
+    }
+
+    /// <summary> Counts nodes with the key equivalent to specified value. Available if the comparator is transparent. </summary>
+    /// <returns> 1 if the key is found in the tree, otherwise 0. </returns>
+    /// <param name="key"> in. The value comparable with the keys. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class K, class C = Compare, class = typename C::is_transparent> size_t count(const K& key) const
+    {
+        Node* pNode;
+        return find_imp(pNode, key) ? 1 : 0;
+    }
+    
+    /// <summary> Removes node with specified key from the tree. </summary>
+    /// <param name="key"> in. The key of node to be removed. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void erase(const Key& key)
+    {
+        Node* pNode;
+        if(find_imp(pNode, key))
+            erase_node(pNode);
+    }
+
+    /// <summary> Removes node with the key equivalent to specified value. Available if the comparator is transparent. </summary>
+    /// <param name="key"> in. The value comparable with the keys. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class K, class C = Compare, class = typename C::is_transparent> void erase(const K& key)
+    {
+        Node* pNode;
+        if(find_imp(pNode, key))
+            erase_node(pNode);
+    }
+
+    /// <summary> 
+    /// Removes nodes with keys in range [lo, hi) in O(log n + k): the tree is split by the bounds, 
+    /// the middle part is destroyed as a whole and the rest parts are joined, so the balance is restored without retracing for each node. 
+    /// </summary>
+    /// <returns> The number of removed nodes. </returns>
+    /// <param name="lo"> in. The lower bound of range (inclusive). </param>
+    /// <param name="hi"> in. The upper bound of range (exclusive). </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    size_t erase_range(const Key& lo, const Key& hi) { return erase_range_imp(&lo, &hi); }
+    template<class K, class C = Compare, class = typename C::is_transparent> size_t erase_range(const K& lo, const K& hi) { return erase_range_imp(&lo, &hi); }
+
+    /// <summary> Removes nodes in range of iterators [first, last), see erase_range. </summary>
+    /// <returns> The iterator last. </returns>
+    /// <param name="first"> in. The first node to be removed. </param>
+    /// <param name="last"> in. The node after the last node to be removed, may be the end iterator. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Iterator erase(Iterator first, Iterator last)
+    {
+        if(first != last)
+            erase_range_imp(&first.key(), last.isEnd() ? NULL : &last.key());
+        return last;
+    }
+
+    /// <summary> Searches for k-th smallest node. Requires TreeAugmentCount. </summary>
+    /// <returns> The iterator to the node, the end iterator if k isn't less than size of the tree. </returns>
+    /// <param name="k"> in. The zero-based index of node in order of keys. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Iterator select(size_t k) { return Iterator(select_imp(k)); }
+    ConstIterator select(size_t k) const { return Iterator(select_imp(k)); }
+
+    /// <summary> Counts nodes with keys less than specified key. Requires TreeAugmentCount. </summary>
+    /// <returns> The number of nodes, equal to the index of the key if it is in the tree. </returns>
+    /// <param name="key"> in. The key. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    size_t rank(const Key& key) const { return rank_imp(key); }
+
+    /// <summary> Counts nodes with keys less than specified value. Requires TreeAugmentCount. Available if the comparator is transparent. </summary>
+    /// <returns> The number of nodes. </returns>
+    /// <param name="key"> in. The value comparable with the keys. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class K, class C = Compare, class = typename C::is_transparent> size_t rank(const K& key) const { return rank_imp(key); }
+
+    /// <summary> Counts nodes with keys in range [lo, hi). Requires TreeAugmentCount. </summary>
+    /// <returns> The number of nodes in range. </returns>
+    /// <param name="lo"> in. The lower bound of range (inclusive). </param>
+    /// <param name="hi"> in. The upper bound of range (exclusive). </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    size_t count_range(const Key& lo, const Key& hi) const
+    {
+        const size_t nLow = rank_imp(lo), nHigh = rank_imp(hi);
+        return nHigh > nLow ? nHigh - nLow : 0;
+    }
+
+    /// <summary> Counts nodes with keys in range [lo, hi). Requires TreeAugmentCount. Available if the comparator is transparent. </summary>
+    /// <returns> The number of nodes in range. </returns>
+    /// <param name="lo"> in. The lower bound of range (inclusive). </param>
+    /// <param name="hi"> in. The upper bound of range (exclusive). </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class K, class C = Compare, class = typename C::is_transparent> size_t count_range(const K& lo, const K& hi) const
+    {
+        const size_t nLow = rank_imp(lo), nHigh = rank_imp(hi);
+        return nHigh > nLow ? nHigh - nLow : 0;
+    }
+
+    /// <summary> Aggregates values of nodes with keys in range [lo, hi) in O(log n) from aggregates of subtrees. Requires TreeAugmentAggregate. </summary>
+    /// <returns> The aggregate, Monoid::identity() if the range is empty. </returns>
+    /// <param name="lo"> in. The lower bound of range (inclusive). </param>
+    /// <param name="hi"> in. The upper bound of range (exclusive). </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class A = Augment> typename A::value_type query_range(const Key& lo, const Key& hi) const { return query_imp<Key, A>(m_root, lo, hi, true, true); }
+    template<class K, class A = Augment, class C = Compare, class = typename C::is_transparent> typename A::value_type query_range(const K& lo, const K& hi) const { return query_imp<K, A>(m_root, lo, hi, true, true); }
+
+    /// <summary> Searches for the first node which key is not less than specified key. </summary>
+    /// <returns> The iterator to the node, the end iterator if all keys are less. </returns>
+    /// <param name="key"> in. The key. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Iterator lower_bound(const Key& key) { return Iterator(bound_imp(key, false)); }
+    ConstIterator lower_bound(const Key& key) const { return Iterator(bound_imp(key, false)); }
+    template<class K, class C = Compare, class = typename C::is_transparent> Iterator lower_bound(const K& key) { return Iterator(bound_imp(key, false)); }
+    template<class K, class C = Compare, class = typename C::is_transparent> ConstIterator lower_bound(const K& key) const { return Iterator(bound_imp(key, false)); }
+
+    /// <summary> Searches for the first node which key is greater than specified key. </summary>
+    /// <returns> The iterator to the node, the end iterator if no key is greater. </returns>
+    /// <param name="key"> in. The key. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Iterator upper_bound(const Key& key) { return Iterator(bound_imp(key, true)); }
+    ConstIterator upper_bound(const Key& key) const { return Iterator(bound_imp(key, true)); }
+    template<class K, class C = Compare, class = typename C::is_transparent> Iterator upper_bound(const K& key) { return Iterator(bound_imp(key, true)); }
+    template<class K, class C = Compare, class = typename C::is_transparent> ConstIterator upper_bound(const K& key) const { return Iterator(bound_imp(key, true)); }
+
+    /// <summary> Searches for the range of nodes with specified key. </summary>
+    /// <returns> The pair of lower_bound and upper_bound, the range is empty if the key isn't found. </returns>
+    /// <param name="key"> in. The key. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    std::pair<Iterator, Iterator> equal_range(const Key& key) { return equal_range_imp(key); }
+    std::pair<ConstIterator, ConstIterator> equal_range(const Key& key) const { return equal_range_imp(key); }
+    template<class K, class C = Compare, class = typename C::is_transparent> std::pair<Iterator, Iterator> equal_range(const K& key) { return equal_range_imp(key); }
+    template<class K, class C = Compare, class = typename C::is_transparent> std::pair<ConstIterator, ConstIterator> equal_range(const K& key) const { return equal_range_imp(key); }
+
+    /// <summary> Searches for the node with the greatest key which is not greater than specified key. </summary>
+    /// <returns> The iterator to the node, the end iterator if all keys are greater. </returns>
+    /// <param name="key"> in. The key. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Iterator floor(const Key& key) { return Iterator(floor_imp(key)); }
+    ConstIterator floor(const Key& key) const { return Iterator(floor_imp(key)); }
+    template<class K, class C = Compare, class = typename C::is_transparent> Iterator floor(const K& key) { return Iterator(floor_imp(key)); }
+    template<class K, class C = Compare, class = typename C::is_transparent> ConstIterator floor(const K& key) const { return Iterator(floor_imp(key)); }
+
+    /// <summary> Searches for the node with the least key which is not less than specified key, the same as lower_bound. </summary>
+    /// <returns> The iterator to the node, the end iterator if all keys are less. </returns>
+    /// <param name="key"> in. The key. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Iterator ceiling(const Key& key) { return Iterator(bound_imp(key, false)); }
+    ConstIterator ceiling(const Key& key) const { return Iterator(bound_imp(key, false)); }
+    template<class K, class C = Compare, class = typename C::is_transparent> Iterator ceiling(const K& key) { return Iterator(bound_imp(key, false)); }
+    template<class K, class C = Compare, class = typename C::is_transparent> ConstIterator ceiling(const K& key) const { return Iterator(bound_imp(key, false)); }
+
+    /// <summary> 
+    /// Calls the function for each node with key in range [lo, hi) in order of keys. 
+    /// Subtrees outside of the range are skipped, the bounds aren't compared inside of subtrees which are entirely in the range. 
+    /// </summary>
+    /// <param name="lo"> in. The lower bound of range (inclusive). </param>
+    /// <param name="hi"> in. The upper bound of range (exclusive). </param>
+    /// <param name="fn"> in. The function called as fn(const Key& key, Val& value). </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class Fn> void for_each_in_range(const Key& lo, const Key& hi, Fn fn) { for_each_imp(m_root, lo, hi, fn, true, true); }
+    template<class K, class Fn, class C = Compare, class = typename C::is_transparent> void for_each_in_range(const K& lo, const K& hi, Fn fn) { for_each_imp(m_root, lo, hi, fn, true, true); }
+
+    /// <summary> 
+    /// Calls the function for each node by the threads of the pool: the top levels of the tree are forked into the left and the right subtrees 
+    /// (about 4 tasks per thread), the small subtrees are processed sequentially. The function is called concurrently and not in order of keys. 
+    /// </summary>
+    /// <param name="fn"> in. The function called as fn(const Key& key, Val& value), should be safe to call from several threads. </param>
+    /// <param name="pool"> in. Optional. The thread pool. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class Fn> void parallel_for_each(Fn fn, TreeThreadPool& pool = TreeThreadPool::instance()) { parallel_for_each_imp(m_root, fn, parallel_depth(pool), pool); }
+
+    /// <summary> 
+    /// Reduces the nodes by the threads of the pool, see parallel_for_each: the result of a subtree is combine(left, map(node), right), 
+    /// so for associative combine the result is combine(...combine(combine(init, map(k1, v1)), map(k2, v2))..., map(kn, vn)) in order of keys. 
+    /// </summary>
+    /// <returns> The result, init if the tree is empty. </returns>
+    /// <param name="init"> in. The initial value, combined with the result of the nodes from the left. </param>
+    /// <param name="map"> in. The function called as map(const Key& key, const Val& value), returns T, should be safe to call from several threads. </param>
+    /// <param name="combine"> in. The associative function called as combine(const T& a, const T& b), returns T. </param>
+    /// <param name="pool"> in. Optional. The thread pool. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class T, class Map, class Combine> T parallel_reduce(T init, Map map, Combine combine, TreeThreadPool& pool = TreeThreadPool::instance()) const
+    {
+        return m_root ? combine(init, parallel_reduce_imp<T>(m_root, map, combine, parallel_depth(pool), pool)) : init;
+    }
+
+    /// <summary> Inserts new node into the tree. If the key exists in the tree - replaces its value. </summary>
+    /// <returns> The iterator to the node and the flag which is true if new node was inserted. </returns>
+    /// <param name="key"> in. The node key. </param>
+    /// <param name="val"> in. The node value. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    std::pair<Iterator, bool> insert(const Key& key, const Val& val) { return insert_or_assign(key, val); }
+
+    /// <summary> Inserts new node into the tree moving the key and the value to the node. If the key exists in the tree - replaces its value. </summary>
+    /// <returns> The iterator to the node and the flag which is true if new node was inserted. </returns>
+    /// <param name="key"> in. The node key. </param>
+    /// <param name="val"> in. The node value. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    std::pair<Iterator, bool> insert(Key&& key, Val&& val) { return insert_or_assign(std::move(key), std::move(val)); }
+
+    /// <summary> Inserts new node into the tree. </summary>
+    /// <returns> The iterator to the node and the flag which is true if new node was inserted. </returns>
+    /// <param name="pair"> in. The node key and value. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    std::pair<Iterator, bool> insert(const std::pair<Key, Val>& pair) { return insert_or_assign(pair.first, pair.second); }
+
+    /// <summary> Inserts new node into the tree moving the key and the value to the node. </summary>
+    /// <returns> The iterator to the node and the flag which is true if new node was inserted. </returns>
+    /// <param name="pair"> in. The node key and value. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    std::pair<Iterator, bool> insert(std::pair<Key, Val>&& pair) { return insert_or_assign(std::move(pair.first), std::move(pair.second)); }
+
+    /// <summary> 
+    /// Inserts new node next to the hint node. If the key exists in the tree - replaces its value. 
+    /// The position between the hint and its neighbour is taken in O(1), otherwise the search climbs from the hint to the subtree 
+    /// which contains the key and descends, O(log d) for the key d positions away. The end iterator means the last inserted node. 
+    /// Inserts without the hint also start from the last inserted node, so sorted and nearly sorted streams don't need the hint. 
+    /// </summary>
+    /// <returns> The iterator to the node and the flag which is true if new node was inserted. </returns>
+    /// <param name="hint"> in. The node near the position of the key. </param>
+    /// <param name="key"> in. The node key. </param>
+    /// <param name="val"> in. The node value. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    std::pair<Iterator, bool> insert(Iterator hint, const Key& key, const Val& val) { return insert_hint_imp(hint.m_node, key, val); }
+    std::pair<Iterator, bool> insert(Iterator hint, Key&& key, Val&& val) { return insert_hint_imp(hint.m_node, std::move(key), std::move(val)); }
+
+    /// <summary> Inserts new node or replaces value of existing node. </summary>
+    /// <returns> The iterator to the node and the flag which is true if new node was inserted. </returns>
+    /// <param name="key"> in. The node key, it's moved to the new node if it's rvalue. </param>
+    /// <param name="val"> in. The node value, it's moved to the node if it's rvalue. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class V> std::pair<Iterator, bool> insert_or_assign(const Key& key, V&& val) { return insert_or_assign_imp(key, std::forward<V>(val)); }
+    template<class V> std::pair<Iterator, bool> insert_or_assign(Key&& key, V&& val) { return insert_or_assign_imp(std::move(key), std::forward<V>(val)); }
+
+    /// <summary> Inserts new node if the key isn't exists in the tree, the value is constructed in place from the arguments. </summary>
+    /// <returns> The iterator to the node and the flag which is true if new node was inserted. </returns>
+    /// <param name="key"> in. The node key, it's moved to the new node if it's rvalue. </param>
+    /// <param name="args"> in. The arguments of the value constructor, they are not used if the key exists. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class... Args> std::pair<Iterator, bool> try_emplace(const Key& key, Args&&... args) { return try_emplace_imp(key, std::forward<Args>(args)...); }
+    template<class... Args> std::pair<Iterator, bool> try_emplace(Key&& key, Args&&... args) { return try_emplace_imp(std::move(key), std::forward<Args>(args)...); }
+
+    /// <summary> 
+    /// Constructs new node in place: the key is constructed from the first argument, the value - from the rest ones. 
+    /// The node is destroyed if the key exists in the tree. 
+    /// </summary>
+    /// <returns> The iterator to the node and the flag which is true if new node was inserted. </returns>
+    /// <param name="key"> in. The argument of the key constructor. </param>
+    /// <param name="args"> in. The arguments of the value constructor. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class K, class... Args> std::pair<Iterator, bool> emplace(K&& key, Args&&... args);
+    
+    /// <summary> Accesses the node value by its key. Important: if node with specified key isn't exists in tree - node with default value will be inserted. </summary>
+    /// <returns> The reference to node value. </returns>
+    /// <param name="key"> in. The key of node to be found. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Val& operator[](const Key& key) { return try_emplace_imp(key).first.value(); }
+
+    /// <summary> Accesses the node value by its key, the key is moved to the new node. </summary>
+    /// <returns> The reference to node value. </returns>
+    /// <param name="key"> in. The key of node to be found. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Val& operator[](Key&& key) { return try_emplace_imp(std::move(key)).first.value(); }
+    
+    /// <summary> Queries the tree iterator. </summary>
+    /// <returns> The iteraror. </returns>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Iterator begin() { return Iterator(m_pMin); }
+    ConstIterator begin() const { return Iterator(m_pMin); }
+
+    /// <summary> Queries the iterator to the last node for iteration in reverse order by Iterator::prev. </summary>
+    /// <returns> The iteraror, the end iterator if the tree is empty. </returns>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Iterator rbegin() { return Iterator(m_pMax); }
+    ConstIterator rbegin() const { return Iterator(m_pMax); }
+
+    /// <summary> Queries the end iterator. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Iterator end() { return Iterator(NULL); }
+    ConstIterator end() const { return Iterator(NULL); }
+
+    /// <summary> Queries the node with the least key in O(1), the leftmost and the rightmost nodes are kept by all operations. </summary>
+    /// <returns> The iterator to the node, the end iterator if the tree is empty. </returns>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Iterator min() { return Iterator(m_pMin); }
+    ConstIterator min() const { return Iterator(m_pMin); }
+
+    /// <summary> Queries the node with the greatest key in O(1). </summary>
+    /// <returns> The iterator to the node, the end iterator if the tree is empty. </returns>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Iterator max() { return Iterator(m_pMax); }
+    ConstIterator max() const { return Iterator(m_pMax); }
+
+    /// <summary> Removes the node with the least key, the search isn't needed, so only retracing remains. </summary>
+    /// <returns> True if the node was removed, false if the tree is empty. </returns>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    bool pop_min()
+    {
+        if(!m_pMin)
+            return false;
+        erase_node(m_pMin);
+        return true;
+    }
+
+    /// <summary> Removes the node with the greatest key. </summary>
+    /// <returns> True if the node was removed, false if the tree is empty. </returns>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    bool pop_max()
+    {
+        if(!m_pMax)
+            return false;
+        erase_node(m_pMax);
+        return true;
+    }
+
+    /// <summary> 
+    /// Saves the tree to graphviz-format file. 
+    /// This file may be converted to .pdf or .png using graphviz utility. 
+    /// Example of command line to convert file to .png: "%GRAPHVIZ%\release\bin\dot.exe -Kdot -Gratio=0.6 -Gsplines=true -Nfontsize=20 -Tpng [file_name] -O"
+    /// </summary>
+    /// <param name="sFile"> in. The output file name. </param>
     /// <remarks> Author: Vladimir Zelyonkin </remarks>
     void saveToGv(const char* sFile);
 
-private:
-    bool find_imp(Node*& pNode, const Key& key) const;
-    Node& node_imp(const Key& key);
-    void update_balance(Node& node);
-    void setChild(Node& parent, Node& child, typename Node::EBranch b) const;
-    void moveChild(Node& from, typename Node::EBranch bf, Node& to, typename Node::EBranch bt) const;
-    void moveNode(Node& parent, typename Node::EBranch bf, Node& toNode);
-    Node* rotate_left(Node& node);
-    Node* rotate_right(Node& node);  
+    /// <summary> Checks structure of the tree: order of keys, links to parents, heights and balance of nodes, the leftmost and the rightmost nodes, the threads. </summary>
+    /// <returns> True if the tree is valid AVL tree. </returns>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    bool isValid() const 
+    { 
+        return check_imp(m_root, NULL, NULL, NULL) >= 0 && m_pMin == (m_root ? min_node(m_root) : NULL) && m_pMax == (m_root ? max_node(m_root) : NULL) 
+            && check_threads(t_threaded()); 
+    }
+
+    /// <summary> Queries statistics of tree balancing. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    const TreeStats& stats() const { return m_stats; }
+
+    /// <summary> Resets statistics of tree balancing. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void reset_stats() { m_stats = TreeStats(); }
+
+private:
+    // three-way comparison of keys (or of key and value comparable with keys) by the comparator of any style
+    template<class A, class B> int compare(const A& a, const B& b) const { return tree_compare(m_cmp, a, b); }
+
+    template<class... Args> Node* create_node(Args&&... args);
+    void destroy_node(Node* pNode);
+    void destroy_nodes(Node* pNode, std::true_type bSkip);
+    void destroy_nodes(Node* pNode, std::false_type bSkip);
+    template<class It> Node* build_sorted(It& it, size_t nNode, Node*& pPrev);
+    Node* link_sorted(Node* const* aNode, size_t nNode);
+    template<class K> bool find_imp(Node*& pNode, const K& key) const;
+    template<class K> bool find_from(Node*& pNode, const K& key) const;
+    template<class K> bool descend(Node*& pNode, const K& key) const;
+    template<class K> size_t find_batch_imp(const K* aKey, size_t nKey, Val** aValue) const;
+    template<class K> bool find_finger(Node*& pNode, const K& key, Node*& pPrev, Node*& pNext, bool bClimb);
+    void set_finger(Node* pNode, Node* pPrev, Node* pNext) { m_pFinger = pNode; m_pFingerPrev = pPrev; m_pFingerNext = pNext; }
+    static Node* neighbour(Node* pNode, typename Node::EBranch b) { return neighbour(pNode, b, t_threaded()); }
+    static Node* neighbour(Node* pNode, typename Node::EBranch b, std::true_type) { return thread(pNode, b); }
+    static Node* neighbour(Node* pNode, typename Node::EBranch b, std::false_type);
+    // the links of nodes in order of keys if the nodes are augmented by TreeAugmentThread, otherwise the links are not stored
+    typedef std::integral_constant<bool, TreeIsThreaded<Augment>::value> t_threaded;
+    static Node* thread(const Node* pNode, typename Node::EBranch b) { return static_cast<Node*>(pNode->m_thread[b]); }
+    static void link(Node* pPrev, Node* pNext) { link(pPrev, pNext, t_threaded()); }
+    static void link(Node* pPrev, Node* pNext, std::true_type);
+    static void link(Node*, Node*, std::false_type) {}
+    static void link_leaf(Node& parent, Node& child, typename Node::EBranch b, std::true_type);
+    static void link_leaf(Node&, Node&, typename Node::EBranch, std::false_type) {}
+    static void unlink(Node* pNode, std::true_type) { link(thread(pNode, Node::eLeft), thread(pNode, Node::eRight)); }
+    static void unlink(Node*, std::false_type) {}
+    static void link_subtrees(Node* pLeft, Node* pRight, std::true_type) { link(pLeft ? max_node(pLeft) : NULL, pRight ? min_node(pRight) : NULL); }
+    static void link_subtrees(Node*, Node*, std::false_type) {}
+    void rethread(std::true_type);
+    void rethread(std::false_type) {}
+    static void thread_subtree(Node* pNode, Node*& pPrev);
+    bool check_threads(std::true_type) const;
+    bool check_threads(std::false_type) const { return true; }
+    void erase_node(Node* pNode);
+    template<class K> void split_tree(const K& key, Tree& right);
+    enum ESetOperation { eUnion, eIntersect, eDifference };
+    void set_operation(Tree& other, ESetOperation op, TreeThreadPool& pool);
+    void set_operation_imp(Node*& pNode1, Node*& pNode2, ESetOperation op, int nDepth, TreeThreadPool& pool, Node*& pDiscard);
+    static void discard(Node* pNode, Node*& pDiscard);
+    size_t destroy_discarded(Node* pDiscard);
+    static size_t count_nodes(const Node* pNode) { return pNode ? 1 + count_nodes(pNode->m_child[Node::eLeft]) + count_nodes(pNode->m_child[Node::eRight]) : 0; }
+    static void collect_veb(Node* pNode, int nLevel, std::vector<Node*>& aNode);
+    static void collect_level(Node* pNode, int nLevel, std::vector<Node*>& aNode);
+    void join_trees(Node* pRoot, size_t nSize, Tree& right);
+    void update_bounds() { m_pMin = m_root ? min_node(m_root) : NULL; m_pMax = m_root ? max_node(m_root) : NULL; }
+    void set_root(Node* pRoot, size_t nSize);
+    size_t count_left(const Node* pLeft, const Node*, std::true_type) const { return TreeAugmentCount::count(pLeft); }
+    size_t count_left(const Node* pLeft, const Node* pRight, std::false_type bCounted) const;
+    static bool count_step(std::vector<const Node*>& aStack, size_t& nNode);
+    static Node* min_node(Node* pNode) { while(pNode->left()) pNode = pNode->left(); return pNode; }
+    static Node* max_node(Node* pNode) { while(pNode->right()) pNode = pNode->right(); return pNode; }
+    template<class K> size_t erase_range_imp(const K* pLow, const K* pHigh);
+    size_t destroy_subtree(Node* pNode);
+    template<class K> Node* split_imp(Node* pNode, const K& key, Node*& pLeft, Node*& pRight);
+    Node* split_path(Node* pNode, const signed char* pCmp, Node*& pLeft, Node*& pRight);
+    Node* join_imp(Node* pLeft, Node& mid, Node* pRight);
+    Node* join_imp(Node* pLeft, Node* pRight);
+    Node* rebalance_path(Node* pNode);
+    static int height(const Node* pNode) { return pNode ? pNode->m_height : 0; }
+    Node* select_imp(size_t k) const;
+    template<class K> size_t rank_imp(const K& key) const;
+    template<class K, class A> typename A::value_type query_imp(const Node* pNode, const K& lo, const K& hi, bool bCheckLow, bool bCheckHigh) const;
+    template<class K> Node* bound_imp(const K& key, bool bUpper) const;
+    template<class K> Node* floor_imp(const K& key) const;
+    template<class K> std::pair<Iterator, Iterator> equal_range_imp(const K& key) const;
+    template<class K, class Fn> void for_each_imp(Node* pNode, const K& lo, const K& hi, Fn& fn, bool bCheckLow, bool bCheckHigh);
+    static int parallel_depth(const TreeThreadPool& pool);
+    template<class Fn> static void for_each_node(Node* pNode, Fn& fn);
+    template<class Fn> static void parallel_for_each_imp(Node* pNode, Fn& fn, int nDepth, TreeThreadPool& pool);
+    template<class T, class Map, class Combine> static T parallel_reduce_imp(const Node* pNode, Map& map, Combine& combine, int nDepth, TreeThreadPool& pool);
+    void update_path(Node* pNode, std::true_type bPropagate);
+    void update_path(Node* pNode, std::false_type bPropagate);
+    template<class K, class... Args> std::pair<Iterator, bool> try_emplace_imp(K&& key, Args&&... args);
+    template<class K, class V> std::pair<Iterator, bool> insert_or_assign_imp(K&& key, V&& val, bool bClimb = false);
+    template<class K, class V> std::pair<Iterator, bool> insert_hint_imp(Node* pHint, K&& key, V&& val);
+    void insert_imp(Node* pParent, Node& child);
+    int check_imp(const Node* pNode, const Node* pParent, const Node* pLow, const Node* pHigh) const;
+    void retrace_insert(Node& node);
+    void retrace_erase(Node& node);
+    Node* rebalance(Node& node);
+    void setChild(Node& parent, Node& child, typename Node::EBranch b) const;
+    void moveChild(Node& from, typename Node::EBranch bf, Node& to, typename Node::EBranch bt) const;
+    void moveNode(Node& parent, typename Node::EBranch bf, Node& toNode);
+    Node* rotate_left(Node& node);
+    Node* rotate_right(Node& node);  
+
+    // copying and assignment are forbidden
+    Tree(const Tree<Key, Val, Compare, Alloc, Augment>&);
+    Tree<Key, Val, Compare, Alloc, Augment>& operator=(const Tree<Key, Val, Compare, Alloc, Augment>&) { return *this; }
+private:
+    const Compare m_cmp;
+    Alloc<Node> m_alloc;
+protected:
+    // derived trees extend the queries over augmented nodes
+    Node* m_root;
+private:
+    // number of nodes
+    size_t m_size;
+    TreeStats m_stats;
+    // the last inserted node and its neighbours in order of keys (NULL - no neighbour), reset by the operations which may remove them
+    Node* m_pFinger;
+    Node* m_pFingerPrev;
+    Node* m_pFingerNext;
+    // the leftmost and the rightmost nodes
+    Node* m_pMin;
+    Node* m_pMax;
+};
+
+
+/// <summary> Moves iterator to next node in the tree. </summary>
+/// <returns> True if the curent node isn't end </returns>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> bool Tree<Key, Val, Compare, Alloc, Augment>::Iterator::next(std::false_type)
+{
+    if(!m_node)
+        return false;
+
+    // minimal element in right branch
+    if(m_node->right())
+    {
+        m_node = m_node->right();
+        while(m_node->left())
+            m_node = m_node->left();
+        return m_node != NULL;
+    }
+
+    // parent node
+    Node* pParent = m_node->parent();
+    while(pParent && pParent->right() == m_node)
+    {
+        m_node = pParent;
+        pParent = m_node->parent();
+    }
+    m_node = pParent;
+    return m_node != NULL;
+}
+
+/// <summary> Searches for node with specified key. </summary>
+/// <returns> Pointer to node value, NULL if specified key isn't found in the tree. </returns>
+/// <param name="key"> in. The key of node to be found. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> const Val* Tree<Key, Val, Compare, Alloc, Augment>::find(const Key& key) const
+{
+    Node* pNode;
+    return find_imp(pNode, key) ? &pNode->m_value : NULL;
+}
+
+
+/// <summary> Searches for node with specified key. </summary>
+/// <returns> Pointer to node value, NULL if specified key isn't found in the tree. </returns>
+/// <param name="key"> in. The key of node to be found. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> Val* Tree<Key, Val, Compare, Alloc, Augment>::find(const Key& key)
+{
+    Node* pNode;
+    return find_imp(pNode, key) ? &pNode->m_value : NULL;
+}
+
+/// <summary> Recalculates the augmented data on the path from the node to the root after its value was changed in place. </summary>
+/// <returns> True if the key is found. </returns>
+/// <param name="key"> in. The key of changed node. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> bool Tree<Key, Val, Compare, Alloc, Augment>::update(const Key& key)
+{
+    Node* pNode;
+    if(!find_imp(pNode, key))
+        return false;
+    update_path(pNode, std::integral_constant<bool, Augment::propagate_value>());
+    return true;
+}
+
+/// <summary> Constructs new node in place, destroys it if the key exists in the tree. </summary>
+/// <returns> The iterator to the node and the flag which is true if new node was inserted. </returns>
+/// <param name="key"> in. The argument of the key constructor. </param>
+/// <param name="args"> in. The arguments of the value constructor. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class K, class... Args> std::pair<typename Tree<Key, Val, Compare, Alloc, Augment>::Iterator, bool> Tree<Key, Val, Compare, Alloc, Augment>::emplace(K&& key, Args&&... args)
+{
+    // the key is known only after construction of node
+    Node* pChild = create_node(std::forward<K>(key), std::forward<Args>(args)...);
+    Node* pNode;
+    Node* pPrev;
+    Node* pNext;
+    if(find_finger(pNode, pChild->m_key, pPrev, pNext, false))
+    {
+        destroy_node(pChild);
+        return std::make_pair(Iterator(pNode), false);
+    }
+    insert_imp(pNode, *pChild);
+    set_finger(pChild, pPrev, pNext);
+    return std::make_pair(Iterator(pChild), true);
+}
+
+/// <summary> Inserts new node if the key isn't exists in the tree. </summary>
+/// <returns> The iterator to the node and the flag which is true if new node was inserted. </returns>
+/// <param name="key"> in. The node key. </param>
+/// <param name="args"> in. The arguments of the value constructor. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class K, class... Args> std::pair<typename Tree<Key, Val, Compare, Alloc, Augment>::Iterator, bool> Tree<Key, Val, Compare, Alloc, Augment>::try_emplace_imp(K&& key, Args&&... args)
+{
+    // search for existing node
+    Node* pNode;
+    Node* pPrev;
+    Node* pNext;
+    if(find_finger(pNode, key, pPrev, pNext, false))
+        return std::make_pair(Iterator(pNode), false);
+
+    Node* pChild = create_node(std::forward<K>(key), std::forward<Args>(args)...);
+    insert_imp(pNode, *pChild);
+    set_finger(pChild, pPrev, pNext);
+    return std::make_pair(Iterator(pChild), true);
+}
+
+/// <summary> Inserts new node or replaces value of existing node. </summary>
+/// <returns> The iterator to the node and the flag which is true if new node was inserted. </returns>
+/// <param name="key"> in. The node key. </param>
+/// <param name="val"> in. The node value. </param>
+/// <param name="bClimb"> in. Optional. True - search from the finger if the key isn't next to it, false - from the root. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class K, class V> std::pair<typename Tree<Key, Val, Compare, Alloc, Augment>::Iterator, bool> Tree<Key, Val, Compare, Alloc, Augment>::insert_or_assign_imp(K&& key, V&& val, bool bClimb)
+{
+    // search for existing node
+    Node* pNode;
+    Node* pPrev;
+    Node* pNext;
+    if(find_finger(pNode, key, pPrev, pNext, bClimb))
+    {
+        pNode->m_value = std::forward<V>(val);
+        update_path(pNode, std::integral_constant<bool, Augment::propagate_value>());
+        return std::make_pair(Iterator(pNode), false);
+    }
+
+    Node* pChild = create_node(std::forward<K>(key), std::forward<V>(val));
+    insert_imp(pNode, *pChild);
+    set_finger(pChild, pPrev, pNext);
+    return std::make_pair(Iterator(pChild), true);
+}
+
+/// <summary> Inserts new node next to the hint node or replaces value of existing node. </summary>
+/// <returns> The iterator to the node and the flag which is true if new node was inserted. </returns>
+/// <param name="pHint"> in. The node near the position of the key, NULL - the finger. </param>
+/// <param name="key"> in. The node key. </param>
+/// <param name="val"> in. The node value. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class K, class V> std::pair<typename Tree<Key, Val, Compare, Alloc, Augment>::Iterator, bool> Tree<Key, Val, Compare, Alloc, Augment>::insert_hint_imp(Node* pHint, K&& key, V&& val)
+{
+    // the hint becomes the finger, its neighbours are found by links
+    if(pHint && pHint != m_pFinger)
+        set_finger(pHint, neighbour(pHint, Node::eLeft), neighbour(pHint, Node::eRight));
+    return insert_or_assign_imp(std::forward<K>(key), std::forward<V>(val), true);
+}
+
+/// <summary> Removes all nodes from the tree. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::clear()
+{
+    // the pool releases memory in bulk, so walk the tree only if nodes should be destroyed one by one
+    destroy_nodes(m_root, std::integral_constant<bool, Alloc<Node>::bulk_release && std::is_trivially_destructible<Node>::value>());
+    m_alloc.release();
+    m_root = NULL;
+    m_size = 0;
+    m_pFinger = NULL;
+    m_pMin = m_pMax = NULL;
+}
+
+/// <summary> Replaces content of the tree by the sorted range. </summary>
+/// <param name="first"> in. The beginning of range of pairs of key and value (forward iterator), sorted by keys without duplicates. </param>
+/// <param name="last"> in. The end of range. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class It> void Tree<Key, Val, Compare, Alloc, Augment>::assign_sorted(It first, It last)
+{
+    clear();
+    const size_t nNode = std::distance(first, last);
+    m_alloc.reserve(nNode);
+    Node* pPrev = NULL;
+    m_root = build_sorted(first, nNode, pPrev);
+    m_size = nNode;
+    update_bounds();
+}
+
+/// <summary> Inserts the batch of pairs of key and value (in any order). </summary>
+/// <param name="first"> in. The beginning of range of pairs of key and value. </param>
+/// <param name="last"> in. The end of range. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class It> void Tree<Key, Val, Compare, Alloc, Augment>::insert_batch(It first, It last)
+{
+    // the tree is rebuilt if the batch is larger than 1/c_nRebuild of the tree
+    const size_t c_nRebuild = 8;
+
+    // sort the batch, the last of duplicated keys wins
+    std::vector<std::pair<Key, Val>> aPair(first, last);
+    tree_parallel_sort(aPair.begin(), aPair.end(), [this](const std::pair<Key, Val>& a, const std::pair<Key, Val>& b) { return compare(a.first, b.first) < 0; });
+    size_t nPair = 0;
+    for(size_t i = 0; i < aPair.size(); ++i)
+    {
+        if(nPair && compare(aPair[nPair - 1].first, aPair[i].first) == 0)
+            aPair[nPair - 1].second = std::move(aPair[i].second);
+        else if(nPair++ != i)
+            aPair[nPair - 1] = std::move(aPair[i]);
+    }
+    aPair.resize(nPair);
+
+    if(nPair * c_nRebuild < size())
+    {
+        // merge in single pass: the search for each key starts from the previous inserted node
+        Node* pFinger = NULL;
+        for(size_t i = 0; i < nPair; ++i)
+        {
+            Node* pNode = pFinger;
+            if(pFinger ? find_from(pNode, aPair[i].first) : find_imp(pNode, aPair[i].first))
+            {
+                pFinger = pNode;
+                pFinger->m_value = std::move(aPair[i].second);
+                update_path(pFinger, std::integral_constant<bool, Augment::propagate_value>());
+            }
+            else
+            {
+                pFinger = create_node(std::move(aPair[i].first), std::move(aPair[i].second));
+                insert_imp(pNode, *pFinger);
+            }
+        }
+        return;
+    }
+
+    // merge nodes of the tree with the batch and rebuild the tree
+    std::vector<Node*> aNode;
+    aNode.reserve(size() + nPair);
+    Iterator it = begin();
+    for(size_t i = 0; i < nPair;)
+    {
+        const int cmp = it.isEnd() ? -1 : compare(aPair[i].first, it.key());
+        if(cmp > 0)
+        {
+            aNode.push_back(it.m_node);
+            it.next();
+            continue;
+        }
+
+        if(cmp == 0)
+        {
+            it.m_node->m_value = std::move(aPair[i++].second);
+            aNode.push_back(it.m_node);
+            it.next();
+        }
+        else
+        {
+            aNode.push_back(create_node(std::move(aPair[i].first), std::move(aPair[i].second)));
+            ++i;
+        }
+    }
+    for(; !it.isEnd(); it.next())
+        aNode.push_back(it.m_node);
+
+    for(size_t i = 1; i < aNode.size(); ++i)
+        link(aNode[i - 1], aNode[i]);
+    m_pFinger = NULL;
+    m_root = link_sorted(aNode.data(), aNode.size());
+    if(m_root)
+        m_root->m_parent = NULL;
+    m_size = aNode.size();
+    update_bounds();
+}
+
+/// <summary> Builds perfectly balanced subtree from the sorted range. </summary>
+/// <returns> The root of subtree. </returns>
+/// <param name="it"> inout. The beginning of range, on return - the end of consumed elements. </param>
+/// <param name="nNode"> in. Number of nodes in subtree. </param>
+/// <param name="pPrev"> inout. The last created node (to check order of keys and to thread the nodes). </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class It> TreeNode<Key, Val, Augment>* Tree<Key, Val, Compare, Alloc, Augment>::build_sorted(It& it, size_t nNode, Node*& pPrev)
+{
+    if(!nNode)
+        return NULL;
+
+    // nodes are created in order of keys: left branch, root, right branch
+    const size_t nLeft = nNode / 2;
+    Node* pLeft = build_sorted(it, nLeft, pPrev);
+    Node* pNode = create_node(it->first, it->second);
+    ++it;
+    assert(!pPrev || compare(pPrev->m_key, pNode->m_key) < 0);
+    link(pPrev, pNode);
+    pPrev = pNode;
+    Node* pRight = build_sorted(it, nNode - nLeft - 1, pPrev);
+
+    // branches differ in number of nodes at most by one, so the node is balanced
+    pNode->m_child[Node::eLeft] = pLeft;
+    pNode->m_child[Node::eRight] = pRight;
+    if(pLeft)
+        pLeft->m_parent = pNode;
+    if(pRight)
+        pRight->m_parent = pNode;
+    pNode->update_height();
+    return pNode;
+}
+
+/// <summary> Links nodes into perfectly balanced subtree. </summary>
+/// <returns> The root of subtree. </returns>
+/// <param name="aNode"> in. The nodes sorted by keys. </param>
+/// <param name="nNode"> in. Number of nodes. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> TreeNode<Key, Val, Augment>* Tree<Key, Val, Compare, Alloc, Augment>::link_sorted(Node* const* aNode, size_t nNode)
+{
+    if(!nNode)
+        return NULL;
+
+    const size_t nLeft = nNode / 2;
+    Node* pNode = aNode[nLeft];
+    for(int b = Node::eLeft; b <= Node::eRight; ++b)
+    {
+        Node* pChild = b == Node::eLeft ? link_sorted(aNode, nLeft) : link_sorted(aNode + nLeft + 1, nNode - nLeft - 1);
+        pNode->m_child[b] = pChild;
+        if(pChild)
+            pChild->m_parent = pNode;
+    }
+    pNode->update_height();
+    return pNode;
+}
+
+/// <summary> Creates new node. </summary>
+/// <returns> Pointer to the created node. </returns>
+/// <param name="args"> in. The arguments of node constructor: the key and arguments of the value constructor. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class... Args> TreeNode<Key, Val, Augment>* Tree<Key, Val, Compare, Alloc, Augment>::create_node(Args&&... args)
+{
+    Node* pNode = m_alloc.allocate();
+    try
+    {
+        return new(pNode) Node(std::forward<Args>(args)...);
+    }
+    catch(...)
+    {
+        m_alloc.deallocate(pNode);
+        throw;
+    }
+}
+
+/// <summary> Destroys the node and returns its memory to allocator. </summary>
+/// <param name="pNode"> in. The node to be destroyed. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::destroy_node(Node* pNode)
+{
+    pNode->~Node();
+    m_alloc.deallocate(pNode);
+}
+
+/// <summary> Destroys the subtree: nothing to do, memory of nodes will be released by allocator. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::destroy_nodes(Node*, std::true_type)
+{
+}
+
+/// <summary> Destroys all nodes of the subtree. </summary>
+/// <param name="pNode"> in. The root of subtree. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::destroy_nodes(Node* pNode, std::false_type bSkip)
+{
+    if(!pNode)
+        return;
+    destroy_nodes(pNode->left(), bSkip);
+    destroy_nodes(pNode->right(), bSkip);
+    destroy_node(pNode);
+}
+
+/// <summary> Destroys all nodes of the subtree. </summary>
+/// <returns> The number of destroyed nodes. </returns>
+/// <param name="pNode"> in. The root of subtree. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> size_t Tree<Key, Val, Compare, Alloc, Augment>::destroy_subtree(Node* pNode)
+{
+    if(!pNode)
+        return 0;
+    const size_t nNode = 1 + destroy_subtree(pNode->left()) + destroy_subtree(pNode->right());
+    destroy_node(pNode);
+    return nNode;
+}
+
+/// <summary> Searches for node with specified key. </summary>
+/// <returns> True if node found. </returns>
+/// <param name="pNode"> out. Pointer to node if node found, otherwise - pointer to parent node for node to be inserted. </param>
+/// <param name="key"> in. The key to be found. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class K> bool Tree<Key, Val, Compare, Alloc, Augment>::find_imp(Node*& pNode, const K& key) const
+{
+    pNode = m_root;
+    return descend(pNode, key);
+}
+
+/// <summary> Searches for node with specified key starting from the specified node (finger): climbs up till subtree which contains the key, then descends. </summary>
+/// <returns> True if node found. </returns>
+/// <param name="pNode"> inout. The finger node, on return - pointer to node if node found, otherwise - pointer to parent node for node to be inserted. </param>
+/// <param name="key"> in. The key to be found. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class K> bool Tree<Key, Val, Compare, Alloc, Augment>::find_from(Node*& pNode, const K& key) const
+{
+    for(Node* pParent = pNode->parent(); pParent; pParent = pNode->parent())
+    {
+        const int cmp = compare(key, pNode->m_key);
+        if(cmp == 0)
+            return true;
+
+        // the key is between the node and its parent, so it belongs to the subtree of the node
+        const bool bLeft = pParent->left() == pNode;
+        if(cmp > 0 ? bLeft && compare(key, pParent->m_key) < 0 : !bLeft && compare(key, pParent->m_key) > 0)
+            break;
+        pNode = pParent;
+    }
+    return descend(pNode, key);
+}
+
+/// <summary> Searches for node with specified key in the subtree. </summary>
+/// <returns> True if node found. </returns>
+/// <param name="pNode"> inout. The root of subtree, on return - pointer to node if node found, otherwise - pointer to parent node for node to be inserted. </param>
+/// <param name="key"> in. The key to be found. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class K> bool Tree<Key, Val, Compare, Alloc, Augment>::descend(Node*& pNode, const K& key) const
+{
+    while(pNode)
+    {
+        const int cmp = compare(key, pNode->m_key);
+        if(cmp == 0)
+            return true;
+
+        // select the branch without extra conditional jumps
+        Node* pChild = pNode->m_child[cmp > 0];
+        if(!pChild)
+            return false;
+        pNode = pChild;
+    }
+    return false;
+}
+
+/// <summary> Searches for many keys at once by interleaved descents. </summary>
+/// <returns> The number of found keys. </returns>
+/// <param name="aKey"> in. The keys to be found. </param>
+/// <param name="nKey"> in. Number of keys. </param>
+/// <param name="aValue"> out. Pointers to values of the keys, NULL if the key isn't found. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class K> size_t Tree<Key, Val, Compare, Alloc, Augment>::find_batch_imp(const K* aKey, size_t nKey, Val** aValue) const
+{
+    // number of searches in flight, enough to cover the memory latency by comparisons of other searches
+    const size_t c_nGroup = 16;
+
+    size_t nFound = 0;
+    for(size_t iFirst = 0; iFirst < nKey; iFirst += c_nGroup)
+    {
+        // the current nodes of unfinished searches and their indexes, finished searches are replaced by the last one
+        Node* aNode[c_nGroup];
+        size_t aIndex[c_nGroup];
+        size_t nActive = std::min(c_nGroup, nKey - iFirst);
+        for(size_t i = 0; i < nActive; ++i)
+        {
+            aNode[i] = m_root;
+            aIndex[i] = iFirst + i;
+        }
+
+        // each round moves every search one level down
+        while(nActive)
+        {
+            for(size_t i = 0; i < nActive;)
+            {
+                Node* pNode = aNode[i];
+                const int cmp = pNode ? compare(aKey[aIndex[i]], pNode->m_key) : 0;
+                Node* pChild = cmp ? pNode->m_child[cmp > 0] : NULL;
+                if(pChild)
+                {
+                    // the key is at the end of the node, it may be on the next cache line
+                    tree_prefetch(pChild);
+                    tree_prefetch(&pChild->m_key);
+                    aNode[i++] = pChild;
+                    continue;
+                }
+
+                // found or not found
+                aValue[aIndex[i]] = pNode && cmp == 0 ? &pNode->m_value : NULL;
+                nFound += pNode && cmp == 0 ? 1 : 0;
+                --nActive;
+                aNode[i] = aNode[nActive];
+                aIndex[i] = aIndex[nActive];
+            }
+        }
+    }
+    return nFound;
+}
+
+/// <summary> 
+/// Searches for node with specified key, the insert position between the finger and its neighbour is taken without search. 
+/// Otherwise the search climbs from the finger or starts from the root, the neighbours of the insert position are tracked by the way. 
+/// </summary>
+/// <returns> True if node found. </returns>
+/// <param name="pNode"> out. Pointer to node if node found, otherwise - pointer to parent node for node to be inserted. </param>
+/// <param name="key"> in. The key to be found. </param>
+/// <param name="pPrev"> out. The node before the insert position, NULL if the key is less than all keys. </param>
+/// <param name="pNext"> out. The node after the insert position, NULL if the key is greater than all keys. </param>
+/// <param name="bClimb"> in. True - the search climbs from the finger (the finger is the hint), false - it starts from the root. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class K> bool Tree<Key, Val, Compare, Alloc, Augment>::find_finger(Node*& pNode, const K& key, Node*& pPrev, Node*& pNext, bool bClimb)
+{
+    if(Node* pFinger = m_pFinger)
+    {
+        const int cmp = compare(key, pFinger->m_key);
+        if(cmp == 0)
+        {
+            pNode = pFinger;
+            return true;
+        }
+
+        // the neighbour of the finger on the side of the key
+        Node* pBound = cmp < 0 ? m_pFingerPrev : m_pFingerNext;
+        const int cmpBound = pBound ? compare(key, pBound->m_key) : -cmp;
+        if(cmpBound == 0)
+        {
+            pNode = pBound;
+            return true;
+        }
+
+        if((cmpBound < 0) != (cmp < 0))
+        {
+            // the key is between the finger and the neighbour: the free child of the finger on the side of the key, 
+            // otherwise the neighbour is the leftmost (rightmost) node of that subtree and its child towards the finger is free
+            ++m_stats.m_nFinger;
+            pPrev = cmp > 0 ? pFinger : pBound;
+            pNext = cmp > 0 ? pBound : pFinger;
+            pNode = pFinger->m_child[cmp > 0] ? pBound : pFinger;
+            assert(pNode && !pNode->m_child[pNode == pFinger ? cmp > 0 : cmp < 0]);
+            return false;
+        }
+
+        if(bClimb)
+        {
+            pNode = pFinger;
+            if(find_from(pNode, key))
+                return true;
+            // the new node is a leaf, so the parent is one neighbour and the other is found by links
+            const bool bRight = compare(key, pNode->m_key) > 0;
+            pPrev = bRight ? pNode : neighbour(pNode, Node::eLeft);
+            pNext = bRight ? neighbour(pNode, Node::eRight) : pNode;
+            return false;
+        }
+    }
+
+    // search from the root, the last nodes passed to the right and to the left are the neighbours (indexed by the branch to avoid jumps)
+    Node* aBound[2] = { NULL, NULL };
+    pNode = m_root;
+    bool bFound = false;
+    while(pNode)
+    {
+        const int cmp = compare(key, pNode->m_key);
+        if(cmp == 0)
+        {
+            bFound = true;
+            break;
+        }
+
+        aBound[cmp > 0] = pNode;
+        Node* pChild = pNode->m_child[cmp > 0];
+        if(!pChild)
+            break;
+        pNode = pChild;
+    }
+    pPrev = aBound[Node::eRight];
+    pNext = aBound[Node::eLeft];
+    return bFound;
+}
+
+/// <summary> Queries the neighbour of the node in order of keys. </summary>
+/// <returns> The previous (eLeft) or the next (eRight) node, NULL if the node is the first (the last) one. </returns>
+/// <param name="pNode"> in. The node. </param>
+/// <param name="b"> in. The direction. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> TreeNode<Key, Val, Augment>* Tree<Key, Val, Compare, Alloc, Augment>::neighbour(Node* pNode, typename Node::EBranch b, std::false_type)
+{
+    // the outermost node of the child subtree in the direction
+    if(Node* pChild = pNode->m_child[b])
+    {
+        while(pChild->m_child[!b])
+            pChild = pChild->m_child[!b];
+        return pChild;
+    }
+
+    // the first ancestor reached from the opposite side
+    Node* pParent = pNode->parent();
+    while(pParent && pParent->m_child[b] == pNode)
+    {
+        pNode = pParent;
+        pParent = pNode->parent();
+    }
+    return pParent;
+}
+
+/// <summary> Links the neighbour nodes in order of keys. </summary>
+/// <param name="pPrev"> in. The previous node, NULL if the next node becomes the first one. </param>
+/// <param name="pNext"> in. The next node, NULL if the previous node becomes the last one. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::link(Node* pPrev, Node* pNext, std::true_type)
+{
+    if(pPrev)
+        pPrev->m_thread[Node::eRight] = pNext;
+    if(pNext)
+        pNext->m_thread[Node::eLeft] = pPrev;
+}
+
+/// <summary> Links the new leaf between the parent and the former neighbour of the parent on that side. </summary>
+/// <param name="parent"> in. The parent node. </param>
+/// <param name="child"> in. The new leaf. </param>
+/// <param name="b"> in. The branch of the parent where the leaf is attached. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::link_leaf(Node& parent, Node& child, typename Node::EBranch b, std::true_type)
+{
+    Node* pOuter = thread(&parent, b);
+    link(b == Node::eLeft ? pOuter : &parent, &child);
+    link(&child, b == Node::eLeft ? &parent : pOuter);
+}
+
+/// <summary> Links all nodes of the tree in order of keys after the operations which rebuild the tree. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::rethread(std::true_type)
+{
+    Node* pPrev = NULL;
+    thread_subtree(m_root, pPrev);
+    link(pPrev, NULL);
+}
+
+/// <summary> Links nodes of the subtree in order of keys. </summary>
+/// <param name="pNode"> in. The root of subtree. </param>
+/// <param name="pPrev"> inout. The node before the subtree, on return - the last node of the subtree. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::thread_subtree(Node* pNode, Node*& pPrev)
+{
+    if(!pNode)
+        return;
+    thread_subtree(pNode->left(), pPrev);
+    link(pPrev, pNode);
+    pPrev = pNode;
+    thread_subtree(pNode->right(), pPrev);
+}
+
+/// <summary> Checks that the threads link the nodes in order of keys. </summary>
+/// <returns> True if the threads are valid. </returns>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> bool Tree<Key, Val, Compare, Alloc, Augment>::check_threads(std::true_type) const
+{
+    // the walk by links of children visits the nodes in order of keys
+    const Node* pPrev = NULL;
+    for(const Node* pNode = m_root ? min_node(m_root) : NULL; pNode; )
+    {
+        if(thread(pNode, Node::eLeft) != pPrev || (pPrev && thread(pPrev, Node::eRight) != pNode))
+            return false;
+        pPrev = pNode;
+        pNode = neighbour(const_cast<Node*>(pNode), Node::eRight, std::false_type());
+    }
+    return !pPrev || !thread(pPrev, Node::eRight);
+}
+
+/// <summary> Links new node to the tree as child of the specified node. </summary>
+/// <param name="pParent"> in. The parent for new node found by find_imp, NULL if the tree is empty. </param>
+/// <param name="child"> in. The new node. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::insert_imp(Node* pParent, Node& child)
+{
+    // the neighbours of the finger may change, the callers which know the neighbours of the new node set it as the finger
+    m_pFinger = NULL;
+    ++m_size;
+
+    // case when tree is empty
+    if(!pParent)
+    {
+        assert(!m_root);
+        m_root = m_pMin = m_pMax = &child;
+        return;
+    }
+
+    // pParent - is a parent of new child
+    const int cmp = compare(child.m_key, pParent->m_key);
+    assert(cmp != 0);
+    link_leaf(*pParent, child, cmp < 0 ? Node::eLeft : Node::eRight, t_threaded());
+    setChild(*pParent, child, cmp < 0 ? Node::eLeft : Node::eRight);
+    if(pParent == (cmp < 0 ? m_pMin : m_pMax))
+        (cmp < 0 ? m_pMin : m_pMax) = &child;
+
+    // balance tree
+    retrace_insert(*pParent);
+    update_path(&child, std::integral_constant<bool, Augment::propagate>());
+}
+
+/// <summary> Sets child for specified parent. </summary>
+/// <param name="parent"> inout. The parent node. </param>
+/// <param name="child"> inout. The child node. </param>
+/// <param name="b"> in. The branch which specified left/right child.  </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::setChild(Node& parent, Node& child, typename Node::EBranch b) const
+{
+    // the order of keys isn't asserted here: the links are restored on unwinding from the exception of the comparator, see set_operation_imp
+    assert(!parent.m_child[b]);
+    parent.m_child[b] = &child;
+    child.m_parent = &parent;
+}
+
+/// <summary> Moves child from parent to another one. </summary>
+/// <param name="from"> inout. The source parent node. </param>
+/// <param name="bf"> in. The source branch. </param>
+/// <param name="to"> inout. The destination parent node.  </param>
+/// <param name="bt"> in. The destination branch. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::moveChild(Node& from, typename Node::EBranch bf, Node& to, typename Node::EBranch bt) const
+{
+    assert(&from != &to);
+
+    if(to.m_child[bt])
+        to.m_child[bt]->m_parent = NULL;
+
+    to.m_child[bt] = from.m_child[bf];
+    from.m_child[bf] = NULL;
+
+    if(to.m_child[bt])
+        to.m_child[bt]->m_parent = &to;
+}
+
+/// <summary> Moves node to specified parent. </summary>
+/// <param name="parent"> inout. The destination parent node. </param>
+/// <param name="bt"> in. The destination branch. </param>
+/// <param name="node"> inout. The node to be moved. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::moveNode(Node& parent, typename Node::EBranch b, Node& node)
+{
+    if(Node* pParentTo = node.parent())
+    {
+        const typename Node::EBranch bt = &node == pParentTo->left() ? Node::eLeft : Node::eRight;
+        moveChild(parent, b, *pParentTo, bt);
+    }
+    else
+    {
+        // node is root
+        m_root = parent.m_child[b];
+        if(m_root)
+            m_root->m_parent = NULL;
+        parent.m_child[b] = NULL;
+    }
+}
+
+/// <summary> Removes the node from the tree and destroys it. </summary>
+/// <param name="pNode"> in. The node to be removed. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::erase_node(Node* pNode)
+{
+    // the finger stays valid unless the node is the finger or its neighbour
+    if(pNode == m_pFinger || pNode == m_pFingerPrev || pNode == m_pFingerNext)
+        m_pFinger = NULL;
+
+    // the leftmost node has no left child, so its successor is found in O(1) (and vice versa)
+    if(pNode == m_pMin)
+        m_pMin = neighbour(pNode, Node::eRight);
+    if(pNode == m_pMax)
+        m_pMax = neighbour(pNode, Node::eLeft);
+    unlink(pNode, t_threaded());
+
+    // remove pNode from tree
+    Node* pNodeUpdate = NULL;
+    if(Node* pMin = pNode->right())
+    {
+        // search for minimal node in right branch
+        const typename Node::EBranch branchMin = pMin->left() ? Node::eLeft : Node::eRight;
+        while(pMin->left())
+            pMin = pMin->left();
+        
+        Node& parentMin = *pMin->parent();
+
+        // replace pNode by pMin
+        moveNode(parentMin, branchMin, *pNode);
+
+        // replace pMin by pMin->right
+        moveChild(*pMin, Node::eRight, parentMin, branchMin);
+
+        // move children from pNode to pMin, pMin takes the height of pNode to let retrace detect the change
+        moveChild(*pNode, Node::eLeft, *pMin, Node::eLeft);
+        moveChild(*pNode, Node::eRight, *pMin, Node::eRight);
+        pMin->m_height = pNode->m_height;
+
+        // update balance starting from the former parent of pMin
+        pNodeUpdate = &parentMin == pNode ? pMin : &parentMin;
+    }
+    else
+    {
+        // update balance starting from parent
+        pNodeUpdate = pNode->parent();
+
+        // if right branch is empty, replace pNode by left child
+        moveNode(*pNode, Node::eLeft, *pNode);
+    }
+
+    // destroy node
+    assert(pNode->left() == NULL && pNode->right() == NULL && pNode->parent() == NULL);
+    destroy_node(pNode);
+    --m_size;
+
+    // update tree balance
+    if(pNodeUpdate)
+    {
+        retrace_erase(*pNodeUpdate);
+        update_path(pNodeUpdate, std::integral_constant<bool, Augment::propagate>());
+    }
+}
+
+/// <summary> Splits the tree by the key: the nodes with keys not less than the key are moved to the right tree. </summary>
+/// <param name="key"> in. The key or the value comparable with the keys. </param>
+/// <param name="right"> out. The tree which receives the nodes with greater keys. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class K> void Tree<Key, Val, Compare, Alloc, Augment>::split_tree(const K& key, Tree& right)
+{
+    assert(&right != this);
+    right.clear();
+    right.m_alloc.share(m_alloc);
+
+    Node* pLeft;
+    Node* pRight;
+    if(Node* pNode = split_imp(m_root, key, pLeft, pRight))
+        pRight = join_imp(NULL, *pNode, pRight);
+
+    const size_t nLeft = count_left(pLeft, pRight, std::integral_constant<bool, std::is_base_of<TreeAugmentCount::Data, Node>::value>());
+    right.set_root(pRight, m_size - nLeft);
+    set_root(pLeft, nLeft);
+    link(m_pMax, NULL);
+    link(NULL, right.m_pMin);
+}
+
+/// <summary> 
+/// Performs the set operation with another tree, the nodes which aren't in the result are destroyed after all parallel tasks are finished. 
+/// Basic guarantee: if the comparator, the move of value or the thread pool throws, both trees remain valid, 
+/// the nodes aren't lost, but they may be distributed between the trees in any way, the nodes which were excluded from the result are destroyed. 
+/// </summary>
+/// <param name="other"> inout. The second operand, on return - empty. </param>
+/// <param name="op"> in. The operation. </param>
+/// <param name="pool"> in. The thread pool. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::set_operation(Tree& other, ESetOperation op, TreeThreadPool& pool)
+{
+    assert(&other != this);
+
+    // the trees share the blocks both ways: after an exception each tree may hold the nodes of another one
+    m_alloc.share(other.m_alloc);
+    other.m_alloc.share(m_alloc);
+    Node* pRoot = m_root;
+    Node* pRootOther = other.m_root;
+    Node* pDiscard = NULL;
+    try
+    {
+        set_operation_imp(pRoot, pRootOther, op, parallel_depth(pool), pool, pDiscard);
+    }
+    catch(...)
+    {
+        destroy_discarded(pDiscard);
+        set_root(pRoot, count_nodes(pRoot));
+        other.set_root(pRootOther, count_nodes(pRootOther));
+        rethread(t_threaded());
+        other.rethread(t_threaded());
+        throw;
+    }
+    const size_t nDiscard = destroy_discarded(pDiscard);
+    join_trees(pRoot, m_size + other.m_size - nDiscard, other);
+    rethread(t_threaded());
+}
+
+/// <summary> 
+/// Performs the set operation with subtrees: the second subtree is split by the root key of the first one, 
+/// the operation is applied to the left parts and to the right parts (in parallel), then the results are joined with or without the root. 
+/// If an exception is thrown, the parts are joined back: the first subtree gets the results of the processed parts, 
+/// both subtrees are valid and keep the range of keys, so the caller can join them back too. 
+/// </summary>
+/// <param name="pNode1"> inout. The root of the first subtree (without parent), may be NULL. On return - the root of the result. </param>
+/// <param name="pNode2"> inout. The root of the second subtree (without parent), may be NULL. On return - NULL. </param>
+/// <param name="op"> in. The operation. </param>
+/// <param name="nDepth"> in. The remaining depth of parallel recursion. </param>
+/// <param name="pool"> in. The thread pool. </param>
+/// <param name="pDiscard"> inout. The list of subtrees which aren't in the result, see discard. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::set_operation_imp(Node*& pNode1, Node*& pNode2, ESetOperation op, int nDepth, TreeThreadPool& pool, Node*& pDiscard)
+{
+    // subtrees are small for parallel processing below this height
+    const int c_nMinParallelHeight = 10;
+
+    if(!pNode1 || !pNode2)
+    {
+        if(op == eUnion && !pNode1)
+            std::swap(pNode1, pNode2);
+        else if(op == eDifference)
+            discard(pNode2, pDiscard);
+        else if(op == eIntersect)
+        {
+            discard(pNode1 ? pNode1 : pNode2, pDiscard);
+            pNode1 = NULL;
+        }
+        pNode2 = NULL;
+        return;
+    }
+
+    // split the second subtree by the key of the first root (the subtree is intact if the comparator throws), detach the children of the first root
+    Node* pLeft2;
+    Node* pRight2;
+    Node* pFound = split_imp(pNode2, pNode1->m_key, pLeft2, pRight2);
+    Node* pLeft1 = pNode1->left();
+    Node* pRight1 = pNode1->right();
+    for(int b = Node::eLeft; b <= Node::eRight; ++b)
+    {
+        if(pNode1->m_child[b])
+            pNode1->m_child[b]->m_parent = NULL;
+        pNode1->m_child[b] = NULL;
+    }
+
+    try
+    {
+        if(nDepth > 0 && height(pLeft1) + height(pLeft2) > c_nMinParallelHeight)
+        {
+            // the right parts are processed by another tree object: rotations update the root and statistics of the tree
+            Tree context(m_cmp);
+            Node* pDiscardRight = NULL;
+            std::exception_ptr pError;
+            try
+            {
+                pool.invoke(
+                    [&]() { set_operation_imp(pLeft1, pLeft2, op, nDepth - 1, pool, pDiscard); },
+                    [&]() { context.set_operation_imp(pRight1, pRight2, op, nDepth - 1, pool, pDiscardRight); });
+            }
+            catch(...)
+            {
+                pError = std::current_exception();
+            }
+
+            // the nodes belong to the operands, the context must not destroy them
+            context.m_root = NULL;
+            discard(pDiscardRight, pDiscard);
+            m_stats.m_nRetrace += context.m_stats.m_nRetrace;
+            m_stats.m_nRotation += context.m_stats.m_nRotation;
+            if(pError)
+                std::rethrow_exception(pError);
+        }
+        else
+        {
+            set_operation_imp(pLeft1, pLeft2, op, nDepth, pool, pDiscard);
+            set_operation_imp(pRight1, pRight2, op, nDepth, pool, pDiscard);
+        }
+        if(pFound && op == eUnion)
+            pNode1->m_value = std::move(pFound->m_value);
+    }
+    catch(...)
+    {
+        // the parts keep the order of keys: the left parts are less than the key of roots, the right parts are greater
+        pNode1 = join_imp(pLeft1, *pNode1, pRight1);
+        pNode2 = pFound ? join_imp(pLeft2, *pFound, pRight2) : join_imp(pLeft2, pRight2);
+        throw;
+    }
+
+    // the root is in the result of union, in the result of intersection if the key is found, in the result of difference otherwise
+    assert(!pLeft2 && !pRight2);
+    if(pFound)
+        discard(pFound, pDiscard);
+    if(op == eUnion || (op == eIntersect) == (pFound != NULL))
+        pNode1 = join_imp(pLeft1, *pNode1, pRight1);
+    else
+    {
+        discard(pNode1, pDiscard);
+        pNode1 = join_imp(pLeft1, pRight1);
+    }
+    pNode2 = NULL;
+}
+
+/// <summary> Adds the subtrees to the list of subtrees which aren't in the result of set operation, the list is linked by parents of the roots. </summary>
+/// <param name="pNode"> in. The root of subtree (without parent) or the list of subtrees, may be NULL. </param>
+/// <param name="pDiscard"> inout. The first subtree of the list. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::discard(Node* pNode, Node*& pDiscard)
+{
+    if(!pNode)
+        return;
+    Node* pLast = pNode;
+    while(pLast->m_parent)
+        pLast = pLast->m_parent;
+    pLast->m_parent = pDiscard;
+    pDiscard = pNode;
+}
+
+/// <summary> Destroys the list of subtrees, see discard. </summary>
+/// <returns> The number of destroyed nodes. </returns>
+/// <param name="pDiscard"> in. The first subtree of the list. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> size_t Tree<Key, Val, Compare, Alloc, Augment>::destroy_discarded(Node* pDiscard)
+{
+    size_t nNode = 0;
+    while(pDiscard)
+    {
+        Node* pNext = pDiscard->m_parent;
+        pDiscard->m_parent = NULL;
+        nNode += destroy_subtree(pDiscard);
+        pDiscard = pNext;
+    }
+    return nNode;
+}
+
+/// <summary> Relocates all nodes to one contiguous block in van Emde Boas order. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::compact_veb()
+{
+    if(!m_root)
+        return;
+
+    std::vector<Node*> aOld;
+    aOld.reserve(size());
+    collect_veb(m_root, m_root->m_height, aOld);
+
+    // copy the nodes in order of layout to the new pool, the new block is exactly of the tree size
+    Alloc<Node> alloc;
+    alloc.reserve(aOld.size());
+    std::vector<Node*> aNew(aOld.size());
+    size_t i = 0;
+    try
+    {
+        for(; i < aOld.size(); ++i)
+        {
+            Node* pNode = alloc.allocate();
+            try
+            {
+                aNew[i] = new(pNode) Node(aOld[i]->m_key, std::move_if_noexcept(aOld[i]->m_value));
+            }
+            catch(...)
+            {
+                alloc.deallocate(pNode);
+                throw;
+            }
+        }
+    }
+    catch(...)
+    {
+        // return the moved values, the tree is unchanged
+        while(i--)
+        {
+            aOld[i]->m_value = std::move(aNew[i]->m_value);
+            aNew[i]->~Node();
+            alloc.deallocate(aNew[i]);
+        }
+        throw;
+    }
+
+    // the parent link of the old node refers to its copy while the links are rewritten
+    for(i = 0; i < aOld.size(); ++i)
+        aOld[i]->m_parent = aNew[i];
+    for(i = 0; i < aOld.size(); ++i)
+    {
+        Node& node = *aNew[i];
+        for(int b = Node::eLeft; b <= Node::eRight; ++b)
+        {
+            if(Node* pChild = aOld[i]->m_child[b])
+            {
+                node.m_child[b] = pChild->m_parent;
+                pChild->m_parent->m_parent = &node;
+            }
+        }
+        node.m_height = aOld[i]->m_height;
+        static_cast<typename Augment::Data&>(node) = static_cast<const typename Augment::Data&>(*aOld[i]);
+    }
+    m_root = aNew[0];
+    m_pMin = m_pMin->m_parent;
+    m_pMax = m_pMax->m_parent;
+    m_pFinger = NULL;
+    rethread(t_threaded());
+
+    // destroy the old nodes and release their blocks (the blocks shared with other trees are released by them)
+    if(!Alloc<Node>::bulk_release || !std::is_trivially_destructible<Node>::value)
+    {
+        for(i = 0; i < aOld.size(); ++i)
+            destroy_node(aOld[i]);
+    }
+    m_alloc.swap(alloc);
+}
+
+/// <summary> Collects nodes of the subtree in van Emde Boas order: the top half of levels, then the subtrees below it from left to right. </summary>
+/// <param name="pNode"> in. The root of subtree. </param>
+/// <param name="nLevel"> in. Number of levels of the subtree to be collected. </param>
+/// <param name="aNode"> inout. The collected nodes. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::collect_veb(Node* pNode, int nLevel, std::vector<Node*>& aNode)
+{
+    if(nLevel == 1)
+    {
+        aNode.push_back(pNode);
+        return;
+    }
+
+    const int nTop = nLevel / 2;
+    collect_veb(pNode, nTop, aNode);
+
+    // the roots of the bottom subtrees are the nodes of level nTop
+    std::vector<Node*> aRoot;
+    collect_level(pNode, nTop, aRoot);
+    for(size_t i = 0; i < aRoot.size(); ++i)
+        collect_veb(aRoot[i], nLevel - nTop, aNode);
+}
+
+/// <summary> Collects nodes of the level of subtree from left to right. </summary>
+/// <param name="pNode"> in. The root of subtree, may be NULL. </param>
+/// <param name="nLevel"> in. The level, 0 - the root. </param>
+/// <param name="aNode"> inout. The collected nodes. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::collect_level(Node* pNode, int nLevel, std::vector<Node*>& aNode)
+{
+    if(!pNode)
+        return;
+    if(!nLevel)
+    {
+        aNode.push_back(pNode);
+        return;
+    }
+    collect_level(pNode->left(), nLevel - 1, aNode);
+    collect_level(pNode->right(), nLevel - 1, aNode);
+}
+
+/// <summary> Sets the result of join as the root of this tree and makes the right tree empty. </summary>
+/// <param name="pRoot"> in. The root of joined tree. </param>
+/// <param name="nSize"> in. The number of nodes of joined tree. </param>
+/// <param name="right"> inout. The joined tree. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::join_trees(Node* pRoot, size_t nSize, Tree& right)
+{
+    right.m_root = NULL;
+    right.m_size = 0;
+    right.m_pFinger = NULL;
+    right.m_pMin = right.m_pMax = NULL;
+    set_root(pRoot, nSize);
+}
+
+/// <summary> Sets new root of the tree. </summary>
+/// <param name="pRoot"> in. The new root. </param>
+/// <param name="nSize"> in. The number of nodes. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::set_root(Node* pRoot, size_t nSize)
+{
+    m_root = pRoot;
+    m_size = nSize;
+    m_pFinger = NULL;
+    update_bounds();
+}
+
+/// <summary> Counts nodes of the left part of split tree, both parts are walked in turn, so the time is proportional to the smaller part. </summary>
+/// <returns> The number of nodes of the left part. </returns>
+/// <param name="pLeft"> in. The root of the left part. </param>
+/// <param name="pRight"> in. The root of the right part, the parts have m_size nodes together. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> size_t Tree<Key, Val, Compare, Alloc, Augment>::count_left(const Node* pLeft, const Node* pRight, std::false_type) const
+{
+    std::vector<const Node*> aLeft, aRight;
+    if(pLeft)
+        aLeft.push_back(pLeft);
+    if(pRight)
+        aRight.push_back(pRight);
+    size_t nLeft = 0, nRight = 0;
+    for(;;)
+    {
+        if(!count_step(aLeft, nLeft))
+            return nLeft;
+        if(!count_step(aRight, nRight))
+            return m_size - nRight;
+    }
+}
+
+/// <summary> Makes one step of walk of subtree: counts the node on the top of stack and pushes its children. </summary>
+/// <returns> False if the walk is finished. </returns>
+/// <param name="aStack"> inout. The stack of roots of subtrees to be walked. </param>
+/// <param name="nNode"> inout. The number of counted nodes. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> bool Tree<Key, Val, Compare, Alloc, Augment>::count_step(std::vector<const Node*>& aStack, size_t& nNode)
+{
+    if(aStack.empty())
+        return false;
+    const Node* pNode = aStack.back();
+    aStack.pop_back();
+    ++nNode;
+    for(int b = Node::eLeft; b <= Node::eRight; ++b)
+    {
+        if(pNode->m_child[b])
+            aStack.push_back(pNode->m_child[b]);
+    }
+    return true;
+}
+
+/// <summary> Removes nodes with keys in range [*pLow, *pHigh). </summary>
+/// <returns> The number of removed nodes. </returns>
+/// <param name="pLow"> in. The lower bound of range (inclusive). </param>
+/// <param name="pHigh"> in. The upper bound of range (exclusive), NULL if the range isn't bounded. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class K> size_t Tree<Key, Val, Compare, Alloc, Augment>::erase_range_imp(const K* pLow, const K* pHigh)
+{
+    if(!m_root || (pHigh && compare(*pLow, *pHigh) >= 0))
+        return 0;
+
+    // split the tree into [.., lo), [lo, hi), [hi, ..), the nodes with keys equal to the bounds are split out separately
+    Node* pLeft;
+    Node* pMiddle;
+    Node* pLowNode = split_imp(m_root, *pLow, pLeft, pMiddle);
+    Node* pRight = NULL;
+    if(pHigh)
+    {
+        Node* pRest = pMiddle;
+        if(Node* pHighNode = split_imp(pRest, *pHigh, pMiddle, pRight))
+            pRight = join_imp(NULL, *pHighNode, pRight);
+    }
+
+    // the bounds refer to keys of nodes, so the nodes are destroyed after splitting
+    size_t nErased = destroy_subtree(pMiddle);
+    if(pLowNode)
+    {
+        destroy_node(pLowNode);
+        ++nErased;
+    }
 
-    // assignment is forbidden
-    Tree<Key, Val>& operator=(const Tree<Key, Val>&) { return *this; }
-private:
-    const t_fnCompare m_fnCmp;
-    Node* m_root;
-};
+    link_subtrees(pLeft, pRight, t_threaded());
+    m_root = join_imp(pLeft, pRight);
+    m_size -= nErased;
+    m_pFinger = NULL;
+    update_bounds();
+    return nErased;
+}
+
+/// <summary> 
+/// Splits the subtree by the key: the nodes with less keys are joined to the left subtree, with greater keys - to the right one. 
+/// Each node on the path to the key becomes the middle node of a join, the total work is O(log n).
+/// The key is compared with the nodes of the path before any change, so the exception of the comparator leaves the subtree intact.
+/// </summary>
+/// <returns> The detached node with the key, NULL if the key isn't found. </returns>
+/// <param name="pNode"> in. The root of subtree (without parent). </param>
+/// <param name="key"> in. The key or the value comparable with the keys. </param>
+/// <param name="pLeft"> out. The root of the subtree with less keys. </param>
+/// <param name="pRight"> out. The root of the subtree with greater keys. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class K> TreeNode<Key, Val, Augment>* Tree<Key, Val, Compare, Alloc, Augment>::split_imp(Node* pNode, const K& key, Node*& pLeft, Node*& pRight)
+{
+    // the height of AVL tree of 2^64 nodes is less than 94
+    const int c_nMaxHeight = 128;
 
+    signed char aCmp[c_nMaxHeight];
+    int nPath = 0;
+    for(const Node* pPath = pNode; pPath; ++nPath)
+    {
+        assert(nPath < c_nMaxHeight);
+        const int cmp = compare(key, pPath->m_key);
+        aCmp[nPath] = static_cast<signed char>(cmp < 0 ? -1 : cmp > 0 ? 1 : 0);
+        if(cmp == 0)
+            break;
+        pPath = pPath->m_child[cmp > 0 ? Node::eRight : Node::eLeft];
+    }
+    return split_path(pNode, aCmp, pLeft, pRight);
+}
 
-/// <summary> Moves iterator to next node in the tree. </summary>
-/// <returns> True if the curent node isn't end </returns>
+/// <summary> Splits the subtree along the path of known comparisons. </summary>
+/// <returns> The detached node with the key, NULL if the key isn't found. </returns>
+/// <param name="pNode"> in. The root of subtree (without parent). </param>
+/// <param name="pCmp"> in. The results of comparison of the key with the nodes of the path, starting from pNode. </param>
+/// <param name="pLeft"> out. The root of the subtree with less keys. </param>
+/// <param name="pRight"> out. The root of the subtree with greater keys. </param>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
-template<class Key, class Val> bool Tree<Key, Val>::Iterator::next()
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> TreeNode<Key, Val, Augment>* Tree<Key, Val, Compare, Alloc, Augment>::split_path(Node* pNode, const signed char* pCmp, Node*& pLeft, Node*& pRight)
 {
-    if(!m_node)
-        return false;
+    if(!pNode)
+    {
+        pLeft = pRight = NULL;
+        return NULL;
+    }
 
-    // minimal element in right branch
-    if(m_node->right())
+    // detach the children
+    Node* pChild[2] = { pNode->left(), pNode->right() };
+    for(int b = Node::eLeft; b <= Node::eRight; ++b)
     {
-        m_node = m_node->right();
-        while(m_node->left())
-            m_node = m_node->left();
-        return m_node != NULL;
+        if(pChild[b])
+            pChild[b]->m_parent = NULL;
+        pNode->m_child[b] = NULL;
     }
 
-    // parent node
-    Node* pParent = m_node->parent();
-    while(pParent && pParent->right() == m_node)
+    if(*pCmp == 0)
     {
-        m_node = pParent;
-        pParent = m_node->parent();
+        pLeft = pChild[Node::eLeft];
+        pRight = pChild[Node::eRight];
+        pNode->update_height();
+        return pNode;
     }
-    m_node = pParent;
-    return m_node != NULL;
+
+    Node* pFound;
+    if(*pCmp < 0)
+    {
+        Node* pLess;
+        pFound = split_path(pChild[Node::eLeft], pCmp + 1, pLeft, pLess);
+        pRight = join_imp(pLess, *pNode, pChild[Node::eRight]);
+    }
+    else
+    {
+        Node* pGreater;
+        pFound = split_path(pChild[Node::eRight], pCmp + 1, pGreater, pRight);
+        pLeft = join_imp(pChild[Node::eLeft], *pNode, pGreater);
+    }
+    return pFound;
 }
 
-/// <summary> Queries the tree iterator. </summary>
-/// <returns> The iteraror. </returns>
+/// <summary> 
+/// Joins two subtrees and the middle node: all keys of the left subtree are less than the key of middle node, all keys of the right one are greater. 
+/// The middle node is linked to the spine of the higher subtree at the node of almost the same height as the lower subtree, 
+/// then the path to root is rebalanced. The work is O(difference of heights). 
+/// </summary>
+/// <returns> The root of joined tree. </returns>
+/// <param name="pLeft"> in. The root of the left subtree (without parent), may be NULL. </param>
+/// <param name="mid"> in. The middle node (without links). </param>
+/// <param name="pRight"> in. The root of the right subtree (without parent), may be NULL. </param>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
-template<class Key, class Val> typename Tree<Key, Val>::Iterator Tree<Key, Val>::begin()
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> TreeNode<Key, Val, Augment>* Tree<Key, Val, Compare, Alloc, Augment>::join_imp(Node* pLeft, Node& mid, Node* pRight)
 {
-    if(!m_root)
-        return Iterator(NULL);
-    Node* pNode = m_root;
-    while(pNode->left())
-        pNode = pNode->left();
-    return Iterator(pNode);
+    assert(!mid.m_parent && !mid.left() && !mid.right());
+    assert((!pLeft || !pLeft->m_parent) && (!pRight || !pRight->m_parent));
+
+    // the branch of the higher subtree to descend along and the lower subtree
+    const int hl = height(pLeft), hr = height(pRight);
+    if(hl <= hr + 1 && hr <= hl + 1)
+    {
+        if(pLeft)
+            setChild(mid, *pLeft, Node::eLeft);
+        if(pRight)
+            setChild(mid, *pRight, Node::eRight);
+        mid.update_height();
+        return &mid;
+    }
+    const typename Node::EBranch b = hl > hr ? Node::eRight : Node::eLeft;
+    Node* pLow = hl > hr ? pRight : pLeft;
+    const int hLow = std::min(hl, hr);
+
+    // descend the inner spine of the higher subtree till the node which is not higher than the lower subtree by more than one
+    Node* pParent = hl > hr ? pLeft : pRight;
+    while(height(pParent->m_child[b]) > hLow + 1)
+        pParent = pParent->m_child[b];
+
+    // the middle node takes the place of the node, the node and the lower subtree become its children
+    Node* pInner = pParent->m_child[b];
+    pParent->m_child[b] = NULL;
+    if(pInner)
+    {
+        pInner->m_parent = NULL;
+        setChild(mid, *pInner, typename Node::EBranch(1 - b));
+    }
+    if(pLow)
+        setChild(mid, *pLow, b);
+    mid.update_height();
+    setChild(*pParent, mid, b);
+    return rebalance_path(pParent);
 }
 
-/// <summary> Searches for node with specified key. </summary>
-/// <returns> Pointer to node value, NULL if specified key isn't found in the tree. </returns>
-/// <param name="key"> in. The key of node to be found. </param>
+/// <summary> Joins two subtrees: all keys of the left subtree are less than keys of the right one. The minimal node of the right subtree becomes the middle node. </summary>
+/// <returns> The root of joined tree. </returns>
+/// <param name="pLeft"> in. The root of the left subtree (without parent), may be NULL. </param>
+/// <param name="pRight"> in. The root of the right subtree (without parent), may be NULL. </param>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
-template<class Key, class Val> const Val* Tree<Key, Val>::find(const Key& key) const
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> TreeNode<Key, Val, Augment>* Tree<Key, Val, Compare, Alloc, Augment>::join_imp(Node* pLeft, Node* pRight)
 {
-    Node* pNode;
-    return find_imp(pNode, key) ? &pNode->m_value : NULL;
+    if(!pLeft || !pRight)
+        return pLeft ? pLeft : pRight;
+
+    // detach the minimal node of the right subtree, its right child takes its place
+    Node* pMin = pRight;
+    while(pMin->left())
+        pMin = pMin->left();
+    Node* pParent = pMin->parent();
+    Node* pChild = pMin->right();
+    if(pChild)
+        pChild->m_parent = pParent;
+    pMin->m_child[Node::eRight] = NULL;
+    pMin->m_parent = NULL;
+    if(pParent)
+    {
+        pParent->m_child[Node::eLeft] = pChild;
+        pRight = rebalance_path(pParent);
+    }
+    else
+        pRight = pChild;
+    pMin->update_height();
+    return join_imp(pLeft, *pMin, pRight);
 }
 
+/// <summary> Updates heights and restores balance of the node and all its ancestors. </summary>
+/// <returns> The root of the tree. </returns>
+/// <param name="pNode"> in. The lowest changed node. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> TreeNode<Key, Val, Augment>* Tree<Key, Val, Compare, Alloc, Augment>::rebalance_path(Node* pNode)
+{
+    // rotation at a subtree root without parent sets m_root, the caller assigns the root of the whole tree anyway
+    Node* pRoot = pNode;
+    for(; pNode; pNode = pNode->parent())
+    {
+        pNode->update_height();
+        pRoot = pNode = rebalance(*pNode);
+    }
+    return pRoot;
+}
 
-/// <summary> Searches for node with specified key. </summary>
-/// <returns> Pointer to node value, NULL if specified key isn't found in the tree. </returns>
-/// <param name="key"> in. The key of node to be found. </param>
+/// <summary> Recalculates augmented data of the node and all its ancestors: retracing may stop below the root, but the data of each ancestor depends on the change. </summary>
+/// <param name="pNode"> in. The lowest changed node. </param>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
-template<class Key, class Val> Val* Tree<Key, Val>::find(const Key& key)
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::update_path(Node* pNode, std::true_type)
 {
-    Node* pNode;
-    return find_imp(pNode, key) ? &pNode->m_value : NULL;
+    for(; pNode; pNode = pNode->parent())
+        Augment::update(*pNode);
 }
 
-/// <summary> Inserts new node into the tree. </summary>
-/// <param name="key"> in. The node key. </param>
-/// <param name="val"> in. The node value. </param>
+/// <summary> Does nothing: augmented data doesn't depend on nodes below. </summary>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
-template<class Key, class Val> void Tree<Key, Val>::insert(const Key& key, const Val& val)
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::update_path(Node*, std::false_type)
 {
-    node_imp(key).m_value = val;
 }
 
-/// <summary> Searches for node with specified key. </summary>
-/// <returns> True if node found. </returns>
-/// <param name="pNode"> out. Pointer to node if node found, otherwise - pointer to parent node for node to be inserted. </param>
-/// <param name="key"> in. The key to be found. </param>
+/// <summary> Searches for k-th smallest node. Requires TreeAugmentCount. </summary>
+/// <returns> The iterator to the node, the end iterator if k isn't less than size of the tree. </returns>
+/// <param name="k"> in. The zero-based index of node in order of keys. </param>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
-template<class Key, class Val> bool Tree<Key, Val>::find_imp(Node*& pNode, const Key& key) const
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> TreeNode<Key, Val, Augment>* Tree<Key, Val, Compare, Alloc, Augment>::select_imp(size_t k) const
 {
-    pNode = m_root;
+    Node* pNode = m_root;
     while(pNode)
     {
-        const int cmp = m_fnCmp(key, pNode->m_key);
-        if(cmp < 0)
+        const size_t nLeft = Augment::count(pNode->left());
+        if(k == nLeft)
+            break;
+        if(k < nLeft)
+            pNode = pNode->left();
+        else
+        {
+            k -= nLeft + 1;
+            pNode = pNode->right();
+        }
+    }
+    return pNode;
+}
+
+/// <summary> Searches for the first node which key is greater (or not less) than specified key. </summary>
+/// <returns> Pointer to the node, NULL if there is no such node. </returns>
+/// <param name="key"> in. The key or the value comparable with the keys. </param>
+/// <param name="bUpper"> in. True - the key of node should be greater (upper bound), false - not less (lower bound). </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class K> TreeNode<Key, Val, Augment>* Tree<Key, Val, Compare, Alloc, Augment>::bound_imp(const K& key, bool bUpper) const
+{
+    // the last node where the path turned left is the bound
+    Node* pBound = NULL;
+    for(Node* pNode = m_root; pNode;)
+    {
+        const int cmp = compare(key, pNode->m_key);
+        if(cmp < 0 || (cmp == 0 && !bUpper))
         {
-            if(!pNode->left())
-                return false;
+            pBound = pNode;
             pNode = pNode->left();
         }
-        else if(cmp > 0)
+        else
+            pNode = pNode->right();
+    }
+    return pBound;
+}
+
+/// <summary> Searches for the node with the greatest key which is not greater than specified key. </summary>
+/// <returns> Pointer to the node, NULL if there is no such node. </returns>
+/// <param name="key"> in. The key or the value comparable with the keys. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class K> TreeNode<Key, Val, Augment>* Tree<Key, Val, Compare, Alloc, Augment>::floor_imp(const K& key) const
+{
+    // the last node where the path turned right is the floor
+    Node* pFloor = NULL;
+    for(Node* pNode = m_root; pNode;)
+    {
+        const int cmp = compare(key, pNode->m_key);
+        if(cmp == 0)
+            return pNode;
+        if(cmp > 0)
         {
-            if(!pNode->right())
-                return false;
+            pFloor = pNode;
             pNode = pNode->right();
         }
-        else if(cmp == 0)
-            return true;
+        else
+            pNode = pNode->left();
     }
-    return false;
+    return pFloor;
 }
 
-/// <summary> Accesses the node value by its key. Important: if node with specified key isn't exists in tree - node with default value will be inserted. </summary>
-/// <returns> The reference to node. </returns>
-/// <param name="key"> in. The key of node to be found. </param>
+/// <summary> Searches for the range of nodes with specified key. </summary>
+/// <returns> The pair of lower_bound and upper_bound. </returns>
+/// <param name="key"> in. The key or the value comparable with the keys. </param>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
-template<class Key, class Val> TreeNode<Key, Val>& Tree<Key, Val>::node_imp(const Key& key)
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class K> std::pair<typename Tree<Key, Val, Compare, Alloc, Augment>::Iterator, typename Tree<Key, Val, Compare, Alloc, Augment>::Iterator> Tree<Key, Val, Compare, Alloc, Augment>::equal_range_imp(const K& key) const
 {
-    // search for existing node
+    // keys are unique: the upper bound of found node is the next node
     Node* pNode;
-    if(find_imp(pNode, key))
-        return *pNode;
-
-    // case when tree is empty
-    if(!pNode)
+    if(!find_imp(pNode, key))
     {
-        assert(pNode == m_root);
-        m_root = new Node(key);
-        return *m_root;
+        Iterator it(bound_imp(key, false));
+        return std::make_pair(it, it);
     }
+    Iterator it(pNode);
+    it.next();
+    return std::make_pair(Iterator(pNode), it);
+}
 
-    // pNode - is a parent, create new child;
-    const int cmp = m_fnCmp(key, pNode->m_key);
-    assert(cmp != 0);
-    Node* pChild = new Node(key);
-    setChild(*pNode, *pChild, cmp < 0 ? Node::eLeft : Node::eRight);
+/// <summary> Calls the function for each node of subtree with key in range [lo, hi) in order of keys. </summary>
+/// <param name="pNode"> in. The root of subtree. </param>
+/// <param name="lo"> in. The lower bound of range (inclusive). </param>
+/// <param name="hi"> in. The upper bound of range (exclusive). </param>
+/// <param name="fn"> in. The function called as fn(const Key& key, Val& value). </param>
+/// <param name="bCheckLow"> in. False if all keys of subtree are known to be not less than the lower bound. </param>
+/// <param name="bCheckHigh"> in. False if all keys of subtree are known to be less than the upper bound. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class K, class Fn> void Tree<Key, Val, Compare, Alloc, Augment>::for_each_imp(Node* pNode, const K& lo, const K& hi, Fn& fn, bool bCheckLow, bool bCheckHigh)
+{
+    while(pNode)
+    {
+        // the node and its left subtree are below the range
+        if(bCheckLow && compare(pNode->m_key, lo) < 0)
+        {
+            pNode = pNode->right();
+            continue;
+        }
+        // the node and its right subtree are above the range
+        if(bCheckHigh && compare(pNode->m_key, hi) >= 0)
+        {
+            pNode = pNode->left();
+            continue;
+        }
 
-    // balance tree
-    update_balance(*pNode);
-    return *pChild;
+        // the node is in the range: its left subtree is below the upper bound, its right subtree is above the lower bound
+        for_each_imp(pNode->left(), lo, hi, fn, bCheckLow, false);
+        fn(pNode->m_key, pNode->m_value);
+        bCheckLow = false;
+        pNode = pNode->right();
+    }
 }
 
-/// <summary> Sets child for specified parent. </summary>
-/// <param name="parent"> inout. The parent node. </param>
-/// <param name="child"> inout. The child node. </param>
-/// <param name="b"> in. The branch which specified left/right child.  </param>
+/// <summary> Queries the depth of parallel recursion: about 4 tasks per thread, 0 if the pool has one thread. </summary>
+/// <returns> The number of levels which are forked. </returns>
+/// <param name="pool"> in. The thread pool. </param>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
-template<class Key, class Val> void Tree<Key, Val>::setChild(Node& parent, Node& child, typename Node::EBranch b) const
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> int Tree<Key, Val, Compare, Alloc, Augment>::parallel_depth(const TreeThreadPool& pool)
 {
-    assert(!parent.m_child[b]);
-    assert(b == Node::eLeft ? m_fnCmp(child.m_key, parent.m_key) < 0 : m_fnCmp(child.m_key, parent.m_key) > 0);
-    parent.m_child[b] = &child;
-    child.m_parent = &parent;
+    if(pool.size() < 2)
+        return 0;
+    int nDepth = 2;
+    for(size_t n = pool.size(); n > 1; n /= 2)
+        ++nDepth;
+    return nDepth;
 }
 
-/// <summary> Moves child from parent to another one. </summary>
-/// <param name="from"> inout. The source parent node. </param>
-/// <param name="bf"> in. The source branch. </param>
-/// <param name="to"> inout. The destination parent node.  </param>
-/// <param name="bt"> in. The destination branch. </param>
+/// <summary> Calls the function for each node of subtree in order of keys. </summary>
+/// <param name="pNode"> in. The root of subtree. </param>
+/// <param name="fn"> in. The function called as fn(const Key& key, Val& value). </param>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
-template<class Key, class Val> void Tree<Key, Val>::moveChild(Node& from, typename Node::EBranch bf, Node& to, typename Node::EBranch bt) const
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class Fn> void Tree<Key, Val, Compare, Alloc, Augment>::for_each_node(Node* pNode, Fn& fn)
 {
-    assert(&from != &to);
-
-    if(to.m_child[bt])
-        to.m_child[bt]->m_parent = NULL;
-
-    to.m_child[bt] = from.m_child[bf];
-    from.m_child[bf] = NULL;
-
-    if(to.m_child[bt])
+    for(; pNode; pNode = pNode->right())
     {
-        to.m_child[bt]->m_parent = &to;
-        assert(bt == Node::eLeft ? m_fnCmp(to.m_child[bt]->m_key, to.m_key) < 0 : m_fnCmp(to.m_child[bt]->m_key, to.m_key) > 0);
+        for_each_node(pNode->left(), fn);
+        fn(pNode->m_key, pNode->m_value);
     }
 }
 
-/// <summary> Moves node to specified parent. </summary>
-/// <param name="parent"> inout. The destination parent node. </param>
-/// <param name="bt"> in. The destination branch. </param>
-/// <param name="node"> inout. The node to be moved. </param>
+/// <summary> Calls the function for each node of subtree, the subtrees of the top levels are processed in parallel. </summary>
+/// <param name="pNode"> in. The root of subtree. </param>
+/// <param name="fn"> in. The function called as fn(const Key& key, Val& value). </param>
+/// <param name="nDepth"> in. The number of levels to be forked. </param>
+/// <param name="pool"> in. The thread pool. </param>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
-template<class Key, class Val> void Tree<Key, Val>::moveNode(Node& parent, typename Node::EBranch b, Node& node)
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class Fn> void Tree<Key, Val, Compare, Alloc, Augment>::parallel_for_each_imp(Node* pNode, Fn& fn, int nDepth, TreeThreadPool& pool)
 {
-    if(Node* pParentTo = node.parent())
-    {
-        const Node::EBranch bt = &node == pParentTo->left() ? Node::eLeft : Node::eRight;
-        moveChild(parent, b, *pParentTo, bt);
-    }
-    else
+    // subtrees are small for parallel processing below this height
+    const int c_nMinParallelHeight = 10;
+
+    if(!pNode || nDepth <= 0 || pNode->m_height <= c_nMinParallelHeight)
     {
-        // node is root
-        m_root = parent.m_child[b];
-        if(m_root)
-            m_root->m_parent = NULL;
-        parent.m_child[b] = NULL;
+        for_each_node(pNode, fn);
+        return;
     }
+    pool.invoke(
+        [&]() { parallel_for_each_imp(pNode->left(), fn, nDepth - 1, pool); fn(pNode->m_key, pNode->m_value); },
+        [&]() { parallel_for_each_imp(pNode->right(), fn, nDepth - 1, pool); });
 }
 
-/// <summary> Removes node with specified key from the tree. </summary>
-/// <param name="key"> in. The key of node to be removed. </param>
+/// <summary> Reduces the nodes of subtree in order of keys, the subtrees of the top levels are processed in parallel. </summary>
+/// <returns> The result of the subtree: combine(left, map(node), right). </returns>
+/// <param name="pNode"> in. The root of subtree, not NULL. </param>
+/// <param name="map"> in. The function called as map(const Key& key, const Val& value). </param>
+/// <param name="combine"> in. The associative function called as combine(const T& a, const T& b). </param>
+/// <param name="nDepth"> in. The number of levels to be forked. </param>
+/// <param name="pool"> in. The thread pool. </param>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
-template<class Key, class Val> void Tree<Key, Val>::erase(const Key& key)
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class T, class Map, class Combine> T Tree<Key, Val, Compare, Alloc, Augment>::parallel_reduce_imp(const Node* pNode, Map& map, Combine& combine, int nDepth, TreeThreadPool& pool)
 {
-    // empty tree
-    if(!m_root)
-        return;
+    // subtrees are small for parallel processing below this height
+    const int c_nMinParallelHeight = 10;
 
-    // search for node 
-    Node* pNode;
-    if(!find_imp(pNode, key))
-        return;
-    
-    // remove pNode from tree
-    Node* pNodeUpdate = NULL;
-    if(Node* pMin = pNode->right())
+    const Node* pLeft = pNode->m_child[Node::eLeft];
+    const Node* pRight = pNode->m_child[Node::eRight];
+    T result = map(pNode->m_key, static_cast<const Val&>(pNode->m_value));
+    if(pLeft && pRight && nDepth > 0 && pNode->m_height > c_nMinParallelHeight)
     {
-        // search for minimal node in right branch
-        const Node::EBranch branchMin = pMin->left() ? Node::eLeft : Node::eRight;
-        while(pMin->left())
-            pMin = pMin->left();
-        
-        Node& parentMin = *pMin->parent();
-
-        // replace pNode by pMin
-        moveNode(parentMin, branchMin, *pNode);
-
-        // replace pMin by pMin->right
-        moveChild(*pMin, Node::eRight, parentMin, branchMin);
+        // T may have no default constructor, so the result of the right subtree is kept on heap
+        std::unique_ptr<T> pRightResult;
+        pool.invoke(
+            [&]() { result = combine(parallel_reduce_imp<T>(pLeft, map, combine, nDepth - 1, pool), result); },
+            [&]() { pRightResult.reset(new T(parallel_reduce_imp<T>(pRight, map, combine, nDepth - 1, pool))); });
+        return combine(result, *pRightResult);
+    }
 
-        // move children from pNode to pMin
-        moveChild(*pNode, Node::eLeft, *pMin, Node::eLeft);
-        moveChild(*pNode, Node::eRight, *pMin, Node::eRight);
+    if(pLeft)
+        result = combine(parallel_reduce_imp<T>(pLeft, map, combine, 0, pool), result);
+    if(pRight)
+        result = combine(result, parallel_reduce_imp<T>(pRight, map, combine, 0, pool));
+    return result;
+}
 
-        // update balance starting from parent of pMin
-        pNodeUpdate = pMin;
-    }
-    else
+/// <summary> 
+/// Aggregates values of nodes of the subtree with keys in range [lo, hi). 
+/// When the path to the bounds splits, each side descends along one path taking the aggregates of subtrees which are entirely in the range. 
+/// </summary>
+/// <returns> The aggregate. </returns>
+/// <param name="pNode"> in. The root of subtree. </param>
+/// <param name="lo"> in. The lower bound of range (inclusive). </param>
+/// <param name="hi"> in. The upper bound of range (exclusive). </param>
+/// <param name="bCheckLow"> in. False if all keys of subtree are known to be not less than the lower bound. </param>
+/// <param name="bCheckHigh"> in. False if all keys of subtree are known to be less than the upper bound. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class K, class A> typename A::value_type Tree<Key, Val, Compare, Alloc, Augment>::query_imp(const Node* pNode, const K& lo, const K& hi, bool bCheckLow, bool bCheckHigh) const
+{
+    while(pNode)
     {
-        // update balance starting from parent
-        pNodeUpdate = pNode->parent();
+        // the subtree is entirely in the range
+        if(!bCheckLow && !bCheckHigh)
+            return pNode->m_aggregate;
 
-        // if right branch is empty, replace pNode by left child
-        moveNode(*pNode, Node::eLeft, *pNode);
+        // the node is outside of the range with one of subtrees
+        if(bCheckLow && compare(pNode->m_key, lo) < 0)
+            pNode = pNode->m_child[Node::eRight];
+        else if(bCheckHigh && compare(pNode->m_key, hi) >= 0)
+            pNode = pNode->m_child[Node::eLeft];
+        else
+        {
+            const typename A::value_type left = query_imp<K, A>(pNode->m_child[Node::eLeft], lo, hi, bCheckLow, false);
+            const typename A::value_type right = query_imp<K, A>(pNode->m_child[Node::eRight], lo, hi, false, bCheckHigh);
+            return A::Monoid::combine(A::Monoid::combine(left, A::Monoid::lift(pNode->m_key, pNode->m_value)), right);
+        }
     }
+    return A::Monoid::identity();
+}
 
-    // destroy node
-    assert(pNode->left() == NULL && pNode->right() == NULL && pNode->parent() == NULL);
-    delete pNode;
-
-    // update tree balance
-    if(pNodeUpdate)
-        update_balance(*pNodeUpdate);
+/// <summary> Counts nodes with keys less than specified key: sums sizes of left subtrees on the path to the key. </summary>
+/// <returns> The number of nodes. </returns>
+/// <param name="key"> in. The key or the value comparable with the keys. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> template<class K> size_t Tree<Key, Val, Compare, Alloc, Augment>::rank_imp(const K& key) const
+{
+    size_t nRank = 0;
+    for(Node* pNode = m_root; pNode;)
+    {
+        const int cmp = compare(key, pNode->m_key);
+        if(cmp == 0)
+            return nRank + Augment::count(pNode->left());
+        if(cmp > 0)
+        {
+            nRank += Augment::count(pNode->left()) + 1;
+            pNode = pNode->right();
+        }
+        else
+            pNode = pNode->left();
+    }
+    return nRank;
 }
 
 /// <summary> 
@@ -421,7 +2916,7 @@ template<class Key, class Val> void Tree<Key, Val>::erase(const Key& key)
 /// </summary>
 /// <param name="sFile"> in. The output file name. </param>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
-template<class Key, class Val> void Tree<Key, Val>::saveToGv(const char* sFile)
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::saveToGv(const char* sFile)
 {
     std::fstream file;
     file.open(sFile, std::ios_base::out | std::ios_base::trunc);
@@ -429,12 +2924,12 @@ template<class Key, class Val> void Tree<Key, Val>::saveToGv(const char* sFile)
     file << "digraph tree\n{";
     
     // list of nodes with labels
-    for(Tree<int, int>::Iterator it = begin(); !it.isEnd(); it.next())
+    for(Iterator it = begin(); !it.isEnd(); it.next())
         file << "\n node_" << it.key() << " [label=\"" << it.key() << " h" << int(it.m_node->m_height) << " b" << it.m_node->balance() << "\"];";
 
     // lenks between nodes
     file << "\n";
-    for(Tree<int, int>::Iterator it = begin(); !it.isEnd(); it.next())
+    for(Iterator it = begin(); !it.isEnd(); it.next())
     {
         if(it.m_node->left())
             file << "\n node_" << it.m_node->m_key << " -> node_" << it.m_node->left()->m_key;
@@ -448,7 +2943,7 @@ template<class Key, class Val> void Tree<Key, Val>::saveToGv(const char* sFile)
 /// <returns> The pointer to new root node. </returns>
 /// <param name="node"> in. The node to be balanced. </param>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
-template<class Key, class Val> TreeNode<Key, Val>* Tree<Key, Val>::rotate_left(Node& node)
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> TreeNode<Key, Val, Augment>* Tree<Key, Val, Compare, Alloc, Augment>::rotate_left(Node& node)
 {
     Node& right = *node.right();
     moveNode(node, Node::eRight, node);
@@ -457,6 +2952,7 @@ template<class Key, class Val> TreeNode<Key, Val>* Tree<Key, Val>::rotate_left(N
     
     node.update_height();
     right.update_height();
+    ++m_stats.m_nRotation;
     return &right;
 }
 
@@ -464,7 +2960,7 @@ template<class Key, class Val> TreeNode<Key, Val>* Tree<Key, Val>::rotate_left(N
 /// <returns> The pointer to new root node. </returns>
 /// <param name="node"> in. The node to be balanced. </param>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
-template<class Key, class Val> TreeNode<Key, Val>* Tree<Key, Val>::rotate_right(Node& node)
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> TreeNode<Key, Val, Augment>* Tree<Key, Val, Compare, Alloc, Augment>::rotate_right(Node& node)
 {
     Node& left = *node.left();
     moveNode(node, Node::eLeft, node);
@@ -473,33 +2969,101 @@ template<class Key, class Val> TreeNode<Key, Val>* Tree<Key, Val>::rotate_right(
 
     node.update_height();
     left.update_height();
+    ++m_stats.m_nRotation;
     return &left;
 }
 
-/// <summary> Perofrms balancing of the tree from the specified node till root. </summary>
+/// <summary> Restores balance of the node by single or double rotation if its branches differ in height by 2. </summary>
+/// <returns> The pointer to root node of the balanced subtree. </returns>
 /// <param name="node"> in. The node to be balanced. </param>
 /// <remarks> Author: Vladimir Zelyonkin </remarks>
-template<class Key, class Val> void Tree<Key, Val>::update_balance(Node& node)
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> TreeNode<Key, Val, Augment>* Tree<Key, Val, Compare, Alloc, Augment>::rebalance(Node& node)
+{
+    if(node.balance() == -2)
+    {
+        if(node.right()->balance() > 0)
+            rotate_right(*node.right());
+        return rotate_left(node);
+    }
+    if(node.balance() == 2)
+    {
+        if(node.left()->balance() < 0)
+            rotate_left(*node.left());
+        return rotate_right(node);
+    }
+    return &node;
+}
+
+/// <summary> 
+/// Perofrms balancing of the tree after insertion from the specified node towards root. 
+/// Stops at the first node which height is unchanged or after the first rotation: rotation restores the height of subtree before insertion. 
+/// </summary>
+/// <param name="node"> in. The parent of inserted node. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::retrace_insert(Node& node)
 {
-    for(Node* pNode = &node; pNode;)
+    for(Node* pNode = &node; pNode; pNode = pNode->parent())
     {
+        ++m_stats.m_nRetrace;
+
         // update node balance
+        const unsigned char height = pNode->m_height;
         pNode->update_height();
 
         // rebalance
-        if(pNode->balance() == -2)
-        {
-            if(pNode->right() && pNode->right()->balance() > 0)
-                rotate_right(*pNode->right());
-            pNode = rotate_left(*pNode);
-        }
-        else if(pNode->balance() == 2)
+        const int balance = pNode->balance();
+        if(balance == -2 || balance == 2)
         {
-            if(pNode->left() && pNode->left()->balance() < 0)
-                rotate_left(*pNode->left());
-            pNode = rotate_right(*pNode);
+            rebalance(*pNode);
+            break;
         }
-        else
-            pNode = pNode->parent();
+        if(pNode->m_height == height)
+            break;
+    }
+}
+
+/// <summary> 
+/// Perofrms balancing of the tree after erasing from the specified node towards root. 
+/// Stops at the first subtree which height is unchanged. 
+/// </summary>
+/// <param name="node"> in. The lowest node which branch was changed. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> void Tree<Key, Val, Compare, Alloc, Augment>::retrace_erase(Node& node)
+{
+    for(Node* pNode = &node; pNode; pNode = pNode->parent())
+    {
+        ++m_stats.m_nRetrace;
+
+        // update node balance
+        const unsigned char height = pNode->m_height;
+        pNode->update_height();
+
+        // rebalance, the subtree gets new root
+        pNode = rebalance(*pNode);
+        if(pNode->m_height == height)
+            break;
     }
 }
+
+/// <summary> Checks structure of the subtree. </summary>
+/// <returns> Height of the subtree, -1 if the subtree is invalid. </returns>
+/// <param name="pNode"> in. The root of subtree. </param>
+/// <param name="pParent"> in. The expected parent of the root. </param>
+/// <param name="pLow"> in. The node which key is lower than all keys of subtree, NULL if there is no lower bound. </param>
+/// <param name="pHigh"> in. The node which key is greater than all keys of subtree, NULL if there is no upper bound. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc, class Augment> int Tree<Key, Val, Compare, Alloc, Augment>::check_imp(const Node* pNode, const Node* pParent, const Node* pLow, const Node* pHigh) const
+{
+    if(!pNode)
+        return 0;
+    if(pNode->m_parent != pParent)
+        return -1;
+    if((pLow && compare(pLow->m_key, pNode->m_key) >= 0) || (pHigh && compare(pNode->m_key, pHigh->m_key) >= 0))
+        return -1;
+
+    const int left = check_imp(pNode->m_child[Node::eLeft], pNode, pLow, pNode);
+    const int right = check_imp(pNode->m_child[Node::eRight], pNode, pNode, pHigh);
+    if(left < 0 || right < 0 || left - right > 1 || right - left > 1 || pNode->m_height != 1 + std::max(left, right) || !Augment::check(*pNode))
+        return -1;
+    return pNode->m_height;
+}
\ No newline at end of file
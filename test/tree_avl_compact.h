@@ -0,0 +1,569 @@
+#pragma once
+#include "tree_avl.h"
+#include <stdint.h>
+#include <stdexcept>
+
+/// <summary>
+/// Implements compact tree node: the nodes are linked by 32-bit indices in the array of nodes,
+/// height of the node is packed in the high bits of the parent index.
+/// </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val> class TreeCompactNode
+{
+public:
+    // Enumeration for manupulations with left/right children of the node
+    enum EBranch { eLeft = 0, eRight = 1 };
+
+    // number of bits for height and for parent index
+    enum { eHeightBits = 6, eIndexBits = 32 - eHeightBits };
+
+    // index of the sentinel node used as NULL link (the sentinel has zero height)
+    static const uint32_t c_nil = 0;
+    // maximal index of node
+    static const uint32_t c_maxIndex = (uint32_t(1) << eIndexBits) - 1;
+
+public:
+    // constructors
+    TreeCompactNode() : m_link(0), m_value(), m_key() { m_child[eLeft] = m_child[eRight] = c_nil; }
+    TreeCompactNode(const Key& key) : m_link(1 << eIndexBits), m_value(), m_key(key) { m_child[eLeft] = m_child[eRight] = c_nil; }
+
+    // access to parent index and height
+    uint32_t parent() const { return m_link & c_maxIndex; }
+    void set_parent(uint32_t parent) { m_link = (m_link & ~c_maxIndex) | parent; }
+    unsigned height() const { return m_link >> eIndexBits; }
+    void set_height(unsigned height) { m_link = (m_link & c_maxIndex) | (uint32_t(height) << eIndexBits); }
+
+    // access to left/right nodes
+    uint32_t left() const { return m_child[eLeft]; }
+    uint32_t right() const { return m_child[eRight]; }
+
+public:
+    // parent node index and height of the node in tree (for an empty node height = 1)
+    uint32_t m_link;
+    // left/fight child
+    uint32_t m_child[2];
+    // node value
+    Val m_value;
+    // node key
+    Key m_key;
+};
+
+/// <summary>
+/// The AVL tree with compact storage of nodes: nodes live in the contiguous array and link each other by 32-bit indices.
+/// The public API is the same as Tree has.
+/// Important: insertion may move the array of nodes, so pointers and references to values are invalidated by insertion.
+/// Number of nodes is limited by TreeCompactNode::c_maxIndex.
+/// Val should be default constructible and assignable: the erased nodes stay in the array, their values are reset to Val() to release resources.
+/// </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare = TreeCompare<Key> > class TreeCompact
+{
+public:
+    typedef TreeCompactNode<Key, Val> Node;
+
+public:
+    /// <summary> Tree iterator. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    class Iterator
+    {
+        friend class TreeCompact<Key, Val, Compare>;
+    public:
+
+        /// <summary> Constructor </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        Iterator(TreeCompact* pTree, uint32_t node) : m_pTree(pTree), m_node(node) {}
+
+        /// <summary> Moves iterator to next node in the tree. </summary>
+        /// <returns> True if the curent node isn't end </returns>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        bool next();
+
+        /// <summary> Checks whether the node is end node of the tree. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        bool isEnd() const { return m_node == Node::c_nil; }
+
+        /// <summary> Queries the node key. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        const Key& key() const { return m_pTree->m_aNode[m_node].m_key; }
+
+        /// <summary> Accesses the node value. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        Val& value() { return m_pTree->m_aNode[m_node].m_value; }
+
+    private:
+        TreeCompact* m_pTree;
+        uint32_t m_node;
+    };
+
+    /// <summary> Constructor </summary>
+    /// <param name="cmp"> in. Optional. The comparator of keys. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    explicit TreeCompact(const Compare& cmp = Compare()) : m_cmp(cmp), m_aNode(1), m_root(Node::c_nil), m_free(Node::c_nil) {}
+
+    /// <summary> Searches for node with specified key. </summary>
+    /// <returns> Pointer to node value, NULL if specified key isn't found in the tree. </returns>
+    /// <param name="key"> in. The key of node to be found. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Val* find(const Key& key)
+    {
+        uint32_t node;
+        return find_imp(node, key) ? &m_aNode[node].m_value : NULL;
+    }
+
+    /// <summary> Searches for node with specified key. </summary>
+    /// <returns> Pointer to node value, NULL if specified key isn't found in the tree. </returns>
+    /// <param name="key"> in. The key of node to be found. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    const Val* find(const Key& key) const
+    {
+        uint32_t node;
+        return find_imp(node, key) ? &m_aNode[node].m_value : NULL;
+    }
+
+    /// <summary> Removes node with specified key from the tree. </summary>
+    /// <param name="key"> in. The key of node to be removed. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void erase(const Key& key);
+
+    /// <summary> Inserts new node into the tree. </summary>
+    /// <param name="key"> in. The node key. </param>
+    /// <param name="val"> in. The node value. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void insert(const Key& key, const Val& val) { m_aNode[node_imp(key)].m_value = val; }
+
+    /// <summary> Inserts new node into the tree. </summary>
+    /// <param name="pair"> in. The node key and value. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void insert(const std::pair<Key, Val>& pair) { insert(pair.first, pair.second); }
+
+    /// <summary> Accesses the node value by its key. Important: if node with specified key isn't exists in tree - node with default value will be inserted. </summary>
+    /// <returns> The reference to node value. </returns>
+    /// <param name="key"> in. The key of node to be found. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Val& operator[](const Key& key) { return m_aNode[node_imp(key)].m_value; }
+
+    /// <summary> Queries the tree iterator. </summary>
+    /// <returns> The iteraror. </returns>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Iterator begin();
+
+    /// <summary> Removes all nodes from the tree. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void clear();
+
+    /// <summary> Reserves memory for specified number of nodes. </summary>
+    /// <param name="nNode"> in. The number of nodes. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void reserve(size_t nNode) { m_aNode.reserve(nNode + 1); }
+
+    /// <summary> Saves the tree to graphviz-format file, see Tree::saveToGv. </summary>
+    /// <param name="sFile"> in. The output file name. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void saveToGv(const char* sFile);
+
+    /// <summary> Checks structure of the tree: order of keys, links to parents, heights and balance of nodes. </summary>
+    /// <returns> True if the tree is valid AVL tree. </returns>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    bool isValid() const { return height(Node::c_nil) == 0 && check_imp(m_root, Node::c_nil, Node::c_nil, Node::c_nil) >= 0; }
+
+private:
+    // three-way comparison of keys by the comparator of any style
+    int compare(const Key& a, const Key& b) const { return tree_compare(m_cmp, a, b); }
+
+    // access to node height and balance
+    unsigned height(uint32_t node) const { return m_aNode[node].height(); }
+    int balance(uint32_t node) const { return int(height(m_aNode[node].left())) - int(height(m_aNode[node].right())); }
+    void update_height(uint32_t node) { m_aNode[node].set_height(1 + std::max(height(m_aNode[node].left()), height(m_aNode[node].right()))); }
+
+    uint32_t create_node(const Key& key);
+    void destroy_node(uint32_t node);
+    bool find_imp(uint32_t& node, const Key& key) const;
+    uint32_t node_imp(const Key& key);
+    void update_balance(uint32_t node);
+    void setChild(uint32_t parent, uint32_t child, typename Node::EBranch b);
+    void moveChild(uint32_t from, typename Node::EBranch bf, uint32_t to, typename Node::EBranch bt);
+    void moveNode(uint32_t parent, typename Node::EBranch bf, uint32_t toNode);
+    uint32_t rotate_left(uint32_t node);
+    uint32_t rotate_right(uint32_t node);
+    int check_imp(uint32_t node, uint32_t parent, uint32_t low, uint32_t high) const;
+
+    // copying and assignment are forbidden
+    TreeCompact(const TreeCompact<Key, Val, Compare>&);
+    TreeCompact<Key, Val, Compare>& operator=(const TreeCompact<Key, Val, Compare>&) { return *this; }
+private:
+    const Compare m_cmp;
+    // array of nodes, the first one is the sentinel
+    std::vector<Node> m_aNode;
+    uint32_t m_root;
+    // head of the list of erased nodes (linked by left child)
+    uint32_t m_free;
+};
+
+
+/// <summary> Moves iterator to next node in the tree. </summary>
+/// <returns> True if the curent node isn't end </returns>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare> bool TreeCompact<Key, Val, Compare>::Iterator::next()
+{
+    if(m_node == Node::c_nil)
+        return false;
+
+    const std::vector<Node>& aNode = m_pTree->m_aNode;
+
+    // minimal element in right branch
+    if(aNode[m_node].right() != Node::c_nil)
+    {
+        m_node = aNode[m_node].right();
+        while(aNode[m_node].left() != Node::c_nil)
+            m_node = aNode[m_node].left();
+        return true;
+    }
+
+    // parent node
+    uint32_t parent = aNode[m_node].parent();
+    while(parent != Node::c_nil && aNode[parent].right() == m_node)
+    {
+        m_node = parent;
+        parent = aNode[m_node].parent();
+    }
+    m_node = parent;
+    return m_node != Node::c_nil;
+}
+
+/// <summary> Queries the tree iterator. </summary>
+/// <returns> The iteraror. </returns>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare> typename TreeCompact<Key, Val, Compare>::Iterator TreeCompact<Key, Val, Compare>::begin()
+{
+    uint32_t node = m_root;
+    if(node != Node::c_nil)
+    {
+        while(m_aNode[node].left() != Node::c_nil)
+            node = m_aNode[node].left();
+    }
+    return Iterator(this, node);
+}
+
+/// <summary> Removes all nodes from the tree. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare> void TreeCompact<Key, Val, Compare>::clear()
+{
+    m_aNode.resize(1);
+    m_root = m_free = Node::c_nil;
+}
+
+/// <summary> Creates new node: reuses erased node or appends new one to the array. </summary>
+/// <returns> Index of the created node. </returns>
+/// <param name="key"> in. The node key. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare> uint32_t TreeCompact<Key, Val, Compare>::create_node(const Key& key)
+{
+    if(m_free != Node::c_nil)
+    {
+        const uint32_t node = m_free;
+        m_free = m_aNode[node].left();
+        m_aNode[node] = Node(key);
+        return node;
+    }
+
+    if(m_aNode.size() > Node::c_maxIndex)
+        throw std::length_error("TreeCompact: too many nodes");
+    m_aNode.push_back(Node(key));
+    return uint32_t(m_aNode.size() - 1);
+}
+
+/// <summary> Adds the node to the list of erased nodes. </summary>
+/// <param name="node"> in. The node to be destroyed. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare> void TreeCompact<Key, Val, Compare>::destroy_node(uint32_t node)
+{
+    // release resources of value, the key is kept till reuse of the node
+    m_aNode[node].m_value = Val();
+    m_aNode[node].m_child[Node::eLeft] = m_free;
+    m_free = node;
+}
+
+/// <summary> Searches for node with specified key. </summary>
+/// <returns> True if node found. </returns>
+/// <param name="node"> out. Index of node if node found, otherwise - index of parent node for node to be inserted. </param>
+/// <param name="key"> in. The key to be found. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare> bool TreeCompact<Key, Val, Compare>::find_imp(uint32_t& node, const Key& key) const
+{
+    node = m_root;
+    while(node != Node::c_nil)
+    {
+        const Node& n = m_aNode[node];
+        const int cmp = compare(key, n.m_key);
+        if(cmp == 0)
+            return true;
+
+        // select the branch without extra conditional jumps
+        const uint32_t child = n.m_child[cmp > 0];
+        if(child == Node::c_nil)
+            return false;
+        node = child;
+    }
+    return false;
+}
+
+/// <summary> Accesses the node by its key. Important: if node with specified key isn't exists in tree - node with default value will be inserted. </summary>
+/// <returns> Index of the node. </returns>
+/// <param name="key"> in. The key of node to be found. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare> uint32_t TreeCompact<Key, Val, Compare>::node_imp(const Key& key)
+{
+    // search for existing node
+    uint32_t node;
+    if(find_imp(node, key))
+        return node;
+
+    // case when tree is empty
+    const uint32_t child = create_node(key);
+    if(node == Node::c_nil)
+    {
+        assert(m_root == Node::c_nil);
+        m_root = child;
+        return child;
+    }
+
+    // node - is a parent
+    const int cmp = compare(key, m_aNode[node].m_key);
+    assert(cmp != 0);
+    setChild(node, child, cmp < 0 ? Node::eLeft : Node::eRight);
+
+    // balance tree
+    update_balance(node);
+    return child;
+}
+
+/// <summary> Sets child for specified parent. </summary>
+/// <param name="parent"> in. The parent node. </param>
+/// <param name="child"> in. The child node. </param>
+/// <param name="b"> in. The branch which specified left/right child.  </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare> void TreeCompact<Key, Val, Compare>::setChild(uint32_t parent, uint32_t child, typename Node::EBranch b)
+{
+    assert(m_aNode[parent].m_child[b] == Node::c_nil);
+    assert(b == Node::eLeft ? compare(m_aNode[child].m_key, m_aNode[parent].m_key) < 0 : compare(m_aNode[child].m_key, m_aNode[parent].m_key) > 0);
+    m_aNode[parent].m_child[b] = child;
+    m_aNode[child].set_parent(parent);
+}
+
+/// <summary> Moves child from parent to another one. </summary>
+/// <param name="from"> in. The source parent node. </param>
+/// <param name="bf"> in. The source branch. </param>
+/// <param name="to"> in. The destination parent node.  </param>
+/// <param name="bt"> in. The destination branch. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare> void TreeCompact<Key, Val, Compare>::moveChild(uint32_t from, typename Node::EBranch bf, uint32_t to, typename Node::EBranch bt)
+{
+    assert(from != to);
+
+    if(m_aNode[to].m_child[bt] != Node::c_nil)
+        m_aNode[m_aNode[to].m_child[bt]].set_parent(Node::c_nil);
+
+    const uint32_t child = m_aNode[from].m_child[bf];
+    m_aNode[to].m_child[bt] = child;
+    m_aNode[from].m_child[bf] = Node::c_nil;
+
+    if(child != Node::c_nil)
+    {
+        m_aNode[child].set_parent(to);
+        assert(bt == Node::eLeft ? compare(m_aNode[child].m_key, m_aNode[to].m_key) < 0 : compare(m_aNode[child].m_key, m_aNode[to].m_key) > 0);
+    }
+}
+
+/// <summary> Moves node to specified parent. </summary>
+/// <param name="parent"> in. The destination parent node. </param>
+/// <param name="b"> in. The destination branch. </param>
+/// <param name="node"> in. The node to be moved. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare> void TreeCompact<Key, Val, Compare>::moveNode(uint32_t parent, typename Node::EBranch b, uint32_t node)
+{
+    const uint32_t parentTo = m_aNode[node].parent();
+    if(parentTo != Node::c_nil)
+    {
+        const typename Node::EBranch bt = node == m_aNode[parentTo].left() ? Node::eLeft : Node::eRight;
+        moveChild(parent, b, parentTo, bt);
+    }
+    else
+    {
+        // node is root
+        m_root = m_aNode[parent].m_child[b];
+        if(m_root != Node::c_nil)
+            m_aNode[m_root].set_parent(Node::c_nil);
+        m_aNode[parent].m_child[b] = Node::c_nil;
+    }
+}
+
+/// <summary> Removes node with specified key from the tree. </summary>
+/// <param name="key"> in. The key of node to be removed. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare> void TreeCompact<Key, Val, Compare>::erase(const Key& key)
+{
+    // search for node
+    uint32_t node;
+    if(!find_imp(node, key))
+        return;
+
+    // remove node from tree
+    uint32_t nodeUpdate = Node::c_nil;
+    uint32_t min = m_aNode[node].right();
+    if(min != Node::c_nil)
+    {
+        // search for minimal node in right branch
+        const typename Node::EBranch branchMin = m_aNode[min].left() != Node::c_nil ? Node::eLeft : Node::eRight;
+        while(m_aNode[min].left() != Node::c_nil)
+            min = m_aNode[min].left();
+
+        const uint32_t parentMin = m_aNode[min].parent();
+
+        // replace node by min
+        moveNode(parentMin, branchMin, node);
+
+        // replace min by min->right
+        moveChild(min, Node::eRight, parentMin, branchMin);
+
+        // move children from node to min, min takes the height of node to let retrace detect the change
+        moveChild(node, Node::eLeft, min, Node::eLeft);
+        moveChild(node, Node::eRight, min, Node::eRight);
+        m_aNode[min].set_height(height(node));
+
+        // update balance starting from the lowest changed node
+        nodeUpdate = parentMin == node ? min : parentMin;
+    }
+    else
+    {
+        // update balance starting from parent
+        nodeUpdate = m_aNode[node].parent();
+
+        // if right branch is empty, replace node by left child
+        moveNode(node, Node::eLeft, node);
+    }
+
+    // destroy node
+    assert(m_aNode[node].left() == Node::c_nil && m_aNode[node].right() == Node::c_nil && m_aNode[node].parent() == Node::c_nil);
+    destroy_node(node);
+
+    // update tree balance
+    if(nodeUpdate != Node::c_nil)
+        update_balance(nodeUpdate);
+}
+
+/// <summary> Saves the tree to graphviz-format file, see Tree::saveToGv. </summary>
+/// <param name="sFile"> in. The output file name. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare> void TreeCompact<Key, Val, Compare>::saveToGv(const char* sFile)
+{
+    std::fstream file;
+    file.open(sFile, std::ios_base::out | std::ios_base::trunc);
+
+    file << "digraph tree\n{";
+
+    // list of nodes with labels
+    for(Iterator it = begin(); !it.isEnd(); it.next())
+        file << "\n node_" << it.key() << " [label=\"" << it.key() << " h" << height(it.m_node) << " b" << balance(it.m_node) << "\"];";
+
+    // lenks between nodes
+    file << "\n";
+    for(Iterator it = begin(); !it.isEnd(); it.next())
+    {
+        const Node& node = m_aNode[it.m_node];
+        if(node.left() != Node::c_nil)
+            file << "\n node_" << node.m_key << " -> node_" << m_aNode[node.left()].m_key;
+        if(node.right() != Node::c_nil)
+            file << "\n node_" << node.m_key << " -> node_" << m_aNode[node.right()].m_key;
+    }
+    file << "\n}";
+}
+
+/// <summary> Makes small left rotation around the specified node. </summary>
+/// <returns> Index of new root node. </returns>
+/// <param name="node"> in. The node to be balanced. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare> uint32_t TreeCompact<Key, Val, Compare>::rotate_left(uint32_t node)
+{
+    const uint32_t right = m_aNode[node].right();
+    moveNode(node, Node::eRight, node);
+    moveChild(right, Node::eLeft, node, Node::eRight);
+    setChild(right, node, Node::eLeft);
+
+    update_height(node);
+    update_height(right);
+    return right;
+}
+
+/// <summary> Makes small right rotation around the specified node. </summary>
+/// <returns> Index of new root node. </returns>
+/// <param name="node"> in. The node to be balanced. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare> uint32_t TreeCompact<Key, Val, Compare>::rotate_right(uint32_t node)
+{
+    const uint32_t left = m_aNode[node].left();
+    moveNode(node, Node::eLeft, node);
+    moveChild(left, Node::eRight, node, Node::eLeft);
+    setChild(left, node, Node::eRight);
+
+    update_height(node);
+    update_height(left);
+    return left;
+}
+
+/// <summary> 
+/// Perofrms balancing of the tree from the specified node towards root after insertion or erasing. 
+/// Stops at the first subtree which height is unchanged: after insertion the rotation restores the height of subtree before insertion. 
+/// </summary>
+/// <param name="node"> in. The lowest node which branch was changed. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare> void TreeCompact<Key, Val, Compare>::update_balance(uint32_t node)
+{
+    while(node != Node::c_nil)
+    {
+        // update node balance
+        const unsigned h = height(node);
+        update_height(node);
+
+        // rebalance
+        const int b = balance(node);
+        if(b == -2)
+        {
+            if(balance(m_aNode[node].right()) > 0)
+                rotate_right(m_aNode[node].right());
+            node = rotate_left(node);
+        }
+        else if(b == 2)
+        {
+            if(balance(m_aNode[node].left()) < 0)
+                rotate_left(m_aNode[node].left());
+            node = rotate_right(node);
+        }
+        if(height(node) == h)
+            break;
+        node = m_aNode[node].parent();
+    }
+}
+
+/// <summary> Checks structure of the subtree. </summary>
+/// <returns> Height of the subtree, -1 if the subtree is invalid. </returns>
+/// <param name="node"> in. The root of subtree. </param>
+/// <param name="parent"> in. The expected parent of the root. </param>
+/// <param name="low"> in. The node which key is lower than all keys of subtree, c_nil if there is no lower bound. </param>
+/// <param name="high"> in. The node which key is greater than all keys of subtree, c_nil if there is no upper bound. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare> int TreeCompact<Key, Val, Compare>::check_imp(uint32_t node, uint32_t parent, uint32_t low, uint32_t high) const
+{
+    if(node == Node::c_nil)
+        return 0;
+    const Node& n = m_aNode[node];
+    if(n.parent() != parent)
+        return -1;
+    if((low != Node::c_nil && compare(m_aNode[low].m_key, n.m_key) >= 0) || (high != Node::c_nil && compare(n.m_key, m_aNode[high].m_key) >= 0))
+        return -1;
+
+    const int left = check_imp(n.left(), node, low, node);
+    const int right = check_imp(n.right(), node, node, high);
+    if(left < 0 || right < 0 || left - right > 1 || right - left > 1 || int(n.height()) != 1 + std::max(left, right))
+        return -1;
+    return int(n.height());
+}
@@ -0,0 +1,238 @@
+#pragma once
+#include "tree_avl.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/// <summary> Counts trailing zero bits of the non-zero number. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+inline int tree_trailing_zeros(size_t x)
+{
+    assert(x != 0);
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long nBit;
+    _BitScanForward64(&nBit, x);
+    return int(nBit);
+#elif defined(_MSC_VER)
+    unsigned long nBit;
+    _BitScanForward(&nBit, static_cast<unsigned long>(x));
+    return int(nBit);
+#elif defined(__GNUC__)
+    return __builtin_ctzll(x);
+#else
+    int nBit = 0;
+    for(; !(x & 1); x >>= 1)
+        ++nBit;
+    return nBit;
+#endif
+}
+
+/// <summary>
+/// The immutable snapshot of the tree for read-mostly data, made by Tree::freeze(). The keys are stored in one array in order of
+/// breadth-first traversal of the perfectly balanced tree (Eytzinger layout): the children of the slot k are the slots 2k and 2k + 1,
+/// so the search needs no links and the top levels share few cache lines. The values are stored in the parallel array.
+/// The search is branch-free: the next slot is computed from the result of comparison, the slots four levels ahead (for 4-byte keys)
+/// occupy one cache line which is prefetched while the levels above are compared.
+/// </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare> class TreeFrozen
+{
+public:
+    /// <summary> The snapshot iterator, visits the keys in order. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    class Iterator
+    {
+        friend class TreeFrozen<Key, Val, Compare>;
+    public:
+        /// <summary> Moves iterator to next key in order: the leftmost slot of the right subtree or the first ancestor reached from the left. </summary>
+        /// <returns> True if the curent slot isn't end </returns>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        bool next()
+        {
+            if(!m_slot)
+                return false;
+            const size_t nNode = m_pFrozen->m_nNode;
+            if(2 * m_slot + 1 <= nNode)
+            {
+                m_slot = 2 * m_slot + 1;
+                while(2 * m_slot <= nNode)
+                    m_slot *= 2;
+            }
+            else
+                m_slot >>= tree_trailing_zeros(~m_slot) + 1;
+            return m_slot != 0;
+        }
+
+        /// <summary> Checks whether the iterator is end. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        bool isEnd() const { return m_slot == 0; }
+
+        /// <summary> Queries the key. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        const Key& key() const { return m_pFrozen->key(m_slot); }
+
+        /// <summary> Queries the value. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        const Val& value() const { return m_pFrozen->m_aValue[m_slot - 1]; }
+
+        /// <summary> Checks whether iterators point to the same key. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        bool operator==(const Iterator& it) const { return m_slot == it.m_slot; }
+        bool operator!=(const Iterator& it) const { return m_slot != it.m_slot; }
+
+    private:
+        Iterator(const TreeFrozen* pFrozen, size_t slot) : m_pFrozen(pFrozen), m_slot(slot) {}
+
+        const TreeFrozen* m_pFrozen;
+        // the slot of the key, 0 - end
+        size_t m_slot;
+    };
+
+public:
+    /// <summary> Constructor of the empty snapshot. </summary>
+    /// <param name="cmp"> in. Optional. The comparator of keys. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    explicit TreeFrozen(const Compare& cmp = Compare()) : m_cmp(cmp), m_nNode(0), m_nOffset(0) {}
+
+    /// <summary> Constructor, copies the keys and the values in layout of the snapshot. </summary>
+    /// <param name="first"> in. The iterator to the first node of the tree (Tree::Iterator: next, isEnd, key, value). </param>
+    /// <param name="nNode"> in. Number of nodes. </param>
+    /// <param name="cmp"> in. The comparator of keys. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class It> TreeFrozen(It first, size_t nNode, const Compare& cmp);
+
+    /// <summary> Queries number of keys. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    size_t size() const { return m_nNode; }
+
+    /// <summary> Searches for the key. </summary>
+    /// <returns> Pointer to the value, NULL if the key isn't found. </returns>
+    /// <param name="key"> in. The key or, if the comparator is transparent, the value comparable with the keys. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    const Val* find(const Key& key) const { return find_imp(key); }
+    template<class K, class C = Compare, class = typename C::is_transparent> const Val* find(const K& key) const { return find_imp(key); }
+
+    /// <summary> Counts keys equal to the key. </summary>
+    /// <returns> 1 if the key is found, otherwise 0. </returns>
+    /// <param name="key"> in. The key. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    size_t count(const Key& key) const { return find_imp(key) ? 1 : 0; }
+
+    /// <summary> Searches for the first key which is not less than the key. </summary>
+    /// <returns> The iterator, the end iterator if all keys are less. </returns>
+    /// <param name="key"> in. The key or, if the comparator is transparent, the value comparable with the keys. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Iterator lower_bound(const Key& key) const { return Iterator(this, lower_bound_imp(key)); }
+    template<class K, class C = Compare, class = typename C::is_transparent> Iterator lower_bound(const K& key) const { return Iterator(this, lower_bound_imp(key)); }
+
+    /// <summary> Queries the iterator to the least key. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Iterator begin() const
+    {
+        size_t slot = m_nNode ? 1 : 0;
+        while(slot && 2 * slot <= m_nNode)
+            slot *= 2;
+        return Iterator(this, slot);
+    }
+
+    /// <summary> Queries the end iterator. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Iterator end() const { return Iterator(this, 0); }
+
+private:
+    // number of keys in one cache line, the prefetch distance in slots
+    enum { eLine = sizeof(Key) < 64 ? 64 / sizeof(Key) : 1 };
+
+    const Key& key(size_t slot) const { return m_aKey[m_nOffset + slot]; }
+    template<class K> size_t lower_bound_imp(const K& key) const;
+    template<class K> const Val* find_imp(const K& key) const
+    {
+        const size_t slot = lower_bound_imp(key);
+        return slot && tree_compare(m_cmp, key, this->key(slot)) == 0 ? &m_aValue[slot - 1] : NULL;
+    }
+    static void number_slots(size_t slot, size_t nNode, size_t& rank, std::vector<size_t>& aRank);
+
+private:
+    Compare m_cmp;
+    size_t m_nNode;
+    // the slots 1..m_nNode start at m_nOffset + 1, the offset aligns the slot 0 to cache line (the slots of a level in one line)
+    size_t m_nOffset;
+    std::vector<Key> m_aKey;
+    // the value of the slot k is m_aValue[k - 1]
+    std::vector<Val> m_aValue;
+};
+
+/// <summary> Constructor, copies the keys and the values in layout of the snapshot. </summary>
+/// <param name="first"> in. The iterator to the first node of the tree. </param>
+/// <param name="nNode"> in. Number of nodes. </param>
+/// <param name="cmp"> in. The comparator of keys. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare> template<class It> TreeFrozen<Key, Val, Compare>::TreeFrozen(It first, size_t nNode, const Compare& cmp)
+    : m_cmp(cmp), m_nNode(nNode), m_nOffset(0)
+{
+    if(!nNode)
+        return;
+
+    // the nodes in order of keys
+    std::vector<It> aNode;
+    aNode.reserve(nNode);
+    for(It it = first; !it.isEnd(); it.next())
+        aNode.push_back(it);
+    assert(aNode.size() == nNode);
+
+    // the rank of key of each slot: in-order traversal of the implicit tree
+    std::vector<size_t> aRank(nNode + 1);
+    size_t rank = 0;
+    number_slots(1, nNode, rank, aRank);
+
+    // the padding before the slot 0 is filled by copies of the first key, the keys are copied in order of slots
+    m_aKey.reserve(nNode + size_t(eLine) + 1);
+    m_aKey.push_back(aNode[0].key());
+    const size_t nMisalign = (reinterpret_cast<size_t>(m_aKey.data()) / sizeof(Key)) % size_t(eLine);
+    m_nOffset = 64 % sizeof(Key) == 0 && nMisalign ? size_t(eLine) - nMisalign : 0;
+    for(size_t i = 0; i < m_nOffset; ++i)
+        m_aKey.push_back(aNode[0].key());
+    m_aValue.reserve(nNode);
+    for(size_t slot = 1; slot <= nNode; ++slot)
+    {
+        m_aKey.push_back(aNode[aRank[slot]].key());
+        m_aValue.push_back(aNode[aRank[slot]].value());
+    }
+}
+
+/// <summary> Numbers the slots of the subtree in order of keys. </summary>
+/// <param name="slot"> in. The root slot of the subtree. </param>
+/// <param name="nNode"> in. Number of slots. </param>
+/// <param name="rank"> inout. The next rank. </param>
+/// <param name="aRank"> out. The ranks of slots. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare> void TreeFrozen<Key, Val, Compare>::number_slots(size_t slot, size_t nNode, size_t& rank, std::vector<size_t>& aRank)
+{
+    if(slot > nNode)
+        return;
+    number_slots(2 * slot, nNode, rank, aRank);
+    aRank[slot] = rank++;
+    number_slots(2 * slot + 1, nNode, rank, aRank);
+}
+
+/// <summary> Searches for the slot of the first key which is not less than the key. </summary>
+/// <returns> The slot, 0 if all keys are less. </returns>
+/// <param name="key"> in. The key. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare> template<class K> size_t TreeFrozen<Key, Val, Compare>::lower_bound_imp(const K& key) const
+{
+    if(!m_nNode)
+        return 0;
+
+    // descend to the leaf level without jumps: the right child if the slot key is less
+    const Key* aKey = &m_aKey[m_nOffset];
+    size_t slot = 1;
+    while(slot <= m_nNode)
+    {
+        tree_prefetch(aKey + std::min(slot * size_t(eLine), m_nNode));
+        slot = 2 * slot + size_t(tree_compare(m_cmp, aKey[slot], key) < 0);
+    }
+
+    // the answer is the last slot where the descent turned left: drop the trailing right turns and that left turn
+    return slot >> (tree_trailing_zeros(~slot) + 1);
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include "tree_avl.h"
+
+/// <summary> Half-open interval [m_begin, m_end), the key of TreeIntervals. Intervals are ordered by begin, then by end. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class T> struct TreeInterval
+{
+    TreeInterval() : m_begin(), m_end() {}
+    TreeInterval(const T& begin, const T& end) : m_begin(begin), m_end(end) {}
+
+    bool operator<(const TreeInterval& other) const { return m_begin < other.m_begin || (!(other.m_begin < m_begin) && m_end < other.m_end); }
+    bool operator==(const TreeInterval& other) const { return !(*this < other) && !(other < *this); }
+
+    T m_begin;
+    T m_end;
+};
+
+/// <summary> The monoid of maximal end of intervals for TreeAugmentAggregate. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class T> struct TreeMonoidMaxEnd
+{
+    typedef T value_type;
+    static T identity() { return std::numeric_limits<T>::lowest(); }
+    template<class V> static T lift(const TreeInterval<T>& key, const V&) { return key.m_end; }
+    static T combine(const T& a, const T& b) { return a < b ? b : a; }
+};
+
+/// <summary> 
+/// Interval tree: the AVL tree of half-open intervals, each node keeps the maximal end of intervals of its subtree 
+/// (maintained by rotations, insert/erase, split/join like any aggregate). The overlap queries skip subtrees 
+/// which end before the query and subtrees which begin after it. 
+/// The intervals are unique keys: insert of an interval equal to existing one replaces its value (try_emplace keeps it), 
+/// so the items which share the same interval must be kept together in Val (e.g. a vector). 
+/// Empty intervals [b, b) can be stored, but they contain no point and overlap no range. 
+/// </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class T, class Val, template<class> class Alloc = TreeNodePool> class TreeIntervals 
+    : public Tree<TreeInterval<T>, Val, TreeCompare<TreeInterval<T>>, Alloc, TreeAugmentAggregate<TreeMonoidMaxEnd<T>>>
+{
+public:
+    typedef TreeInterval<T> Interval;
+    typedef Tree<Interval, Val, TreeCompare<Interval>, Alloc, TreeAugmentAggregate<TreeMonoidMaxEnd<T>>> Base;
+    typedef typename Base::Node Node;
+
+public:
+    /// <summary> Calls the function for each interval which overlaps range [lo, hi) in order of intervals. </summary>
+    /// <param name="lo"> in. The beginning of range. </param>
+    /// <param name="hi"> in. The end of range (exclusive). </param>
+    /// <param name="fn"> in. The function called as fn(const Interval& interval, Val& value). </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class Fn> void for_each_overlap(const T& lo, const T& hi, Fn fn)
+    {
+        if(lo < hi)
+            overlap_imp(this->m_root, lo, hi, false, fn);
+    }
+
+    /// <summary> Calls the function for each interval which contains the point (stabbing query) in order of intervals. </summary>
+    /// <param name="point"> in. The point. </param>
+    /// <param name="fn"> in. The function called as fn(const Interval& interval, Val& value). </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class Fn> void for_each_containing(const T& point, Fn fn)
+    {
+        overlap_imp(this->m_root, point, point, true, fn);
+    }
+
+    /// <summary> Counts intervals which overlap range [lo, hi). </summary>
+    /// <returns> The number of intervals. </returns>
+    /// <param name="lo"> in. The beginning of range. </param>
+    /// <param name="hi"> in. The end of range (exclusive). </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    size_t count_overlap(const T& lo, const T& hi)
+    {
+        size_t nOverlap = 0;
+        for_each_overlap(lo, hi, [&nOverlap](const Interval&, Val&) { ++nOverlap; });
+        return nOverlap;
+    }
+
+private:
+    /// <summary> Calls the function for each non-empty interval of subtree which overlaps range [lo, hi) or contains the point lo == hi. </summary>
+    /// <param name="pNode"> in. The root of subtree. </param>
+    /// <param name="lo"> in. The beginning of range. </param>
+    /// <param name="hi"> in. The end of range. </param>
+    /// <param name="bPoint"> in. True if the range is the point (the end is inclusive). </param>
+    /// <param name="fn"> in. The function. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class Fn> static void overlap_imp(Node* pNode, const T& lo, const T& hi, bool bPoint, Fn& fn)
+    {
+        while(pNode)
+        {
+            // all intervals of subtree end before the range
+            if(!(lo < pNode->m_aggregate))
+                return;
+
+            overlap_imp(pNode->left(), lo, hi, bPoint, fn);
+
+            // the interval and the right subtree begin after the range
+            const Interval& interval = pNode->m_key;
+            if(bPoint ? hi < interval.m_begin : !(interval.m_begin < hi))
+                return;
+            if(lo < interval.m_end && interval.m_begin < interval.m_end)
+                fn(interval, pNode->m_value);
+            pNode = pNode->right();
+        }
+    }
+};
@@ -0,0 +1,433 @@
+#pragma once
+#include "tree_avl.h"
+
+/// <summary> Implements tree node without link to parent, contains pair of value and key. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val> class TreeNoParentNode
+{
+public:
+    // Enumeration for manupulations with left/right children of the node
+    enum EBranch { eLeft = 0, eRight = 1 };
+
+public:
+    // constructor
+    TreeNoParentNode(const Key& key) : m_height(1), m_value(), m_key(key) { m_child[eLeft] = m_child[eRight] = NULL; }
+
+    // access to node height and balance
+    unsigned char height(EBranch branch) const { return m_child[branch] ? m_child[branch]->m_height : 0; }
+    int balance() const { return height(eLeft) - height(eRight); }
+    void update_height() { m_height = 1 + std::max(height(eLeft), height(eRight)); }
+
+    // access to left/right nodes
+    TreeNoParentNode* left() { return m_child[eLeft]; }
+    TreeNoParentNode* right() { return m_child[eRight]; }
+
+private:
+    // assignment is forbidden
+    TreeNoParentNode<Key, Val>& operator=(const TreeNoParentNode<Key, Val>&) { return *this; }
+
+public:
+    // left/fight child
+    TreeNoParentNode* m_child[2];
+    // height of the node in tree (for an empty node height = 1)
+    unsigned char m_height;
+    // node value
+    Val m_value;
+    // node key
+    const Key m_key;
+};
+
+/// <summary>
+/// The AVL tree without links to parent nodes. The public API is the same as Tree has.
+/// Insertion and erasing record the path of descent and rebalance the tree along it,
+/// iterator keeps its own stack of nodes. Important: any modification of the tree invalidates iterators.
+/// </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare = TreeCompare<Key>, template<class> class Alloc = TreeNodePool> class TreeNoParent
+{
+public:
+    typedef TreeNoParentNode<Key, Val> Node;
+
+    // maximal height of the tree: AVL tree of height 64 contains more than 2^44 nodes
+    enum { eMaxHeight = 64 };
+
+public:
+    /// <summary> Tree iterator. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    class Iterator
+    {
+        friend class TreeNoParent<Key, Val, Compare, Alloc>;
+    public:
+
+        /// <summary> Constructor, positions the iterator to the minimal node of subtree. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        explicit Iterator(Node* root) : m_nNode(0) { push_left(root); }
+
+        /// <summary> Moves iterator to next node in the tree. </summary>
+        /// <returns> True if the curent node isn't end </returns>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        bool next()
+        {
+            if(!m_nNode)
+                return false;
+
+            // minimal element in right branch or the nearest ancestor for which the node is in left branch
+            Node* pNode = m_aNode[--m_nNode];
+            push_left(pNode->right());
+            return m_nNode != 0;
+        }
+
+        /// <summary> Checks whether the node is end node of the tree. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        bool isEnd() const { return m_nNode == 0; }
+
+        /// <summary> Queries the node key. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        const Key& key() const { return m_aNode[m_nNode - 1]->m_key; }
+
+        /// <summary> Accesses the node value. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        Val& value() { return m_aNode[m_nNode - 1]->m_value; }
+
+    private:
+        // pushes the node and all its left descendants to the stack
+        void push_left(Node* pNode)
+        {
+            for(; pNode; pNode = pNode->left())
+            {
+                assert(m_nNode < eMaxHeight);
+                m_aNode[m_nNode++] = pNode;
+            }
+        }
+
+    private:
+        // the current node (on the top) and its ancestors which are not visited yet
+        Node* m_aNode[eMaxHeight];
+        int m_nNode;
+    };
+
+    /// <summary> Constructor </summary>
+    /// <param name="cmp"> in. Optional. The comparator of keys. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    explicit TreeNoParent(const Compare& cmp = Compare()) : m_cmp(cmp), m_root(NULL) {}
+
+    /// <summary> Destructor </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    virtual ~TreeNoParent() { clear(); }
+
+    /// <summary> Removes all nodes from the tree. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void clear()
+    {
+        destroy_nodes(m_root, std::integral_constant<bool, Alloc<Node>::bulk_release && std::is_trivially_destructible<Node>::value>());
+        m_alloc.release();
+        m_root = NULL;
+    }
+
+    /// <summary> Searches for node with specified key. </summary>
+    /// <returns> Pointer to node value, NULL if specified key isn't found in the tree. </returns>
+    /// <param name="key"> in. The key of node to be found. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Val* find(const Key& key) { Node* pNode = find_imp(key); return pNode ? &pNode->m_value : NULL; }
+
+    /// <summary> Searches for node with specified key. </summary>
+    /// <returns> Pointer to node value, NULL if specified key isn't found in the tree. </returns>
+    /// <param name="key"> in. The key of node to be found. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    const Val* find(const Key& key) const { const Node* pNode = find_imp(key); return pNode ? &pNode->m_value : NULL; }
+
+    /// <summary> Removes node with specified key from the tree. </summary>
+    /// <param name="key"> in. The key of node to be removed. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void erase(const Key& key);
+
+    /// <summary> Inserts new node into the tree. </summary>
+    /// <param name="key"> in. The node key. </param>
+    /// <param name="val"> in. The node value. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void insert(const Key& key, const Val& val) { node_imp(key).m_value = val; }
+
+    /// <summary> Inserts new node into the tree. </summary>
+    /// <param name="pair"> in. The node key and value. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void insert(const std::pair<Key, Val>& pair) { insert(pair.first, pair.second); }
+
+    /// <summary> Accesses the node value by its key. Important: if node with specified key isn't exists in tree - node with default value will be inserted. </summary>
+    /// <returns> The reference to node value. </returns>
+    /// <param name="key"> in. The key of node to be found. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Val& operator[](const Key& key) { return node_imp(key).m_value; }
+
+    /// <summary> Queries the tree iterator. </summary>
+    /// <returns> The iteraror. </returns>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Iterator begin() { return Iterator(m_root); }
+
+    /// <summary> Saves the tree to graphviz-format file, see Tree::saveToGv. </summary>
+    /// <param name="sFile"> in. The output file name. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void saveToGv(const char* sFile);
+
+private:
+    // three-way comparison of keys by the comparator of any style
+    int compare(const Key& a, const Key& b) const { return tree_compare(m_cmp, a, b); }
+
+    Node* create_node(const Key& key);
+    void destroy_node(Node* pNode);
+    void destroy_nodes(Node*, std::true_type) {}
+    void destroy_nodes(Node* pNode, std::false_type bSkip);
+    Node* find_imp(const Key& key) const;
+    Node& node_imp(const Key& key);
+    void update_balance(Node** aPath[], int nPath);
+    Node* rotate_left(Node& node);
+    Node* rotate_right(Node& node);
+
+    // copying and assignment are forbidden
+    TreeNoParent(const TreeNoParent<Key, Val, Compare, Alloc>&);
+    TreeNoParent<Key, Val, Compare, Alloc>& operator=(const TreeNoParent<Key, Val, Compare, Alloc>&) { return *this; }
+private:
+    const Compare m_cmp;
+    Alloc<Node> m_alloc;
+    Node* m_root;
+};
+
+
+/// <summary> Creates new node. </summary>
+/// <returns> Pointer to the created node. </returns>
+/// <param name="key"> in. The node key. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc> TreeNoParentNode<Key, Val>* TreeNoParent<Key, Val, Compare, Alloc>::create_node(const Key& key)
+{
+    Node* pNode = m_alloc.allocate();
+    try
+    {
+        return new(pNode) Node(key);
+    }
+    catch(...)
+    {
+        m_alloc.deallocate(pNode);
+        throw;
+    }
+}
+
+/// <summary> Destroys the node and returns its memory to allocator. </summary>
+/// <param name="pNode"> in. The node to be destroyed. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc> void TreeNoParent<Key, Val, Compare, Alloc>::destroy_node(Node* pNode)
+{
+    pNode->~Node();
+    m_alloc.deallocate(pNode);
+}
+
+/// <summary> Destroys all nodes of the subtree. </summary>
+/// <param name="pNode"> in. The root of subtree. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc> void TreeNoParent<Key, Val, Compare, Alloc>::destroy_nodes(Node* pNode, std::false_type bSkip)
+{
+    if(!pNode)
+        return;
+    destroy_nodes(pNode->left(), bSkip);
+    destroy_nodes(pNode->right(), bSkip);
+    destroy_node(pNode);
+}
+
+/// <summary> Searches for node with specified key. </summary>
+/// <returns> Pointer to node, NULL if node isn't found. </returns>
+/// <param name="key"> in. The key to be found. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc> TreeNoParentNode<Key, Val>* TreeNoParent<Key, Val, Compare, Alloc>::find_imp(const Key& key) const
+{
+    Node* pNode = m_root;
+    while(pNode)
+    {
+        const int cmp = compare(key, pNode->m_key);
+        if(cmp == 0)
+            return pNode;
+
+        // select the branch without extra conditional jumps
+        pNode = pNode->m_child[cmp > 0];
+    }
+    return NULL;
+}
+
+/// <summary> Accesses the node by its key. Important: if node with specified key isn't exists in tree - node with default value will be inserted. </summary>
+/// <returns> The reference to node. </returns>
+/// <param name="key"> in. The key of node to be found. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc> TreeNoParentNode<Key, Val>& TreeNoParent<Key, Val, Compare, Alloc>::node_imp(const Key& key)
+{
+    // search for existing node, record links passed on the way
+    Node** aPath[eMaxHeight + 1];
+    int nPath = 0;
+    Node** ppLink = &m_root;
+    while(*ppLink)
+    {
+        Node* pNode = *ppLink;
+        const int cmp = compare(key, pNode->m_key);
+        if(cmp == 0)
+            return *pNode;
+
+        assert(nPath < eMaxHeight);
+        aPath[nPath++] = ppLink;
+        ppLink = &pNode->m_child[cmp > 0];
+    }
+
+    // create new leaf
+    Node* pChild = create_node(key);
+    *ppLink = pChild;
+
+    // balance tree
+    update_balance(aPath, nPath);
+    return *pChild;
+}
+
+/// <summary> Removes node with specified key from the tree. </summary>
+/// <param name="key"> in. The key of node to be removed. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc> void TreeNoParent<Key, Val, Compare, Alloc>::erase(const Key& key)
+{
+    // search for node, record links passed on the way
+    Node** aPath[eMaxHeight + 1];
+    int nPath = 0;
+    Node** ppLink = &m_root;
+    for(;;)
+    {
+        Node* pNode = *ppLink;
+        if(!pNode)
+            return;
+        const int cmp = compare(key, pNode->m_key);
+        if(cmp == 0)
+            break;
+
+        assert(nPath < eMaxHeight);
+        aPath[nPath++] = ppLink;
+        ppLink = &pNode->m_child[cmp > 0];
+    }
+
+    // remove pNode from tree
+    Node* pNode = *ppLink;
+    if(pNode->right())
+    {
+        // search for minimal node in right branch
+        const int iNode = nPath;
+        aPath[nPath++] = ppLink;
+        Node** ppMin = &pNode->m_child[Node::eRight];
+        while((*ppMin)->left())
+        {
+            aPath[nPath++] = ppMin;
+            ppMin = &(*ppMin)->m_child[Node::eLeft];
+        }
+        Node* pMin = *ppMin;
+
+        // replace pMin by its right child, then replace pNode by pMin
+        *ppMin = pMin->right();
+        pMin->m_child[Node::eLeft] = pNode->left();
+        pMin->m_child[Node::eRight] = pNode->right();
+        *ppLink = pMin;
+
+        // the link to right branch belongs now to pMin
+        if(iNode + 1 < nPath)
+            aPath[iNode + 1] = &pMin->m_child[Node::eRight];
+    }
+    else
+    {
+        // if right branch is empty, replace pNode by left child
+        *ppLink = pNode->left();
+    }
+
+    // destroy node
+    destroy_node(pNode);
+
+    // update tree balance
+    update_balance(aPath, nPath);
+}
+
+/// <summary> Saves the tree to graphviz-format file, see Tree::saveToGv. </summary>
+/// <param name="sFile"> in. The output file name. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc> void TreeNoParent<Key, Val, Compare, Alloc>::saveToGv(const char* sFile)
+{
+    std::fstream file;
+    file.open(sFile, std::ios_base::out | std::ios_base::trunc);
+
+    file << "digraph tree\n{";
+
+    // list of nodes with labels
+    for(Iterator it = begin(); !it.isEnd(); it.next())
+    {
+        const Node& node = *it.m_aNode[it.m_nNode - 1];
+        file << "\n node_" << node.m_key << " [label=\"" << node.m_key << " h" << int(node.m_height) << " b" << node.balance() << "\"];";
+    }
+
+    // lenks between nodes
+    file << "\n";
+    for(Iterator it = begin(); !it.isEnd(); it.next())
+    {
+        Node& node = *it.m_aNode[it.m_nNode - 1];
+        if(node.left())
+            file << "\n node_" << node.m_key << " -> node_" << node.left()->m_key;
+        if(node.right())
+            file << "\n node_" << node.m_key << " -> node_" << node.right()->m_key;
+    }
+    file << "\n}";
+}
+
+/// <summary> Makes small left rotation around the specified node. </summary>
+/// <returns> The pointer to new root node, it should be stored to the link which pointed to node. </returns>
+/// <param name="node"> in. The node to be balanced. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc> TreeNoParentNode<Key, Val>* TreeNoParent<Key, Val, Compare, Alloc>::rotate_left(Node& node)
+{
+    Node& right = *node.right();
+    node.m_child[Node::eRight] = right.left();
+    right.m_child[Node::eLeft] = &node;
+
+    node.update_height();
+    right.update_height();
+    return &right;
+}
+
+/// <summary> Makes small right rotation around the specified node. </summary>
+/// <returns> The pointer to new root node, it should be stored to the link which pointed to node. </returns>
+/// <param name="node"> in. The node to be balanced. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc> TreeNoParentNode<Key, Val>* TreeNoParent<Key, Val, Compare, Alloc>::rotate_right(Node& node)
+{
+    Node& left = *node.left();
+    node.m_child[Node::eLeft] = left.right();
+    left.m_child[Node::eRight] = &node;
+
+    node.update_height();
+    left.update_height();
+    return &left;
+}
+
+/// <summary> Perofrms balancing of the tree along the recorded path from the bottom till root. </summary>
+/// <param name="aPath"> in. The links to nodes from root to the lowest changed node. </param>
+/// <param name="nPath"> in. The number of links in the path. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, template<class> class Alloc> void TreeNoParent<Key, Val, Compare, Alloc>::update_balance(Node** aPath[], int nPath)
+{
+    while(nPath > 0)
+    {
+        Node** ppLink = aPath[--nPath];
+        Node* pNode = *ppLink;
+
+        // update node balance
+        pNode->update_height();
+
+        // rebalance
+        if(pNode->balance() == -2)
+        {
+            if(pNode->right()->balance() > 0)
+                pNode->m_child[Node::eRight] = rotate_right(*pNode->right());
+            *ppLink = rotate_left(*pNode);
+        }
+        else if(pNode->balance() == 2)
+        {
+            if(pNode->left()->balance() < 0)
+                pNode->m_child[Node::eLeft] = rotate_left(*pNode->left());
+            *ppLink = rotate_right(*pNode);
+        }
+    }
+}
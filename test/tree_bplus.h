@@ -0,0 +1,699 @@
+#pragma once
+#include "tree_avl.h"
+#include <stdint.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+/// <summary> Counts set bits of the number. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+inline int tree_popcount(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    return int(__popcnt64(x));
+#else
+    int n = 0;
+    for(; x; x &= x - 1)
+        ++n;
+    return n;
+#endif
+}
+
+/// <summary>
+/// Search in the sorted keys of B+ tree node: the number of keys less than the key (lower) or not greater than the key (upper).
+/// The general version is the binary search by the comparator.
+/// </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Compare, int nKeys, bool bArithmetic = std::is_arithmetic<Key>::value && std::is_same<Compare, TreeCompare<Key>>::value>
+struct TreeBPlusSearch
+{
+    static int lower(const Compare& cmp, const Key* aKey, int n, const Key& key) { return bound(cmp, aKey, n, key, false); }
+    static int upper(const Compare& cmp, const Key* aKey, int n, const Key& key) { return bound(cmp, aKey, n, key, true); }
+
+    static int bound(const Compare& cmp, const Key* aKey, int n, const Key& key, bool bUpper)
+    {
+        int lo = 0;
+        while(n > 0)
+        {
+            const int half = n / 2;
+            const int c = tree_compare(cmp, aKey[lo + half], key);
+            if(c < 0 || (bUpper && c == 0))
+            {
+                lo += half + 1;
+                n -= half + 1;
+            }
+            else
+                n = half;
+        }
+        return lo;
+    }
+};
+
+/// <summary> Search in the node for arithmetic keys with the default comparator: branch-free count of all slots (vectorized by compiler). </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Compare, int nKeys> struct TreeBPlusSearch<Key, Compare, nKeys, true>
+{
+    static int lower(const Compare&, const Key* aKey, int n, Key key)
+    {
+        int nLess = 0;
+        for(int i = 0; i < nKeys; ++i)
+            nLess += int(i < n) & int(aKey[i] < key);
+        return nLess;
+    }
+
+    static int upper(const Compare&, const Key* aKey, int n, Key key)
+    {
+        int nNotGreater = 0;
+        for(int i = 0; i < nKeys; ++i)
+            nNotGreater += int(i < n) & int(!(key < aKey[i]));
+        return nNotGreater;
+    }
+};
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+/// <summary>
+/// Search in the node for 32-bit integer keys: the keys are compared by vectors (8 keys by AVX2, 4 keys by SSE2),
+/// the masks of comparisons are packed to bits and the bits of used slots are counted.
+/// </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Compare, int nKeys> struct TreeBPlusSearch<int, Compare, nKeys, true>
+{
+    static int lower(const Compare&, const int* aKey, int n, int key) { return count_greater(aKey, n, key, true); }
+    static int upper(const Compare&, const int* aKey, int n, int key) { return n - count_greater(aKey, n, key, false); }
+
+    // bLess = true: counts keys less than the key, otherwise - keys greater than the key
+    static int count_greater(const int* aKey, int n, int key, bool bLess)
+    {
+        uint64_t bits = 0;
+#if defined(__AVX2__)
+        const __m256i vKey = _mm256_set1_epi32(key);
+        for(int i = 0; i < nKeys; i += 8)
+        {
+            const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(aKey + i));
+            const __m256i vGreater = bLess ? _mm256_cmpgt_epi32(vKey, v) : _mm256_cmpgt_epi32(v, vKey);
+            bits |= uint64_t(uint32_t(_mm256_movemask_ps(_mm256_castsi256_ps(vGreater)))) << i;
+        }
+#else
+        const __m128i vKey = _mm_set1_epi32(key);
+        for(int i = 0; i < nKeys; i += 4)
+        {
+            const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(aKey + i));
+            const __m128i vGreater = bLess ? _mm_cmpgt_epi32(vKey, v) : _mm_cmpgt_epi32(v, vKey);
+            bits |= uint64_t(uint32_t(_mm_movemask_ps(_mm_castsi128_ps(vGreater)))) << i;
+        }
+#endif
+        return tree_popcount(bits & (n < 64 ? (uint64_t(1) << n) - 1 : ~uint64_t(0)));
+    }
+};
+#endif
+
+/// <summary> The leaf of B+ tree: the keys and the values, the links to neighbour leaves. </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, int nKeys> struct TreeBPlusLeaf
+{
+    TreeBPlusLeaf() : m_aKey(), m_aValue(), m_pPrev(NULL), m_pNext(NULL), m_nKey(0) {}
+
+    // the keys are first, so they start at the cache line
+    Key m_aKey[nKeys];
+    Val m_aValue[nKeys];
+    TreeBPlusLeaf* m_pPrev;
+    TreeBPlusLeaf* m_pNext;
+    int m_nKey;
+};
+
+/// <summary> The inner node of B+ tree: m_nKey separators and m_nKey + 1 children, the child i contains keys in [m_aKey[i - 1], m_aKey[i]). </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, int nKeys> struct TreeBPlusInner
+{
+    TreeBPlusInner() : m_aKey(), m_nKey(0) {}
+
+    Key m_aKey[nKeys];
+    // the inner nodes or the leaves (the level is known from the height of the tree)
+    void* m_aChild[nKeys + 1];
+    int m_nKey;
+};
+
+/// <summary>
+/// B+ tree with the public API of Tree: the nodes hold nKeys (16..64) keys in cache line aligned arrays, so one cache miss
+/// brings many keys, the search inside a node compares the keys by SIMD for 32-bit integer keys (branch-free for other arithmetic keys).
+/// The values are stored in the leaves which are linked for sequential scans.
+/// A node is released when it becomes empty, the keys aren't moved between nodes by erase (as in many database B+ trees).
+/// Key and Val should be default constructible and assignable.
+/// Important: insert and erase move keys and values inside nodes, so pointers and references to values are invalidated by them.
+/// </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare = TreeCompare<Key>, int nKeys = 32> class TreeBPlus
+{
+    // the SIMD search reads the nodes by vectors of 8 keys and collects the results to 64-bit mask
+    static_assert(nKeys >= 16 && nKeys <= 64 && nKeys % 8 == 0, "TreeBPlus: nKeys must be a multiple of 8 in range 16..64");
+
+public:
+    typedef TreeBPlusLeaf<Key, Val, nKeys> Leaf;
+    typedef TreeBPlusInner<Key, nKeys> Inner;
+
+public:
+    class ConstIterator;
+
+    /// <summary> Tree iterator, walks the linked leaves. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    class Iterator
+    {
+        friend class TreeBPlus<Key, Val, Compare, nKeys>;
+        friend class ConstIterator;
+    public:
+
+        /// <summary> Constructor </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        Iterator(Leaf* pLeaf, int index) : m_pLeaf(pLeaf), m_index(index) {}
+
+        /// <summary> Moves iterator to next key in the tree. </summary>
+        /// <returns> True if the curent key isn't end </returns>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        bool next()
+        {
+            if(!m_pLeaf)
+                return false;
+            if(++m_index == m_pLeaf->m_nKey)
+            {
+                m_pLeaf = m_pLeaf->m_pNext;
+                m_index = 0;
+            }
+            return m_pLeaf != NULL;
+        }
+
+        /// <summary> Checks whether the iterator is end. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        bool isEnd() const { return m_pLeaf == NULL; }
+
+        /// <summary> Queries the key. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        const Key& key() const { return m_pLeaf->m_aKey[m_index]; }
+
+        /// <summary> Accesses the value. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        Val& value() { return m_pLeaf->m_aValue[m_index]; }
+
+    private:
+        Leaf* m_pLeaf;
+        int m_index;
+    };
+
+    /// <summary> The iterator of the const tree, the values are read-only. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    class ConstIterator
+    {
+    public:
+        /// <summary> Constructor </summary>
+        /// <param name="it"> in. The iterator of the tree. </param>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        ConstIterator(const Iterator& it) : m_it(it) {}
+
+        /// <summary> Moves iterator to next key in the tree. </summary>
+        /// <returns> True if the curent key isn't end </returns>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        bool next() { return m_it.next(); }
+
+        /// <summary> Checks whether the iterator is end. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        bool isEnd() const { return m_it.isEnd(); }
+
+        /// <summary> Queries the key. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        const Key& key() const { return m_it.key(); }
+
+        /// <summary> Queries the value. </summary>
+        /// <remarks> Author: Vladimir Zelyonkin </remarks>
+        const Val& value() const { return m_it.m_pLeaf->m_aValue[m_it.m_index]; }
+
+    private:
+        Iterator m_it;
+    };
+
+    /// <summary> Constructor </summary>
+    /// <param name="cmp"> in. Optional. The comparator of keys. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    explicit TreeBPlus(const Compare& cmp = Compare()) : m_cmp(cmp), m_pRoot(NULL), m_nHeight(0), m_pFirst(NULL), m_size(0) {}
+
+    /// <summary> Destructor </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    virtual ~TreeBPlus() { clear(); }
+
+    /// <summary> Removes all keys from the tree. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void clear()
+    {
+        if(m_pRoot)
+            destroy_node(m_pRoot, m_nHeight);
+        m_pRoot = NULL;
+        m_nHeight = 0;
+        m_pFirst = NULL;
+        m_size = 0;
+    }
+
+    /// <summary> Queries number of keys in the tree. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    size_t size() const { return m_size; }
+
+    /// <summary> Searches for the key. </summary>
+    /// <returns> Pointer to the value, NULL if the key isn't found in the tree. </returns>
+    /// <param name="key"> in. The key to be found. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Val* find(const Key& key) { return find_imp(key); }
+    const Val* find(const Key& key) const { return find_imp(key); }
+
+    /// <summary> Removes the key from the tree. </summary>
+    /// <param name="key"> in. The key to be removed. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void erase(const Key& key);
+
+    /// <summary> Inserts the key into the tree. If the key exists in the tree - replaces its value. </summary>
+    /// <param name="key"> in. The key. </param>
+    /// <param name="val"> in. The value. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void insert(const Key& key, const Val& val) { node_imp(key) = val; }
+
+    /// <summary> Inserts the key into the tree. </summary>
+    /// <param name="pair"> in. The key and the value. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void insert(const std::pair<Key, Val>& pair) { insert(pair.first, pair.second); }
+
+    /// <summary> Accesses the value by its key. Important: if the key isn't exists in tree - the key with default value will be inserted. </summary>
+    /// <returns> The reference to the value. </returns>
+    /// <param name="key"> in. The key to be found. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Val& operator[](const Key& key) { return node_imp(key); }
+
+    /// <summary> Queries the tree iterator. </summary>
+    /// <returns> The iteraror. </returns>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Iterator begin() { return Iterator(m_pFirst, 0); }
+    ConstIterator begin() const { return Iterator(m_pFirst, 0); }
+
+    /// <summary> Checks structure of the tree: order of keys, separators of the inner nodes, links of the leaves, number of keys. </summary>
+    /// <returns> True if the tree is valid. </returns>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    bool isValid() const;
+
+private:
+    typedef TreeBPlusSearch<Key, Compare, nKeys> Search;
+
+    // maximal height of the tree (the height grows when the root with nKeys separators is split)
+    enum { eMaxHeight = 32 };
+
+    // the path from the root to the leaf: the inner node of each level and the index of the child in it
+    struct Path
+    {
+        Inner* m_apNode[eMaxHeight + 1];
+        int m_aIndex[eMaxHeight + 1];
+    };
+
+    // three-way comparison of keys
+    int compare(const Key& a, const Key& b) const { return tree_compare(m_cmp, a, b); }
+
+    template<class T> static T* create_node();
+    template<class T> static void free_node(T* pNode);
+    void destroy_node(void* pNode, int nLevel);
+    Leaf* descend(const Key& key, Path* pPath) const;
+    Val* find_imp(const Key& key) const;
+    Val& node_imp(const Key& key);
+    int create_inner(const Path& path, Inner** apInner);
+    void insert_separator(Path& path, const Key& key, void* pChild, Inner** apInner);
+    void remove_leaf(Leaf* pLeaf, Path& path);
+    bool check_imp(const void* pNode, int nLevel, const Key* pLow, const Key* pHigh, const Leaf*& pPrev, size_t& nKey) const;
+
+    // copying and assignment are forbidden
+    TreeBPlus(const TreeBPlus&);
+    TreeBPlus& operator=(const TreeBPlus&) { return *this; }
+
+private:
+    const Compare m_cmp;
+    // the root: the inner node if the height is greater than 1, otherwise the leaf
+    void* m_pRoot;
+    int m_nHeight;
+    // the first leaf
+    Leaf* m_pFirst;
+    size_t m_size;
+};
+
+
+/// <summary> Creates the node in the cache line aligned memory. </summary>
+/// <returns> The node. </returns>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, int nKeys> template<class T> T* TreeBPlus<Key, Val, Compare, nKeys>::create_node()
+{
+    void* p = tree_aligned_allocate(sizeof(T));
+    try
+    {
+        return new(p) T();
+    }
+    catch(...)
+    {
+        tree_aligned_free(p);
+        throw;
+    }
+}
+
+/// <summary> Destroys the node and releases its memory. </summary>
+/// <param name="pNode"> in. The node. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, int nKeys> template<class T> void TreeBPlus<Key, Val, Compare, nKeys>::free_node(T* pNode)
+{
+    pNode->~T();
+    tree_aligned_free(pNode);
+}
+
+/// <summary> Destroys the subtree. </summary>
+/// <param name="pNode"> in. The root of subtree. </param>
+/// <param name="nLevel"> in. The level of the root: 1 - leaf. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, int nKeys> void TreeBPlus<Key, Val, Compare, nKeys>::destroy_node(void* pNode, int nLevel)
+{
+    if(nLevel == 1)
+    {
+        free_node(static_cast<Leaf*>(pNode));
+        return;
+    }
+    Inner* pInner = static_cast<Inner*>(pNode);
+    for(int i = 0; i <= pInner->m_nKey; ++i)
+        destroy_node(pInner->m_aChild[i], nLevel - 1);
+    free_node(pInner);
+}
+
+/// <summary> Descends from the root to the leaf which may contain the key. </summary>
+/// <returns> The leaf, NULL if the tree is empty. </returns>
+/// <param name="key"> in. The key. </param>
+/// <param name="pPath"> out. Optional. The path to the leaf. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, int nKeys> TreeBPlusLeaf<Key, Val, nKeys>* TreeBPlus<Key, Val, Compare, nKeys>::descend(const Key& key, Path* pPath) const
+{
+    void* pNode = m_pRoot;
+    for(int nLevel = m_nHeight; nLevel > 1; --nLevel)
+    {
+        Inner* pInner = static_cast<Inner*>(pNode);
+        const int i = Search::upper(m_cmp, pInner->m_aKey, pInner->m_nKey, key);
+        if(pPath)
+        {
+            pPath->m_apNode[nLevel] = pInner;
+            pPath->m_aIndex[nLevel] = i;
+        }
+        pNode = pInner->m_aChild[i];
+    }
+    return static_cast<Leaf*>(pNode);
+}
+
+/// <summary> Searches for the key. </summary>
+/// <returns> Pointer to the value, NULL if the key isn't found. </returns>
+/// <param name="key"> in. The key. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, int nKeys> Val* TreeBPlus<Key, Val, Compare, nKeys>::find_imp(const Key& key) const
+{
+    Leaf* pLeaf = descend(key, NULL);
+    if(!pLeaf)
+        return NULL;
+    const int i = Search::lower(m_cmp, pLeaf->m_aKey, pLeaf->m_nKey, key);
+    return i < pLeaf->m_nKey && compare(pLeaf->m_aKey[i], key) == 0 ? &pLeaf->m_aValue[i] : NULL;
+}
+
+/// <summary> Searches for the key, inserts it with default value if it isn't found. The full leaf is split in halves. </summary>
+/// <returns> The reference to the value. </returns>
+/// <param name="key"> in. The key. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, int nKeys> Val& TreeBPlus<Key, Val, Compare, nKeys>::node_imp(const Key& key)
+{
+    if(!m_pRoot)
+    {
+        m_pFirst = create_node<Leaf>();
+        m_pRoot = m_pFirst;
+        m_nHeight = 1;
+    }
+
+    Path path;
+    Leaf* pLeaf = descend(key, &path);
+    int i = Search::lower(m_cmp, pLeaf->m_aKey, pLeaf->m_nKey, key);
+    if(i < pLeaf->m_nKey && compare(pLeaf->m_aKey[i], key) == 0)
+        return pLeaf->m_aValue[i];
+
+    if(pLeaf->m_nKey == nKeys)
+    {
+        // all nodes of the split are allocated before any change, so bad_alloc leaves the tree intact
+        Inner* apInner[eMaxHeight + 1];
+        const int nInner = create_inner(path, apInner);
+        Leaf* pRight;
+        try
+        {
+            pRight = create_node<Leaf>();
+        }
+        catch(...)
+        {
+            for(int j = 0; j < nInner; ++j)
+                free_node(apInner[j]);
+            throw;
+        }
+
+        // move the upper half to the new leaf
+        const int nLeft = nKeys / 2;
+        std::move(pLeaf->m_aKey + nLeft, pLeaf->m_aKey + nKeys, pRight->m_aKey);
+        std::move(pLeaf->m_aValue + nLeft, pLeaf->m_aValue + nKeys, pRight->m_aValue);
+        pRight->m_nKey = nKeys - nLeft;
+        pLeaf->m_nKey = nLeft;
+        pRight->m_pPrev = pLeaf;
+        pRight->m_pNext = pLeaf->m_pNext;
+        if(pLeaf->m_pNext)
+            pLeaf->m_pNext->m_pPrev = pRight;
+        pLeaf->m_pNext = pRight;
+        insert_separator(path, pRight->m_aKey[0], pRight, apInner);
+        if(i > nLeft)
+        {
+            i -= nLeft;
+            pLeaf = pRight;
+        }
+    }
+
+    std::move_backward(pLeaf->m_aKey + i, pLeaf->m_aKey + pLeaf->m_nKey, pLeaf->m_aKey + pLeaf->m_nKey + 1);
+    std::move_backward(pLeaf->m_aValue + i, pLeaf->m_aValue + pLeaf->m_nKey, pLeaf->m_aValue + pLeaf->m_nKey + 1);
+    pLeaf->m_aKey[i] = key;
+    pLeaf->m_aValue[i] = Val();
+    ++pLeaf->m_nKey;
+    ++m_size;
+    return pLeaf->m_aValue[i];
+}
+
+/// <summary> Creates the inner nodes for the split of the leaf: one node for each full parent and the new root if all parents are full. </summary>
+/// <returns> Number of created nodes. </returns>
+/// <param name="path"> in. The path to the full leaf. </param>
+/// <param name="apInner"> out. The created nodes in order of levels. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, int nKeys> int TreeBPlus<Key, Val, Compare, nKeys>::create_inner(const Path& path, Inner** apInner)
+{
+    int nInner = 0;
+    try
+    {
+        for(int nLevel = 2; nLevel > m_nHeight || path.m_apNode[nLevel]->m_nKey == nKeys; ++nLevel)
+        {
+            assert(nInner <= eMaxHeight);
+            apInner[nInner] = create_node<Inner>();
+            ++nInner;
+            if(nLevel > m_nHeight)
+                break;
+        }
+    }
+    catch(...)
+    {
+        while(nInner)
+            free_node(apInner[--nInner]);
+        throw;
+    }
+    return nInner;
+}
+
+/// <summary> Inserts the separator and the new child after the child of the path into the parent, splits the full parents up to the root. </summary>
+/// <param name="path"> inout. The path to the split node. </param>
+/// <param name="key"> in. The least key of the new child. </param>
+/// <param name="pChild"> in. The new child. </param>
+/// <param name="apInner"> in. The nodes for the split parents and the new root, see create_inner. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, int nKeys> void TreeBPlus<Key, Val, Compare, nKeys>::insert_separator(Path& path, const Key& key, void* pChild, Inner** apInner)
+{
+    Key separator = key;
+    for(int nLevel = 2; ; ++nLevel)
+    {
+        // the root is split: the new root
+        if(nLevel > m_nHeight)
+        {
+            assert(m_nHeight < eMaxHeight);
+            Inner* pRoot = *apInner;
+            pRoot->m_aKey[0] = separator;
+            pRoot->m_aChild[0] = m_pRoot;
+            pRoot->m_aChild[1] = pChild;
+            pRoot->m_nKey = 1;
+            m_pRoot = pRoot;
+            ++m_nHeight;
+            return;
+        }
+
+        Inner* pInner = path.m_apNode[nLevel];
+        const int i = path.m_aIndex[nLevel];
+        if(pInner->m_nKey < nKeys)
+        {
+            std::move_backward(pInner->m_aKey + i, pInner->m_aKey + pInner->m_nKey, pInner->m_aKey + pInner->m_nKey + 1);
+            std::copy_backward(pInner->m_aChild + i + 1, pInner->m_aChild + pInner->m_nKey + 1, pInner->m_aChild + pInner->m_nKey + 2);
+            pInner->m_aKey[i] = separator;
+            pInner->m_aChild[i + 1] = pChild;
+            ++pInner->m_nKey;
+            return;
+        }
+
+        // the full node: the separators with the new one are distributed to halves, the middle separator goes up
+        Key aKey[nKeys + 1];
+        void* aChild[nKeys + 2];
+        std::move(pInner->m_aKey, pInner->m_aKey + i, aKey);
+        aKey[i] = separator;
+        std::move(pInner->m_aKey + i, pInner->m_aKey + nKeys, aKey + i + 1);
+        std::copy(pInner->m_aChild, pInner->m_aChild + i + 1, aChild);
+        aChild[i + 1] = pChild;
+        std::copy(pInner->m_aChild + i + 1, pInner->m_aChild + nKeys + 1, aChild + i + 2);
+
+        Inner* pRight = *apInner++;
+        const int nLeft = nKeys / 2;
+        std::move(aKey, aKey + nLeft, pInner->m_aKey);
+        std::copy(aChild, aChild + nLeft + 1, pInner->m_aChild);
+        pInner->m_nKey = nLeft;
+        std::move(aKey + nLeft + 1, aKey + nKeys + 1, pRight->m_aKey);
+        std::copy(aChild + nLeft + 1, aChild + nKeys + 2, pRight->m_aChild);
+        pRight->m_nKey = nKeys - nLeft;
+        separator = aKey[nLeft];
+        pChild = pRight;
+    }
+}
+
+/// <summary> Removes the key from the tree. The empty leaf is released. </summary>
+/// <param name="key"> in. The key to be removed. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, int nKeys> void TreeBPlus<Key, Val, Compare, nKeys>::erase(const Key& key)
+{
+    Path path;
+    Leaf* pLeaf = descend(key, &path);
+    if(!pLeaf)
+        return;
+    const int i = Search::lower(m_cmp, pLeaf->m_aKey, pLeaf->m_nKey, key);
+    if(i == pLeaf->m_nKey || compare(pLeaf->m_aKey[i], key) != 0)
+        return;
+
+    std::move(pLeaf->m_aKey + i + 1, pLeaf->m_aKey + pLeaf->m_nKey, pLeaf->m_aKey + i);
+    std::move(pLeaf->m_aValue + i + 1, pLeaf->m_aValue + pLeaf->m_nKey, pLeaf->m_aValue + i);
+    --pLeaf->m_nKey;
+    --m_size;
+    if(!pLeaf->m_nKey)
+        remove_leaf(pLeaf, path);
+}
+
+/// <summary> Removes the empty leaf from the tree, the parents which become empty are removed too, the root with one child is replaced by the child. </summary>
+/// <param name="pLeaf"> in. The empty leaf. </param>
+/// <param name="path"> in. The path to the leaf. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, int nKeys> void TreeBPlus<Key, Val, Compare, nKeys>::remove_leaf(Leaf* pLeaf, Path& path)
+{
+    if(pLeaf->m_pPrev)
+        pLeaf->m_pPrev->m_pNext = pLeaf->m_pNext;
+    else
+        m_pFirst = pLeaf->m_pNext;
+    if(pLeaf->m_pNext)
+        pLeaf->m_pNext->m_pPrev = pLeaf->m_pPrev;
+    free_node(pLeaf);
+
+    int nLevel = 2;
+    for(; nLevel <= m_nHeight; ++nLevel)
+    {
+        Inner* pInner = path.m_apNode[nLevel];
+        if(!pInner->m_nKey)
+        {
+            // the only child is removed
+            free_node(pInner);
+            continue;
+        }
+
+        // remove the child and the separator before it (or after it for the first child)
+        const int i = path.m_aIndex[nLevel];
+        const int iKey = i ? i - 1 : 0;
+        std::move(pInner->m_aKey + iKey + 1, pInner->m_aKey + pInner->m_nKey, pInner->m_aKey + iKey);
+        std::copy(pInner->m_aChild + i + 1, pInner->m_aChild + pInner->m_nKey + 1, pInner->m_aChild + i);
+        --pInner->m_nKey;
+        break;
+    }
+
+    if(nLevel > m_nHeight)
+    {
+        // the whole tree is removed
+        m_pRoot = NULL;
+        m_nHeight = 0;
+        return;
+    }
+
+    // the root with one child is replaced by the child
+    while(m_nHeight > 1 && !static_cast<Inner*>(m_pRoot)->m_nKey)
+    {
+        Inner* pRoot = static_cast<Inner*>(m_pRoot);
+        m_pRoot = pRoot->m_aChild[0];
+        free_node(pRoot);
+        --m_nHeight;
+    }
+}
+
+/// <summary> Checks structure of the tree. </summary>
+/// <returns> True if the tree is valid. </returns>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, int nKeys> bool TreeBPlus<Key, Val, Compare, nKeys>::isValid() const
+{
+    if(!m_pRoot)
+        return !m_nHeight && !m_pFirst && !m_size;
+    const Leaf* pPrev = NULL;
+    size_t nKey = 0;
+    return check_imp(m_pRoot, m_nHeight, NULL, NULL, pPrev, nKey) && !pPrev->m_pNext && nKey == m_size;
+}
+
+/// <summary> Checks the subtree: the keys are sorted and lie in [*pLow, *pHigh), the leaves are linked in order and aren't empty. </summary>
+/// <returns> True if the subtree is valid. </returns>
+/// <param name="pNode"> in. The root of subtree. </param>
+/// <param name="nLevel"> in. The level of the root. </param>
+/// <param name="pLow"> in. The lower bound of keys, NULL if not bounded. </param>
+/// <param name="pHigh"> in. The upper bound of keys, NULL if not bounded. </param>
+/// <param name="pPrev"> inout. The previous leaf. </param>
+/// <param name="nKey"> inout. Number of keys in the leaves. </param>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class Key, class Val, class Compare, int nKeys> bool TreeBPlus<Key, Val, Compare, nKeys>::check_imp(const void* pNode, int nLevel, const Key* pLow, const Key* pHigh, const Leaf*& pPrev, size_t& nKey) const
+{
+    const Key* aKey = nLevel == 1 ? static_cast<const Leaf*>(pNode)->m_aKey : static_cast<const Inner*>(pNode)->m_aKey;
+    const int n = nLevel == 1 ? static_cast<const Leaf*>(pNode)->m_nKey : static_cast<const Inner*>(pNode)->m_nKey;
+    if(n > nKeys || (nLevel == 1 && n < 1) || (reinterpret_cast<uintptr_t>(pNode) & 63))
+        return false;
+    for(int i = 0; i < n; ++i)
+    {
+        if((i && compare(aKey[i - 1], aKey[i]) >= 0) || (pLow && compare(aKey[i], *pLow) < 0) || (pHigh && compare(aKey[i], *pHigh) >= 0))
+            return false;
+    }
+
+    if(nLevel == 1)
+    {
+        const Leaf* pLeaf = static_cast<const Leaf*>(pNode);
+        if(pLeaf->m_pPrev != pPrev || (pPrev ? pPrev->m_pNext != pLeaf : m_pFirst != pLeaf))
+            return false;
+        pPrev = pLeaf;
+        nKey += n;
+        return true;
+    }
+
+    const Inner* pInner = static_cast<const Inner*>(pNode);
+    for(int i = 0; i <= n; ++i)
+    {
+        if(!check_imp(pInner->m_aChild[i], nLevel - 1, i ? &aKey[i - 1] : pLow, i < n ? &aKey[i] : pHigh, pPrev, nKey))
+            return false;
+    }
+    return true;
+}
@@ -0,0 +1,275 @@
+#pragma once
+#include "tree_avl.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/// <summary>
+/// Reader-writer lock for read-mostly data with per-core reader counters: a reader increments the counter of its slot (chosen by the thread id),
+/// so readers of different cores don't bounce one cache line. The writer raises the flag and waits until all counters are zero;
+/// a reader which sees the flag after its increment steps back and waits, so the writers aren't starved by the stream of readers.
+/// The writers are serialized by the mutex. The lock is not recursive. Lockable and SharedLockable: lock/unlock, lock_shared/unlock_shared.
+/// </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+class TreeSharedLock
+{
+public:
+    /// <summary> Constructor </summary>
+    /// <param name="nSlot"> in. Optional. Number of reader counters (rounded up to power of 2), by default - number of hardware threads. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    explicit TreeSharedLock(size_t nSlot = std::thread::hardware_concurrency()) : m_aSlot(NULL), m_nSlot(1), m_bWriter(false)
+    {
+        while(m_nSlot < nSlot)
+            m_nSlot *= 2;
+
+        // the array starts at cache line, so each slot occupies one line
+        m_aSlot = static_cast<Slot*>(tree_aligned_allocate(m_nSlot * sizeof(Slot)));
+        for(size_t i = 0; i < m_nSlot; ++i)
+            new(m_aSlot + i) Slot();
+    }
+
+    /// <summary> Destructor </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    ~TreeSharedLock()
+    {
+        for(size_t i = 0; i < m_nSlot; ++i)
+            m_aSlot[i].~Slot();
+        tree_aligned_free(m_aSlot);
+    }
+
+    /// <summary> Acquires the shared lock. </summary>
+    /// <returns> The slot of the reader, the lock released by another thread should be released by unlock_shared(slot). </returns>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    size_t lock_shared()
+    {
+        const size_t nSlot = slot();
+        std::atomic<long>& counter = m_aSlot[nSlot].m_nReader;
+        for(;;)
+        {
+            // the increment and the check of the flag are ordered against the flag and the check of counters by the writer
+            counter.fetch_add(1, std::memory_order_seq_cst);
+            if(!m_bWriter.load(std::memory_order_seq_cst))
+                return nSlot;
+            counter.fetch_sub(1, std::memory_order_release);
+            while(m_bWriter.load(std::memory_order_relaxed))
+                std::this_thread::yield();
+        }
+    }
+
+    /// <summary> Releases the shared lock. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void unlock_shared() { unlock_shared(slot()); }
+
+    /// <summary> Releases the shared lock acquired by any thread. </summary>
+    /// <param name="nSlot"> in. The slot returned by lock_shared. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void unlock_shared(size_t nSlot) { m_aSlot[nSlot].m_nReader.fetch_sub(1, std::memory_order_release); }
+
+    /// <summary> Acquires the exclusive lock: waits for other writers, then for the readers. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void lock()
+    {
+        m_mutex.lock();
+        m_bWriter.store(true, std::memory_order_seq_cst);
+        for(size_t i = 0; i < m_nSlot; ++i)
+        {
+            // the loads take part in the total order with the store of the flag: an acquire load might read the counter before the store
+            while(m_aSlot[i].m_nReader.load(std::memory_order_seq_cst))
+                std::this_thread::yield();
+        }
+    }
+
+    /// <summary> Releases the exclusive lock. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void unlock()
+    {
+        m_bWriter.store(false, std::memory_order_release);
+        m_mutex.unlock();
+    }
+
+    /// <summary> Checks the layout of the reader counters: each counter occupies its own cache line. </summary>
+    /// <returns> True if the slots are aligned to cache line. </returns>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    bool isValid() const { return sizeof(Slot) == 64 && reinterpret_cast<uintptr_t>(m_aSlot) % 64 == 0; }
+
+private:
+    // the counter of readers, the slot is aligned to cache line and padded to its size (the padding warning C4324 is expected)
+#if defined(_MSC_VER)
+#pragma warning(push)
+#pragma warning(disable : 4324)
+    struct __declspec(align(64)) Slot
+#else
+    struct alignas(64) Slot
+#endif
+    {
+        Slot() : m_nReader(0) {}
+
+        std::atomic<long> m_nReader;
+    };
+#if defined(_MSC_VER)
+#pragma warning(pop)
+#endif
+
+    // the slot of the calling thread: the hash of the thread id is mixed, as the ids of threads are often aligned addresses
+    size_t slot() const
+    {
+        if(m_nSlot == 1)
+            return 0;
+        const unsigned long long h = std::hash<std::thread::id>()(std::this_thread::get_id()) * 0x9E3779B97F4A7C15ull;
+        return size_t(h >> 40) & (m_nSlot - 1);
+    }
+
+    // copying is forbidden
+    TreeSharedLock(const TreeSharedLock&);
+    TreeSharedLock& operator=(const TreeSharedLock&);
+
+private:
+    // the reader counters, number of slots is power of 2
+    Slot* m_aSlot;
+    size_t m_nSlot;
+    std::atomic<bool> m_bWriter;
+    std::mutex m_mutex;
+};
+
+/// <summary>
+/// The wrapper which makes the tree safe for concurrent use: the lookups and the iterations run in parallel under the shared lock,
+/// the changes are serialized by the exclusive lock. The lookups return copies of values, because pointers into the tree are invalidated
+/// by the changes of other threads; the iterators are used through Reader, which holds the shared lock while it exists.
+/// TreeType is Tree or TreeBPlus, TreeCompact and TreeNoParent support the lookups and the changes, but neither size() nor iteration through Reader.
+/// Lock is TreeSharedLock (default) or another Lockable and SharedLockable lock, Reader may be moved to another thread only with TreeSharedLock.
+/// </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+template<class TreeType, class Lock = TreeSharedLock> class ConcurrentTree
+{
+public:
+    typedef TreeType Tree;
+
+    /// <summary> The shared access to the tree: the const methods of the tree and its iterators, the shared lock is held while the object exists. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    class Reader
+    {
+    public:
+        explicit Reader(const ConcurrentTree& tree) : m_pTree(&tree), m_nSlot(lock_shared(tree.m_lock)) {}
+        Reader(Reader&& reader) : m_pTree(reader.m_pTree), m_nSlot(reader.m_nSlot) { reader.m_pTree = NULL; }
+        ~Reader() { if(m_pTree) unlock_shared(m_pTree->m_lock, m_nSlot); }
+
+        const Tree& operator*() const { return m_pTree->m_tree; }
+        const Tree* operator->() const { return &m_pTree->m_tree; }
+
+    private:
+        Reader(const Reader&);
+        Reader& operator=(const Reader&);
+
+        const ConcurrentTree* m_pTree;
+        // the slot of the reader counter, which is released by the destructor even in another thread
+        size_t m_nSlot;
+    };
+
+    /// <summary> The exclusive access to the tree for several changes at once, the exclusive lock is held while the object exists. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    class Writer
+    {
+    public:
+        explicit Writer(ConcurrentTree& tree) : m_pTree(&tree) { m_pTree->m_lock.lock(); }
+        Writer(Writer&& writer) : m_pTree(writer.m_pTree) { writer.m_pTree = NULL; }
+        ~Writer() { if(m_pTree) m_pTree->m_lock.unlock(); }
+
+        Tree& operator*() const { return m_pTree->m_tree; }
+        Tree* operator->() const { return &m_pTree->m_tree; }
+
+    private:
+        Writer(const Writer&);
+        Writer& operator=(const Writer&);
+
+        ConcurrentTree* m_pTree;
+    };
+
+public:
+    /// <summary> Constructor </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    ConcurrentTree() {}
+
+    /// <summary> Searches for the key and copies its value. </summary>
+    /// <returns> True if the key is found. </returns>
+    /// <param name="key"> in. The key. </param>
+    /// <param name="val"> out. The value, unchanged if the key isn't found. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class K, class V> bool find(const K& key, V& val) const
+    {
+        Reader reader(*this);
+        const auto pVal = reader->find(key);
+        if(!pVal)
+            return false;
+        val = *pVal;
+        return true;
+    }
+
+    /// <summary> Counts nodes with the key. </summary>
+    /// <returns> 1 if the key is found, otherwise 0. </returns>
+    /// <param name="key"> in. The key. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class K> size_t count(const K& key) const
+    {
+        Reader reader(*this);
+        return reader->find(key) ? 1 : 0;
+    }
+
+    /// <summary> Queries number of nodes. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    size_t size() const
+    {
+        Reader reader(*this);
+        return reader->size();
+    }
+
+    /// <summary> Inserts the key into the tree. If the key exists in the tree - replaces its value. </summary>
+    /// <param name="key"> in. The key. </param>
+    /// <param name="val"> in. The value. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class K, class V> void insert(K&& key, V&& val)
+    {
+        Writer writer(*this);
+        writer->insert(std::forward<K>(key), std::forward<V>(val));
+    }
+
+    /// <summary> Removes the key from the tree. </summary>
+    /// <param name="key"> in. The key. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class K> void erase(const K& key)
+    {
+        Writer writer(*this);
+        writer->erase(key);
+    }
+
+    /// <summary> Removes all keys from the tree. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    void clear()
+    {
+        Writer writer(*this);
+        writer->clear();
+    }
+
+    /// <summary> Acquires the shared access: the lookups and the iterators of the tree. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Reader read() const { return Reader(*this); }
+
+    /// <summary> Acquires the exclusive access: any changes of the tree. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    Writer write() { return Writer(*this); }
+
+private:
+    // TreeSharedLock identifies the reader by the slot, other locks - by the thread
+    static size_t lock_shared(TreeSharedLock& lock) { return lock.lock_shared(); }
+    template<class L> static size_t lock_shared(L& lock) { lock.lock_shared(); return 0; }
+    static void unlock_shared(TreeSharedLock& lock, size_t nSlot) { lock.unlock_shared(nSlot); }
+    template<class L> static void unlock_shared(L& lock, size_t) { lock.unlock_shared(); }
+
+    // copying is forbidden
+    ConcurrentTree(const ConcurrentTree&);
+    ConcurrentTree& operator=(const ConcurrentTree&);
+
+private:
+    Tree m_tree;
+    mutable Lock m_lock;
+};
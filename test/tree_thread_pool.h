@@ -0,0 +1,304 @@
+#pragma once
+#include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// <summary>
+/// The work-stealing pool of worker threads for fork-join parallelism of tree algorithms.
+/// Each thread has its own deque of published tasks: invoke(a, b) pushes b to the back of the deque of the calling thread and runs a,
+/// then pops b back if no thread has stolen it (the owner works LIFO, so the recent small tasks stay in its cache).
+/// The idle threads steal the oldest (the largest) tasks from the front of other deques. Each deque has its own lock,
+/// so the threads contend only when they touch the same deque. The thread which waits for a stolen task helps with other tasks,
+/// and sleeps till the task is finished if there are none. The threads which aren't workers of the pool share one deque.
+/// </summary>
+/// <remarks> Author: Vladimir Zelyonkin </remarks>
+class TreeThreadPool
+{
+public:
+    /// <summary> Constructor, starts the workers. </summary>
+    /// <param name="nThread"> in. Optional. Number of threads including the calling one, by default - number of hardware threads. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    explicit TreeThreadPool(size_t nThread = std::thread::hardware_concurrency()) 
+        : m_nQueue(std::max<size_t>(nThread, 1)), m_aQueue(new Queue[m_nQueue]), m_nTask(0), m_nIdle(0), m_bStop(false)
+    {
+        // the started workers are stopped if a thread can't be started
+        try
+        {
+            m_aThread.reserve(m_nQueue - 1);
+            for(size_t i = 1; i < nThread; ++i)
+                m_aThread.push_back(std::thread([this, i]() { work(i); }));
+        }
+        catch(...)
+        {
+            stop();
+            throw;
+        }
+    }
+
+    /// <summary> Destructor, stops the workers. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    ~TreeThreadPool()
+    {
+        stop();
+    }
+
+    /// <summary> The pool shared by trees by default. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    static TreeThreadPool& instance()
+    {
+        // the local statics of VS2013 aren't thread-safe: the pool is constructed once under the flag initialized before main
+        std::call_once(Shared<TreeThreadPool>::s_flag, []()
+        {
+            static TreeThreadPool s_pool;
+            Shared<TreeThreadPool>::s_pPool = &s_pool;
+        });
+        return *Shared<TreeThreadPool>::s_pPool;
+    }
+
+    /// <summary> Queries number of threads including the calling one. </summary>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    size_t size() const { return m_aThread.size() + 1; }
+
+    /// <summary> Runs two functions in parallel and waits for both. The exception of a function is rethrown after both are finished. </summary>
+    /// <param name="fnA"> in. The function which is run by the calling thread. </param>
+    /// <param name="fnB"> in. The function which may be run by a worker. </param>
+    /// <remarks> Author: Vladimir Zelyonkin </remarks>
+    template<class FnA, class FnB> void invoke(FnA&& fnA, FnB&& fnB)
+    {
+        if(m_aThread.empty())
+        {
+            fnA();
+            fnB();
+            return;
+        }
+
+        Task task(fnB);
+        const size_t iQueue = queue_index();
+        push(iQueue, &task);
+
+        std::exception_ptr pError;
+        try
+        {
+            fnA();
+        }
+        catch(...)
+        {
+            pError = std::current_exception();
+        }
+
+        // run the task if no thread has stolen it, otherwise wait for it
+        if(remove(iQueue, &task))
+            task.run();
+        else
+            wait(iQueue, task);
+
+        if(!pError)
+            pError = task.m_pError;
+        if(pError)
+            std::rethrow_exception(pError);
+    }
+
+private:
+    // the shared pool, the template allows to define static members in the header
+    template<class T> struct Shared
+    {
+        static std::once_flag s_flag;
+        static T* s_pPool;
+    };
+
+    // the published function
+    struct Task
+    {
+        explicit Task(std::function<void()> fn) : m_fn(fn), m_bDone(false) {}
+
+        void run()
+        {
+            try
+            {
+                m_fn();
+            }
+            catch(...)
+            {
+                m_pError = std::current_exception();
+            }
+
+            // the flag is set under the lock: the waiting thread destroys the task only after it gets the lock
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_bDone.store(true, std::memory_order_release);
+            m_cvDone.notify_one();
+        }
+
+        std::function<void()> m_fn;
+        std::exception_ptr m_pError;
+        std::atomic<bool> m_bDone;
+        std::mutex m_mutex;
+        std::condition_variable m_cvDone;
+    };
+
+    // the deque of tasks published by one thread
+    struct Queue
+    {
+        std::mutex m_mutex;
+        std::deque<Task*> m_deque;
+    };
+
+    // the index of the deque of the calling thread: the workers own the deques 1..n-1, other threads share the deque 0
+    size_t queue_index() const
+    {
+        const std::thread::id id = std::this_thread::get_id();
+        for(size_t i = 0; i < m_aThread.size(); ++i)
+        {
+            if(m_aThread[i].get_id() == id)
+                return i + 1;
+        }
+        return 0;
+    }
+
+    void push(size_t iQueue, Task* pTask)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_aQueue[iQueue].m_mutex);
+            m_aQueue[iQueue].m_deque.push_back(pTask);
+        }
+
+        // the sleeping worker checks the counter of tasks under the lock of the pool after it is counted as idle
+        m_nTask.fetch_add(1);
+        if(m_nIdle.load() > 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+            }
+            m_cvTask.notify_one();
+        }
+    }
+
+    // removes the task if no thread has stolen it, the task of the owner is at the back (the shared deque is searched)
+    bool remove(size_t iQueue, Task* pTask)
+    {
+        Queue& queue = m_aQueue[iQueue];
+        std::lock_guard<std::mutex> lock(queue.m_mutex);
+        for(std::deque<Task*>::reverse_iterator it = queue.m_deque.rbegin(); it != queue.m_deque.rend(); ++it)
+        {
+            if(*it == pTask)
+            {
+                queue.m_deque.erase(std::next(it).base());
+                m_nTask.fetch_sub(1);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // takes the newest task of the owner (bBack) or the oldest task for the thief
+    Task* take(size_t iQueue, bool bBack)
+    {
+        Queue& queue = m_aQueue[iQueue];
+        std::lock_guard<std::mutex> lock(queue.m_mutex);
+        if(queue.m_deque.empty())
+            return NULL;
+        Task* pTask;
+        if(bBack)
+        {
+            pTask = queue.m_deque.back();
+            queue.m_deque.pop_back();
+        }
+        else
+        {
+            pTask = queue.m_deque.front();
+            queue.m_deque.pop_front();
+        }
+        m_nTask.fetch_sub(1);
+        return pTask;
+    }
+
+    // steals a task from other deques starting from the next one, then from the own deque
+    Task* steal(size_t iQueue)
+    {
+        for(size_t i = 1; i <= m_nQueue; ++i)
+        {
+            if(Task* pTask = take((iQueue + i) % m_nQueue, false))
+                return pTask;
+        }
+        return NULL;
+    }
+
+    // helps with other tasks while the stolen task is run by another thread, sleeps if there are no tasks
+    void wait(size_t iQueue, Task& task)
+    {
+        while(!task.m_bDone.load(std::memory_order_acquire))
+        {
+            if(Task* pTask = steal(iQueue))
+                pTask->run();
+            else
+            {
+                std::unique_lock<std::mutex> lock(task.m_mutex);
+                task.m_cvDone.wait(lock, [&task]() { return task.m_bDone.load(std::memory_order_relaxed); });
+            }
+        }
+
+        // the thief may still hold the lock of the task
+        std::lock_guard<std::mutex> lock(task.m_mutex);
+    }
+
+    void work(size_t iQueue)
+    {
+        for(;;)
+        {
+            Task* pTask = take(iQueue, true);
+            if(!pTask)
+                pTask = steal(iQueue);
+            if(pTask)
+            {
+                pTask->run();
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_nIdle.fetch_add(1);
+            m_cvTask.wait(lock, [this]() { return m_bStop || m_nTask.load() > 0; });
+            m_nIdle.fetch_sub(1);
+            if(m_bStop && !m_nTask.load())
+                return;
+        }
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_bStop = true;
+        }
+        m_cvTask.notify_all();
+        for(size_t i = 0; i < m_aThread.size(); ++i)
+            m_aThread[i].join();
+    }
+
+    // copying is forbidden
+    TreeThreadPool(const TreeThreadPool&);
+    TreeThreadPool& operator=(const TreeThreadPool&);
+
+private:
+    // the deques of the threads (the workers read the number while the others are started)
+    const size_t m_nQueue;
+    std::unique_ptr<Queue[]> m_aQueue;
+    // number of tasks in the deques
+    std::atomic<size_t> m_nTask;
+    // number of workers which sleep (or are going to sleep) under the lock of the pool
+    std::atomic<size_t> m_nIdle;
+    // the lock and the condition of sleeping workers
+    std::mutex m_mutex;
+    std::condition_variable m_cvTask;
+    bool m_bStop;
+    std::vector<std::thread> m_aThread;
+};
+
+template<class T> std::once_flag TreeThreadPool::Shared<T>::s_flag;
+template<class T> T* TreeThreadPool::Shared<T>::s_pPool = NULL;